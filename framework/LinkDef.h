@@ -12,6 +12,7 @@
 #pragma link C++ class base::SubEvent+;
 #pragma link C++ class base::LocalStampConverter+;
 #pragma link C++ class base::Event+;
+#pragma link C++ class base::Timeslice+;
 #pragma link C++ class base::Message+;
 #pragma link C++ class base::Iterator+;
 #pragma link C++ class base::Processor+;
@@ -87,6 +88,8 @@
 #pragma link C++ class std::vector<hadaq::MessageFloat>+;
 #pragma link C++ struct hadaq::MessageDouble+;
 #pragma link C++ class std::vector<hadaq::MessageDouble>+;
+#pragma link C++ struct hadaq::MessageInt+;
+#pragma link C++ class std::vector<hadaq::MessageInt>+;
 #pragma link C++ class hadaq::MessageMonitor+;
 #pragma link C++ class std::vector<hadaq::MessageMonitor>+;
 #pragma link C++ struct hadaq::MdcMessage+;
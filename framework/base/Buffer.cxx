@@ -3,6 +3,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <cstdio>
+#include <new>
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 /// reset buffer
@@ -10,8 +11,10 @@
 void base::Buffer::reset()
 {
    if (fRec) {
-      if (--fRec->refcnt == 0)
+      if (fRec->decref()) {
+         fRec->~RawDataRec();
          free(fRec);
+      }
       fRec = nullptr;
    }
 }
@@ -46,9 +49,9 @@ void base::Buffer::makenew(unsigned datalen)
       return;
    }
 
-   fRec->reset();
+   new (fRec) RawDataRec();
 
-   fRec->refcnt = 1;
+   fRec->refcnt.store(1, std::memory_order_relaxed);
 
    fRec->buf = (char*) fRec + sizeof(RawDataRec);
 
@@ -71,9 +74,9 @@ void base::Buffer::makecopyof(void* buf, unsigned datalen)
       return;
    }
 
-   fRec->reset();
+   new (fRec) RawDataRec();
 
-   fRec->refcnt = 1;
+   fRec->refcnt.store(1, std::memory_order_relaxed);
 
    fRec->buf = (char*) fRec + sizeof(RawDataRec);
    memcpy(fRec->buf, buf, datalen);
@@ -96,9 +99,9 @@ void base::Buffer::makereferenceof(void* buf, unsigned datalen)
       return;
    }
 
-   fRec->reset();
+   new (fRec) RawDataRec();
 
-   fRec->refcnt = 1;
+   fRec->refcnt.store(1, std::memory_order_relaxed);
 
    fRec->buf = buf;
 
@@ -0,0 +1,557 @@
+#include "base/ColumnStore.h"
+
+#include <cstring>
+
+#ifndef STREAM_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+   /** copy string into fixed-size field */
+   void CopyName(char *tgt, const char *src)
+   {
+      strncpy(tgt, src ? src : "", base::ColumnFile::NameLength - 1);
+      tgt[base::ColumnFile::NameLength - 1] = 0;
+   }
+
+   /** read value of specified type as integer, for float and double bit pattern is used
+     * Differences calculated modulo 2^64, therefore unsigned type is used */
+   uint64_t GetInt(const uint8_t *src, unsigned type)
+   {
+      switch (type) {
+         case base::ColumnFile::col_UInt8: return *src;
+         case base::ColumnFile::col_UInt16: { uint16_t v; memcpy(&v, src, 2); return v; }
+         case base::ColumnFile::col_UInt32:
+         case base::ColumnFile::col_Float: { uint32_t v; memcpy(&v, src, 4); return v; }
+         case base::ColumnFile::col_Int32: { int32_t v; memcpy(&v, src, 4); return (uint64_t) (int64_t) v; }
+         case base::ColumnFile::col_UInt64:
+         case base::ColumnFile::col_Double: { uint64_t v; memcpy(&v, src, 8); return v; }
+      }
+      return 0;
+   }
+
+   /** write value of specified type, for float and double bit pattern is provided */
+   void SetInt(uint8_t *tgt, unsigned type, uint64_t value)
+   {
+      switch (type) {
+         case base::ColumnFile::col_UInt8: *tgt = (uint8_t) value; break;
+         case base::ColumnFile::col_UInt16: { uint16_t v = value; memcpy(tgt, &v, 2); break; }
+         case base::ColumnFile::col_UInt32:
+         case base::ColumnFile::col_Int32:
+         case base::ColumnFile::col_Float: { uint32_t v = value; memcpy(tgt, &v, 4); break; }
+         case base::ColumnFile::col_UInt64:
+         case base::ColumnFile::col_Double: memcpy(tgt, &value, 8); break;
+      }
+   }
+
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Returns true if file name has ".strm" extension, used to select columnar store
+
+bool base::ColumnFile::IsColumnFile(const char *fname)
+{
+   if (!fname) return false;
+   size_t len = strlen(fname);
+   return (len > 5) && (strcmp(fname + len - 5, ".strm") == 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// destructor
+
+base::ColumnStoreWriter::~ColumnStoreWriter()
+{
+   Close();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Create output file
+
+bool base::ColumnStoreWriter::Open(const char *fname)
+{
+   Close();
+
+   fFile = fopen(fname, "wb");
+   if (!fFile) {
+      printf("Cannot open file %s for writing\n", fname);
+      return false;
+   }
+
+   fFileName = fname;
+   fGroups.clear();
+   fColumns.clear();
+   fHeaderWritten = false;
+   fChunkEvents = 0;
+   fChunkBytes = 0;
+   fNumEvents = 0;
+   fNumChunks = 0;
+
+   return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Write collected events and close file
+
+bool base::ColumnStoreWriter::Close()
+{
+   if (!fFile) return false;
+
+   bool res = WriteHeader() && WriteChunk();
+
+   fclose(fFile);
+   fFile = nullptr;
+
+   if (!res)
+      printf("Failure when writing file %s\n", fFileName.c_str());
+
+   return res;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Add group, returns group index or -1 if columns cannot be added anymore
+
+int base::ColumnStoreWriter::AddGroup(const char *name)
+{
+   if (!fFile || fHeaderWritten) {
+      printf("Cannot add group %s to columnar store\n", name);
+      return -1;
+   }
+
+   fGroups.emplace_back();
+   fGroups.back().name = name;
+   fGroups.back().offsets.emplace_back(0);
+
+   return fGroups.size() - 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Add column to the group, returns column index or -1 if columns cannot be added anymore
+/// If compress specified, values stored as differences when it reduces data size.
+/// For float and double differences of bit patterns are used, which is efficient for close values like time stamps
+
+int base::ColumnStoreWriter::AddColumn(int group, const char *name, ColumnFile::ColumnType type, bool compress)
+{
+   if (!fFile || fHeaderWritten || (group < 0) || (group >= (int) fGroups.size()) || !ColumnFile::TypeSize(type)) {
+      printf("Cannot add column %s to columnar store\n", name);
+      return -1;
+   }
+
+   fColumns.emplace_back();
+   auto &rec = fColumns.back();
+   rec.name = name;
+   rec.group = group;
+   rec.type = type;
+   rec.size = ColumnFile::TypeSize(type);
+   rec.compress = compress;
+
+   int indx = fColumns.size() - 1;
+
+   if (fGroups[group].firstcol < 0)
+      fGroups[group].firstcol = indx;
+
+   return indx;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Write file header with groups and columns descriptors
+
+bool base::ColumnStoreWriter::WriteHeader()
+{
+   if (fHeaderWritten) return true;
+
+   ColumnFile::Header hdr;
+   memset(&hdr, 0, sizeof(hdr));
+   memcpy(hdr.magic, "STRMCOLS", 8);
+   hdr.version = ColumnFile::Version;
+   hdr.numgroups = fGroups.size();
+   hdr.numcolumns = fColumns.size();
+
+   if (fwrite(&hdr, sizeof(hdr), 1, fFile) != 1) return false;
+
+   for (auto &grp : fGroups) {
+      ColumnFile::Group descr;
+      memset(&descr, 0, sizeof(descr));
+      CopyName(descr.name, grp.name.c_str());
+      if (fwrite(&descr, sizeof(descr), 1, fFile) != 1) return false;
+   }
+
+   for (auto &col : fColumns) {
+      ColumnFile::Column descr;
+      memset(&descr, 0, sizeof(descr));
+      CopyName(descr.name, col.name.c_str());
+      descr.group = col.group;
+      descr.type = col.type;
+      if (fwrite(&descr, sizeof(descr), 1, fFile) != 1) return false;
+   }
+
+   fHeaderWritten = true;
+   return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Append block with values to the encoded chunk
+/// When compression enabled, values stored as zigzag varint of difference to previous value,
+/// but only if result is smaller than original data. Float and double values handled as bit patterns
+
+void base::ColumnStoreWriter::EncodeBlock(const uint8_t *data, unsigned count, unsigned type, bool compress)
+{
+   size_t hdrpos = fEncoded.size();
+   fEncoded.resize(hdrpos + sizeof(ColumnFile::Block));
+
+   unsigned size = ColumnFile::TypeSize(type);
+   uint64_t rawbytes = (uint64_t) count * size;
+   uint32_t codec = ColumnFile::codec_None;
+
+   if (compress && count) {
+      uint64_t prev = 0;
+      for (unsigned n = 0; n < count; ++n) {
+         uint64_t value = GetInt(data + n * size, type), diff = value - prev;
+         prev = value;
+         uint64_t zz = (diff << 1) ^ (uint64_t) ((int64_t) diff >> 63);
+         while (zz >= 0x80) {
+            fEncoded.emplace_back((uint8_t) (zz | 0x80));
+            zz >>= 7;
+         }
+         fEncoded.emplace_back((uint8_t) zz);
+         if (fEncoded.size() - hdrpos - sizeof(ColumnFile::Block) >= rawbytes) break;
+      }
+
+      if (fEncoded.size() - hdrpos - sizeof(ColumnFile::Block) < rawbytes)
+         codec = ColumnFile::codec_Delta;
+      else
+         fEncoded.resize(hdrpos + sizeof(ColumnFile::Block));
+   }
+
+   if (codec == ColumnFile::codec_None)
+      fEncoded.insert(fEncoded.end(), data, data + rawbytes);
+
+   ColumnFile::Block blk;
+   blk.codec = codec;
+   blk.type = type;
+   blk.count = count;
+   blk.nbytes = fEncoded.size() - hdrpos - sizeof(ColumnFile::Block);
+   memcpy(fEncoded.data() + hdrpos, &blk, sizeof(blk));
+
+   // pad to 8 bytes that next block and uncompressed data are aligned
+   fEncoded.resize((fEncoded.size() + 7) & ~((size_t) 7), 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Write collected events as single chunk
+
+bool base::ColumnStoreWriter::WriteChunk()
+{
+   if (fChunkEvents == 0) return true;
+
+   fEncoded.resize(sizeof(ColumnFile::Chunk));
+
+   for (auto &grp : fGroups)
+      EncodeBlock((const uint8_t *) grp.offsets.data(), grp.offsets.size(), ColumnFile::col_UInt32, true);
+
+   for (auto &col : fColumns)
+      EncodeBlock(col.data.data(), col.count, col.type, col.compress);
+
+   ColumnFile::Chunk chunk;
+   chunk.magic = ColumnFile::ChunkMagic;
+   chunk.numevents = fChunkEvents;
+   chunk.size = fEncoded.size();
+   memcpy(fEncoded.data(), &chunk, sizeof(chunk));
+
+   bool res = fwrite(fEncoded.data(), fEncoded.size(), 1, fFile) == 1;
+
+   for (auto &grp : fGroups) {
+      grp.offsets.clear();
+      grp.offsets.emplace_back(0);
+   }
+
+   for (auto &col : fColumns) {
+      col.data.clear();
+      col.count = 0;
+   }
+
+   fChunkEvents = 0;
+   fChunkBytes = 0;
+   fNumChunks++;
+
+   return res;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Close event - values appended to columns since previous call belong to this event
+/// Number of entries in the group defined by its first column
+
+bool base::ColumnStoreWriter::FillEvent()
+{
+   if (!fFile) return false;
+
+   if (!fHeaderWritten && !WriteHeader())
+      return false;
+
+   for (auto &grp : fGroups)
+      grp.offsets.emplace_back(grp.firstcol < 0 ? 0 : fColumns[grp.firstcol].count);
+
+   fChunkEvents++;
+   fNumEvents++;
+
+   if ((fChunkEvents >= fMaxChunkEvents) || (fChunkBytes >= fMaxChunkBytes))
+      return WriteChunk();
+
+   return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// destructor
+
+base::ColumnStoreReader::~ColumnStoreReader()
+{
+   Close();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Open file and scan chunks
+/// Incomplete last chunk, which may appear when writer was not closed, is ignored
+
+bool base::ColumnStoreReader::Open(const char *fname)
+{
+   Close();
+
+#ifdef STREAM_WINDOWS
+   FILE *f = fopen(fname, "rb");
+   if (!f) return false;
+   fseek(f, 0, SEEK_END);
+   long sz = ftell(f);
+   fseek(f, 0, SEEK_SET);
+   fBuffer.resize(sz > 0 ? sz : 0);
+   bool ok = (sz > 0) && (fread(fBuffer.data(), sz, 1, f) == 1);
+   fclose(f);
+   if (!ok) return false;
+   fData = fBuffer.data();
+   fSize = fBuffer.size();
+#else
+   int fd = open(fname, O_RDONLY);
+   if (fd < 0) return false;
+
+   struct stat st;
+   if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+      close(fd);
+      return false;
+   }
+
+   void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (mem == MAP_FAILED) return false;
+
+   fData = (const char *) mem;
+   fSize = st.st_size;
+#endif
+
+   auto hdr = (const ColumnFile::Header *) fData;
+
+   if ((fSize < sizeof(ColumnFile::Header)) || (memcmp(hdr->magic, "STRMCOLS", 8) != 0) || (hdr->version != ColumnFile::Version)) {
+      printf("File %s is not columnar store\n", fname);
+      Close();
+      return false;
+   }
+
+   uint64_t pos = sizeof(ColumnFile::Header) + hdr->numgroups * sizeof(ColumnFile::Group) + hdr->numcolumns * sizeof(ColumnFile::Column);
+   if (pos > fSize) {
+      printf("File %s is truncated\n", fname);
+      Close();
+      return false;
+   }
+
+   fHeader = hdr;
+   fGroups = (const ColumnFile::Group *) (fData + sizeof(ColumnFile::Header));
+   fColumns = (const ColumnFile::Column *) (fData + sizeof(ColumnFile::Header) + hdr->numgroups * sizeof(ColumnFile::Group));
+
+   while (pos + sizeof(ColumnFile::Chunk) <= fSize) {
+      auto chunk = (const ColumnFile::Chunk *) (fData + pos);
+      if ((chunk->magic != ColumnFile::ChunkMagic) || (chunk->size < sizeof(ColumnFile::Chunk)) || (pos + chunk->size > fSize)) break;
+      fChunks.emplace_back(pos);
+      fNumEvents += chunk->numevents;
+      pos += chunk->size;
+   }
+
+   return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Close file
+
+void base::ColumnStoreReader::Close()
+{
+#ifndef STREAM_WINDOWS
+   if (fData)
+      munmap((void *) fData, fSize);
+#endif
+   fData = nullptr;
+   fSize = 0;
+   fBuffer.clear();
+   fHeader = nullptr;
+   fGroups = nullptr;
+   fColumns = nullptr;
+   fChunks.clear();
+   fNumEvents = 0;
+   fChunk = -1;
+   fChunkEvents = 0;
+   fBlocks.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Find group by name, returns -1 if not found
+
+int base::ColumnStoreReader::FindGroup(const char *name) const
+{
+   for (unsigned n = 0; n < NumGroups(); ++n)
+      if (strncmp(fGroups[n].name, name, ColumnFile::NameLength - 1) == 0)
+         return n;
+   return -1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Find column of the group by name, returns -1 if not found
+
+int base::ColumnStoreReader::FindColumn(int group, const char *name) const
+{
+   for (unsigned n = 0; n < NumColumns(); ++n)
+      if (((int) fColumns[n].group == group) && (strncmp(fColumns[n].name, name, ColumnFile::NameLength - 1) == 0))
+         return n;
+   return -1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Select chunk, returns false if chunk is broken
+
+bool base::ColumnStoreReader::SelectChunk(unsigned n)
+{
+   fChunk = -1;
+   fChunkEvents = 0;
+   fBlocks.clear();
+
+   if (n >= fChunks.size()) return false;
+
+   auto chunk = (const ColumnFile::Chunk *) (fData + fChunks[n]);
+
+   unsigned numblocks = NumGroups() + NumColumns();
+   fBlocks.resize(numblocks);
+
+   uint64_t pos = sizeof(ColumnFile::Chunk);
+   for (unsigned k = 0; k < numblocks; ++k) {
+      auto blk = (const ColumnFile::Block *) ((const char *) chunk + pos);
+      if (pos + sizeof(ColumnFile::Block) > chunk->size) break;
+      pos += sizeof(ColumnFile::Block) + ((blk->nbytes + 7) & ~((uint64_t) 7));
+      if (pos > chunk->size) break;
+      fBlocks[k].hdr = blk;
+   }
+
+   if (!fBlocks.empty() && !fBlocks.back().hdr) {
+      printf("Chunk %u is broken\n", n);
+      fBlocks.clear();
+      return false;
+   }
+
+   fChunk = n;
+   fChunkEvents = chunk->numevents;
+   return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Returns data of the block in selected chunk, decode it if necessary
+/// Block must have requested type, data size verified before it is used
+
+const void *base::ColumnStoreReader::GetBlock(unsigned indx, unsigned type, unsigned &count)
+{
+   count = 0;
+   if ((fChunk < 0) || (indx >= fBlocks.size())) return nullptr;
+
+   auto &rec = fBlocks[indx];
+   unsigned size = ColumnFile::TypeSize(type);
+
+   if ((rec.hdr->type != type) || !size) {
+      printf("Block %u in chunk %d has type %u, expected %u\n", indx, fChunk, (unsigned) rec.hdr->type, type);
+      return nullptr;
+   }
+
+   const uint8_t *src = (const uint8_t *) rec.hdr + sizeof(ColumnFile::Block);
+
+   if (rec.hdr->codec == ColumnFile::codec_None) {
+      if ((uint64_t) rec.hdr->count * size > rec.hdr->nbytes) {
+         printf("Block %u in chunk %d is broken\n", indx, fChunk);
+         return nullptr;
+      }
+      count = rec.hdr->count;
+      return src;
+   }
+
+   if (rec.hdr->codec != ColumnFile::codec_Delta) {
+      printf("Block %u in chunk %d has unknown codec %u\n", indx, fChunk, (unsigned) rec.hdr->codec);
+      return nullptr;
+   }
+
+   if (rec.isdecoded) {
+      count = rec.hdr->count;
+      return rec.decoded.data();
+   }
+
+   // every value encoded at least with one byte
+   unsigned num = rec.hdr->count;
+   if (num > rec.hdr->nbytes) {
+      printf("Block %u in chunk %d is broken\n", indx, fChunk);
+      return nullptr;
+   }
+
+   rec.decoded.resize((size_t) num * size);
+
+   const uint8_t *end = src + rec.hdr->nbytes;
+   uint64_t prev = 0;
+
+   for (unsigned n = 0; n < num; ++n) {
+      uint64_t zz = 0;
+      unsigned shift = 0;
+      while ((src < end) && (*src & 0x80) && (shift < 63)) {
+         zz |= (uint64_t) (*src++ & 0x7f) << shift;
+         shift += 7;
+      }
+      if ((src >= end) || (*src & 0x80)) {
+         printf("Block %u in chunk %d is broken\n", indx, fChunk);
+         rec.decoded.clear();
+         return nullptr;
+      }
+      zz |= (uint64_t) *src++ << shift;
+
+      prev += (zz >> 1) ^ (~(zz & 1) + 1);
+      SetInt(rec.decoded.data() + n * size, type, prev);
+   }
+
+   count = num;
+
+   rec.isdecoded = true;
+   return rec.decoded.data();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Returns event offsets of the group in selected chunk, ChunkEvents()+1 values
+/// Entries of event n are in range [offsets[n], offsets[n+1])
+
+const uint32_t *base::ColumnStoreReader::GetOffsets(unsigned group)
+{
+   unsigned count = 0;
+   if (group >= NumGroups()) return nullptr;
+   return (const uint32_t *) GetBlock(group, ColumnFile::col_UInt32, count);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Returns values of column in selected chunk
+/// Uncompressed values are not copied
+
+const void *base::ColumnStoreReader::GetColumn(unsigned col, unsigned *count)
+{
+   unsigned cnt = 0;
+   const void *res = col < NumColumns() ? GetBlock(NumGroups() + col, fColumns[col].type, cnt) : nullptr;
+   if (count) *count = cnt;
+   return res;
+}
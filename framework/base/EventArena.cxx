@@ -0,0 +1,98 @@
+#include "base/EventArena.h"
+
+#include <cstdlib>
+#include <cstdio>
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// constructor
+
+base::EventArena::EventArena(size_t chunksize) :
+   fChunkSize(chunksize < 0x400 ? 0x400 : chunksize)
+{
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// destructor
+
+base::EventArena::~EventArena()
+{
+   for (auto &chunk : fChunks)
+      free(chunk.buf);
+   fChunks.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Allocate memory when current chunk is full
+/// Takes next already existing chunk or creates new one
+
+void *base::EventArena::AllocateSlow(size_t sz, size_t /* align */)
+{
+   // try chunks which remain from previous events
+   while (fCurrent + 1 < fChunks.size()) {
+      fUsed += fPos;
+      fCurrent++;
+      fPos = 0;
+      if (sz <= fChunks[fCurrent].size) {
+         fPos = sz;
+         return fChunks[fCurrent].buf;
+      }
+   }
+
+   Chunk chunk;
+   chunk.size = (sz > fChunkSize) ? sz : fChunkSize;
+   chunk.buf = (char *) malloc(chunk.size);
+   if (!chunk.buf) {
+      printf("EventArena allocation error sz %ld\n", (long) chunk.size);
+      return nullptr;
+   }
+
+   if (!fChunks.empty()) {
+      fUsed += fPos;
+      fCurrent++;
+   }
+   fChunks.emplace_back(chunk);
+
+   // malloc provides memory aligned for any standard type
+   fPos = sz;
+   return chunk.buf;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Reset arena - all memory can be used again
+/// If several chunks were used, they are merged into single one to avoid chunk switching next time
+
+void base::EventArena::Reset()
+{
+   size_t used = GetUsed();
+   if (used > fPeak) fPeak = used;
+
+   if (fCurrent > 0) {
+      size_t total = GetTotalSize();
+      for (auto &chunk : fChunks)
+         free(chunk.buf);
+      fChunks.clear();
+
+      Chunk chunk;
+      chunk.size = total;
+      chunk.buf = (char *) malloc(total);
+      if (chunk.buf)
+         fChunks.emplace_back(chunk);
+      else
+         printf("EventArena allocation error sz %ld\n", (long) total);
+   }
+
+   fCurrent = 0;
+   fPos = 0;
+   fUsed = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Returns total size of all allocated chunks
+
+size_t base::EventArena::GetTotalSize() const
+{
+   size_t total = 0;
+   for (auto &chunk : fChunks)
+      total += chunk.size;
+   return total;
+}
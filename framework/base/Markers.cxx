@@ -15,6 +15,11 @@ void base::GlobalMarker::SetInterval(double left, double right)
 
    lefttm = globaltm + left;
    righttm = globaltm + right;
+
+   // offsets converted separately, therefore interval width does not depend from absolute time
+   globalps = SecondsToPs(globaltm);
+   leftps = globalps + SecondsToPs(left);
+   rightps = globalps + SecondsToPs(right);
 }
 
 ///////////////////////////////////////////////////////////////////////////
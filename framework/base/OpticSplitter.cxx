@@ -77,10 +77,11 @@ bool base::OpticSplitter::FirstBufferScan(const base::Buffer& buf)
          proc->fSplitBuf.rec().format = buf.rec().format;
          proc->fSplitBuf.rec().boardid = entry.first;
 
-         proc->AddNextBuffer(proc->fSplitBuf);
+         // rejected buffer is accounted by processor, data source should throttle with ProcMgr::CanAcceptRawData()
+         if (!proc->AddNextBuffer(std::move(proc->fSplitBuf)))
+            proc->fSplitBuf.reset();
 
          proc->fSplitPtr = nullptr;
-         proc->fSplitBuf.reset();
       }
    }
 
@@ -2,12 +2,123 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 
 #include "base/StreamProc.h"
 #include "base/EventProc.h"
+#include "base/ColumnStore.h"
 
 base::ProcMgr* base::ProcMgr::fInstance = nullptr;
 
+namespace base {
+
+   /** \brief Workers for parallel build of timeslices
+     *
+     * Threads are waiting for new generation of tasks, calling thread also takes part in processing.
+     * Tasks distributed via atomic counter. Every task has own event with subevents of all processors,
+     * events are reused for next timeslices */
+
+   class TimesliceWorkers {
+   public:
+      std::vector<std::thread> thrds;     ///< threads
+      std::mutex m;                       ///< mutex
+      std::condition_variable cv;         ///< signal new tasks
+      std::condition_variable cv_done;    ///< signal tasks completion
+      std::vector<base::Event *> events;  ///< events with subevents for each task
+      unsigned numtasks{0};               ///< number of tasks in current generation
+      std::atomic<unsigned> next{0};      ///< next task to process
+      unsigned generation{0};             ///< incremented with every new set of tasks
+      unsigned running{0};                ///< number of threads still processing tasks
+      bool canceled{false};               ///< when set, threads are stopped
+      std::function<void(unsigned)> func; ///< function called for every task
+
+      /** constructor, starts threads */
+      TimesliceWorkers(unsigned nthreads)
+      {
+         for (unsigned n = 0; n < nthreads; ++n)
+            thrds.emplace_back([this] { ThreadLoop(); });
+      }
+
+      /** destructor, stops threads */
+      ~TimesliceWorkers()
+      {
+         {
+            std::unique_lock<std::mutex> lk(m);
+            canceled = true;
+         }
+         cv.notify_all();
+         for (auto &thrd : thrds)
+            thrd.join();
+         for (auto evt : events)
+            delete evt;
+      }
+
+      /** returns event for next task */
+      base::Event *AddTask()
+      {
+         if (numtasks >= events.size())
+            events.emplace_back(new base::Event);
+         return events[numtasks++];
+      }
+
+      /** process tasks until all are taken */
+      void ProcessTasks()
+      {
+         unsigned n;
+         while ((n = next++) < numtasks)
+            func(n);
+      }
+
+      /** loop of worker thread */
+      void ThreadLoop()
+      {
+         unsigned seen = 0;
+         std::unique_lock<std::mutex> lk(m);
+         while (true) {
+            cv.wait(lk, [this, seen] { return canceled || (generation != seen); });
+            if (canceled) break;
+            seen = generation;
+            lk.unlock();
+            ProcessTasks();
+            lk.lock();
+            if (--running == 0)
+               cv_done.notify_one();
+         }
+      }
+
+      /** process all tasks with all threads, returns when all tasks are done */
+      void Run()
+      {
+         next = 0;
+         if ((numtasks < 2) || thrds.empty()) {
+            ProcessTasks();
+            return;
+         }
+
+         {
+            std::unique_lock<std::mutex> lk(m);
+            running = thrds.size();
+            generation++;
+         }
+         cv.notify_all();
+
+         ProcessTasks();
+
+         std::unique_lock<std::mutex> lk(m);
+         cv_done.wait(lk, [this] { return running == 0; });
+      }
+   };
+
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////
 /// constructor
 
@@ -15,7 +126,7 @@ base::ProcMgr::ProcMgr() :
    fProc(),
    fMap(),
    fEvProc(),
-   fTriggers(10000),                // FIXME: size should be configurable
+   fTriggers(1000),                 // grows when necessary, see SetTriggersQueueCapacity()
    fTimeMasterIndex(DummyIndex),
    fAnalysisKind(kind_Stream),
    fTree(nullptr),
@@ -26,6 +137,8 @@ base::ProcMgr::ProcMgr() :
    if (!fInstance) fInstance = this;
 
    fSecondName = "second.C";
+
+   fProfiler.SetActive(false);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -36,6 +149,16 @@ base::ProcMgr::~ProcMgr()
    DeleteAllProcessors();
    // printf("Delete processors done\n");
 
+   for (unsigned n = fTimeslicesPos; n < fTimeslices.size(); n++)
+      delete fTimeslices[n];
+   fTimeslices.clear();
+
+   delete fTimesliceWorkers;
+   fTimesliceWorkers = nullptr;
+
+   delete fColumnStore;
+   fColumnStore = nullptr;
+
    ClearInstancePointer(this);
 }
 
@@ -109,12 +232,73 @@ void base::ProcMgr::SetHistFilling(int lvl)
       evproc->SetHistFilling(lvl);
 }
 
+/////////////////////////////////////////////////////////////////////////
+/// Set sampled filling of expensive histograms for all processors.
+/// In HADAQ plugin histograms of level 3 and 4 (per-channel histograms in TDC)
+/// filled only for 1 of n events and not more often than hz times per second.
+/// Sampled events are filled with weight, therefore histograms stay comparable.
+/// Counters of lower levels remain exact. Can be changed at runtime, n=1 disables sampling
+
+void base::ProcMgr::SetHistSampling(unsigned n, double hz)
+{
+   fDfltHistSampling = n;
+   fDfltHistSamplingRate = hz;
+   for (auto &proc : fProc)
+      proc->SetHistSampling(n, hz);
+   for (auto &evproc : fEvProc)
+      evproc->SetHistSampling(n, hz);
+}
+
+/////////////////////////////////////////////////////////////////////////
+/// Enable profiling of processing phases for manager and all processors.
+/// Share of CPU cycles spent in every phase is reported at the end of processing
+/// and, if interval > 0, periodically every interval seconds.
+/// When disabled, each instrumented phase only checks a flag
+
+void base::ProcMgr::SetProfiling(bool on, double interval)
+{
+   fDfltProfiling = on;
+   fProfilingInterval = interval;
+   fProfilingLastTm = 0.;
+
+   fProfiler.SetActive(on);
+   if (on) fProfiler.MakeStatistic();
+
+   for (auto &proc : fProc)
+      proc->SetProfiling(on);
+   for (auto &evproc : fEvProc)
+      evproc->SetProfiling(on);
+}
+
+/////////////////////////////////////////////////////////////////////////
+/// Print statistic of all active profilers and start new measurement interval.
+/// For every processor share of CPU cycles (in 1/1000) spent in each phase is shown
+
+void base::ProcMgr::PrintProfiling()
+{
+   auto report = [](Profiler &prof, const char *name) {
+      if (!prof.IsActive()) return;
+      prof.MakeStatistic();
+      auto res = prof.Format();
+      if (!res.empty())
+         printf("PROFILER %s: %s\n", name, res.c_str());
+   };
+
+   report(fProfiler, "ProcMgr");
+
+   for (auto &proc : fProc)
+      report(proc->fProfiler, proc->GetName());
+   for (auto &evproc : fEvProc)
+      report(evproc->fProfiler, evproc->GetName());
+}
+
 /////////////////////////////////////////////////////////////////////////
 //// Set store kind for all processors. With HADAQ following values are used
 /// * 0 - disable store
 /// * 1 - std::vector<hadaq::TdcMessageExt> - includes original TDC message
 /// * 2 - std::vector<hadaq::MessageFloat>  - compact form, without channel 0, stamp as float (relative to ch0)
 /// * 3 - std::vector<hadaq::MessageDouble> - compact form, with channel 0, absolute time stamp as double
+/// * 4 - std::vector<hadaq::MessageInt>    - compact form, without channel 0, stamp as int32 in ps (relative to ch0)
 
 void base::ProcMgr::SetStoreKind(unsigned kind)
 {
@@ -125,6 +309,47 @@ void base::ProcMgr::SetStoreKind(unsigned kind)
       evproc->SetStoreKind(kind);
 }
 
+/////////////////////////////////////////////////////////////////////////
+/// Configure storage kind of internal histograms
+///
+/// * base::hist_Double - default, all bins stored as double
+/// * base::hist_Float - bins stored as float, half of memory
+///
+/// For compact kind inverse bin width is stored in histogram header to avoid division when filling.
+/// Must be called before first processor or histogram is created, otherwise returns false.
+/// Only supported by managers which use base implementation of histograms methods, see \ref CanCompactHist
+
+bool base::ProcMgr::SetHistStorage(HistStorageKind kind)
+{
+   if (kind == fHistStorage)
+      return true;
+
+   if (!CanCompactHist()) {
+      printf("Histogram storage kind cannot be changed for this manager\n");
+      return false;
+   }
+
+   if ((fNumHistCreated > 0) || (fProc.size() > 0) || (fEvProc.size() > 0)) {
+      printf("Histogram storage kind can be changed only before processors and histograms are created\n");
+      return false;
+   }
+
+   fHistStorage = kind;
+   return true;
+}
+
+/////////////////////////////////////////////////////////////////////////
+/// Allocate memory for internal histogram - header and bins, size is number of doubles
+/// Name, title and binning (nbins2 == 0 for 1D histogram) can be used by derived classes
+/// which place histograms in special memory
+
+double *base::ProcMgr::AllocateHist(unsigned size, const char * /* name */, const char * /* title */, const char * /* options */,
+                                    int /* nbins1 */, double /* left1 */, double /* right1 */,
+                                    int /* nbins2 */, double /* left2 */, double /* right2 */)
+{
+   return new double[size];
+}
+
 /////////////////////////////////////////////////////////////////////////
 /// Creates 1-dimensional histogram
 /// \param name  histogram name
@@ -144,11 +369,34 @@ base::H1handle base::ProcMgr::MakeH1(const char* name, const char* title, int nb
    if (!InternalHistFormat() || IsBlockHistCreation())
       return nullptr;
 
-   double* arr = new double[nbins+5];
+   fNumHistCreated++;
+
+   // dirty bits placed after bins
+   int ndirty = HistDirty::AllocSize(HistDirty::NumBlocks(nbins+2));
+
+   if (fHistStorage != hist_Double) {
+      int size = CompactHist::AllocSize(CompactHist::H1HeaderSize, nbins+2);
+      double *hdr = AllocateHist(size + ndirty, name, title, xtitle, nbins, left, right);
+      if (!hdr) return nullptr;
+      hdr[0] = nbins;
+      hdr[1] = left;
+      hdr[2] = right;
+      hdr[3] = nbins / (right - left);
+      void *bins = CompactHist::Bins(hdr, CompactHist::H1HeaderSize);
+      for (int n = 0; n < nbins+2; n++)
+         CompactHist::Set(bins, n, 0.);
+      std::fill(hdr + size, hdr + size + ndirty, 0.);
+      RegisterDeltaHist(hdr, name, bins, nbins+2, false, GetHistDirty(hdr, false));
+      return hdr;
+   }
+
+   double* arr = AllocateHist(nbins+5+ndirty, name, title, xtitle, nbins, left, right);
+   if (!arr) return nullptr;
    arr[0] = nbins;
    arr[1] = left;
    arr[2] = right;
-   for (int n=0;n<nbins+2;n++) arr[n+3] = 0.;
+   for (int n=0;n<nbins+2+ndirty;n++) arr[n+3] = 0.;
+   RegisterDeltaHist(arr, name, arr + 3, nbins+2, false, GetHistDirty(arr, false));
    return arr;
 }
 
@@ -171,11 +419,16 @@ void base::ProcMgr::FillH1(H1handle h1, double x, double weight)
    // put code here, but it should be already performed in processor
    if (!InternalHistFormat() || !h1) return;
 
+   if (fHistStorage != hist_Double)
+      return CompactHist::FillH1(h1, x, weight);
+
    double* arr = (double*) h1;
    int nbin = (int) arr[0];
    int bin = (int) (nbin * (x - arr[1]) / (arr[2] - arr[1]));
-   if (bin<0) arr[3]+=weight; else
-   if (bin>=nbin) arr[4+nbin]+=weight; else arr[4+bin]+=weight;
+   if (bin<0) bin = -1; else if (bin>nbin) bin = nbin;
+   arr[4+bin] += weight;
+   if (HasHistDirtyBits())
+      HistDirty::MarkBin(HistDirty::DoubleH1(h1), bin+1);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
@@ -188,6 +441,10 @@ double base::ProcMgr::GetH1Content(H1handle h1, int bin)
 
    double* arr = (double*) h1;
    int nbin = (int) arr[0];
+   if (fHistStorage != hist_Double) {
+      if (bin < 0) bin = -1; else if (bin > nbin) bin = nbin;
+      return CompactHist::Get(CompactHist::Bins(h1, CompactHist::H1HeaderSize), bin + 1);
+   }
    if (bin<0) return arr[3];
    if (bin>=nbin) return arr[4+nbin];
    return arr[4+bin];
@@ -203,9 +460,13 @@ void base::ProcMgr::SetH1Content(H1handle h1, int bin, double v)
 
    double* arr = (double*) h1;
    int nbin = (int) arr[0];
-   if (bin<0) arr[3] = v;
-   else if (bin>=nbin) arr[4+nbin] = v;
-   else arr[4+bin] = v;
+   if (bin < 0) bin = -1; else if (bin > nbin) bin = nbin;
+   if (fHistStorage != hist_Double)
+      CompactHist::Set(CompactHist::Bins(h1, CompactHist::H1HeaderSize), bin + 1, v);
+   else
+      arr[4+bin] = v;
+   if (void *dirty = GetHistDirty(h1, false))
+      HistDirty::MarkBin(dirty, bin + 1);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
@@ -218,6 +479,14 @@ void base::ProcMgr::ClearH1(base::H1handle h1)
    if (!InternalHistFormat() || !h1) return;
 
    double* arr = (double*) h1;
+   if (void *dirty = GetHistDirty(h1, false))
+      HistDirty::MarkAll(dirty, HistDirty::NumBlocks(arr[0]+2));
+   if (fHistStorage != hist_Double) {
+      void *bins = CompactHist::Bins(h1, CompactHist::H1HeaderSize);
+      for (int n = 0; n < arr[0]+2; n++)
+         CompactHist::Set(bins, n, 0.);
+      return;
+   }
    for (int n=0;n<arr[0]+2;n++) arr[n+3] = 0.;
 }
 
@@ -230,6 +499,16 @@ void base::ProcMgr::CopyH1(H1handle tgt, H1handle src)
 
    double *atgt = (double*) tgt;
    double *asrc = (double*) src;
+   void *dirty = GetHistDirty(tgt, false);
+   if (dirty && (atgt[0] == asrc[0]))
+      HistDirty::MarkAll(dirty, HistDirty::NumBlocks(atgt[0]+2));
+   if ((fHistStorage != hist_Double) && (atgt[0] == asrc[0])) {
+      void *btgt = CompactHist::Bins(tgt, CompactHist::H1HeaderSize),
+           *bsrc = CompactHist::Bins(src, CompactHist::H1HeaderSize);
+      for (int n = 0; n < atgt[0]+2; n++)
+         CompactHist::Set(btgt, n, CompactHist::Get(bsrc, n));
+      return;
+   }
    if (atgt[0] == asrc[0])
       for (int n=0;n<atgt[0]+2;n++) atgt[n+3] = asrc[n+3];
 }
@@ -255,16 +534,65 @@ base::H2handle base::ProcMgr::MakeH2(const char* name, const char* title, int nb
    if (!InternalHistFormat() || IsBlockHistCreation())
       return nullptr;
 
-   double *bins = new double[(nbins1+2)*(nbins2+2)+6];
+   fNumHistCreated++;
+
+   if ((fH2TilingLimit > 0) && ((unsigned) ((nbins1+2)*(nbins2+2)) >= fH2TilingLimit) && CanTileHist()) {
+      int ntiles = TiledHist::NumTiles(nbins1) * TiledHist::NumTiles(nbins2),
+          size = TiledHist::AllocSize(nbins1, nbins2), ndirty = HistDirty::AllocSize(ntiles);
+      double *hdr = AllocateHist(size + ndirty, name, title, options, nbins1, left1, right1, nbins2, left2, right2);
+      if (!hdr) return nullptr;
+      hdr[0] = -nbins1;
+      hdr[1] = left1;
+      hdr[2] = right1;
+      hdr[3] = nbins2;
+      hdr[4] = left2;
+      hdr[5] = right2;
+      hdr[6] = nbins1 / (right1 - left1);
+      hdr[7] = nbins2 / (right2 - left2);
+      void **tiles = TiledHist::Tiles(hdr);
+      for (int n = 0; n < ntiles; n++)
+         tiles[n] = nullptr;
+      std::fill(hdr + size, hdr + size + ndirty, 0.);
+      RegisterDeltaHist(hdr, name, nullptr, (nbins1+2)*(nbins2+2), true, GetHistDirty(hdr, true));
+      return (base::H2handle) hdr;
+   }
+
+   // dirty bits placed after bins
+   int ndirty = HistDirty::AllocSize(HistDirty::NumBlocks((nbins1+2)*(nbins2+2)));
+
+   if (fHistStorage != hist_Double) {
+      int size = CompactHist::AllocSize(CompactHist::H2HeaderSize, (nbins1+2)*(nbins2+2));
+      double *hdr = AllocateHist(size + ndirty, name, title, options, nbins1, left1, right1, nbins2, left2, right2);
+      if (!hdr) return nullptr;
+      hdr[0] = nbins1;
+      hdr[1] = left1;
+      hdr[2] = right1;
+      hdr[3] = nbins2;
+      hdr[4] = left2;
+      hdr[5] = right2;
+      hdr[6] = nbins1 / (right1 - left1);
+      hdr[7] = nbins2 / (right2 - left2);
+      void *bins = CompactHist::Bins(hdr, CompactHist::H2HeaderSize);
+      for (int n = 0; n < (nbins1+2)*(nbins2+2); n++)
+         CompactHist::Set(bins, n, 0.);
+      std::fill(hdr + size, hdr + size + ndirty, 0.);
+      RegisterDeltaHist(hdr, name, bins, (nbins1+2)*(nbins2+2), false, GetHistDirty(hdr, true));
+      return (base::H2handle) hdr;
+   }
+
+   double *bins = AllocateHist((nbins1+2)*(nbins2+2)+6+ndirty, name, title, options, nbins1, left1, right1, nbins2, left2, right2);
+   if (!bins) return nullptr;
    bins[0] = nbins1;
    bins[1] = left1;
    bins[2] = right1;
    bins[3] = nbins2;
    bins[4] = left2;
    bins[5] = right2;
-   for (int n = 0; n < nbins1*nbins2; n++)
+   for (int n = 0; n < (nbins1+2)*(nbins2+2)+ndirty; n++)
       bins[n+6] = 0.;
 
+   RegisterDeltaHist(bins, name, bins + 6, (nbins1+2)*(nbins2+2), false, GetHistDirty(bins, true));
+
    return (base::H2handle) bins;
 }
 
@@ -276,7 +604,7 @@ bool base::ProcMgr::GetH2NBins(H2handle h2, int &nbins1, int &nbins2)
    if (!h2 || !InternalHistFormat()) return false;
    double* arr = (double*) h2;
 
-   nbins1 = (int) arr[0];
+   nbins1 = (int) std::abs(arr[0]);
    nbins2 = (int) arr[3];
    return true;
 }
@@ -287,6 +615,13 @@ bool base::ProcMgr::GetH2NBins(H2handle h2, int &nbins1, int &nbins2)
 void base::ProcMgr::FillH2(H2handle h2, double x, double y, double weight)
 {
    if (!h2 || !InternalHistFormat()) return;
+
+   if (TiledHist::IsTiled(h2))
+      return TiledHist::FillH2(fHistStorage, h2, x, y, weight);
+
+   if (fHistStorage != hist_Double)
+      return CompactHist::FillH2(h2, x, y, weight);
+
    double* arr = (double*) h2;
 
    int nbin1 = (int) arr[0];
@@ -299,6 +634,8 @@ void base::ProcMgr::FillH2(H2handle h2, double x, double y, double weight)
    if (bin2<0) bin2 = -1; else if (bin2>nbin2) bin2 = nbin2;
 
    arr[6 + (bin1+1) + (bin2+1)*(nbin1+2)] += weight;
+   if (HasHistDirtyBits())
+      HistDirty::MarkBin(HistDirty::DoubleH2(h2), (bin1+1) + (bin2+1)*(nbin1+2));
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
@@ -309,12 +646,18 @@ double base::ProcMgr::GetH2Content(H2handle h2, int bin1, int bin2)
    if (!h2 || !InternalHistFormat()) return 0.;
    double* arr = (double*) h2;
 
-   int nbin1 = (int) arr[0];
+   int nbin1 = (int) std::abs(arr[0]);
    int nbin2 = (int) arr[3];
 
    if (bin1<0) bin1 = -1; else if (bin1>nbin1) bin1 = nbin1;
    if (bin2<0) bin2 = -1; else if (bin2>nbin2) bin2 = nbin2;
 
+   if (TiledHist::IsTiled(h2))
+      return TiledHist::Get(fHistStorage, h2, bin1+1, bin2+1);
+
+   if (fHistStorage != hist_Double)
+      return CompactHist::Get(CompactHist::Bins(h2, CompactHist::H2HeaderSize), (bin1+1) + (bin2+1)*(nbin1+2));
+
    return arr[6 + (bin1+1) + (bin2+1)*(nbin1+2)];
 }
 
@@ -326,13 +669,33 @@ void base::ProcMgr::SetH2Content(H2handle h2, int bin1, int bin2, double v)
    if (!h2 || !InternalHistFormat()) return;
    double* arr = (double*) h2;
 
-   int nbin1 = (int) arr[0];
+   int nbin1 = (int) std::abs(arr[0]);
    int nbin2 = (int) arr[3];
 
    if (bin1<0) bin1 = -1; else if (bin1>nbin1) bin1 = nbin1;
    if (bin2<0) bin2 = -1; else if (bin2>nbin2) bin2 = nbin2;
 
-   arr[6 + (bin1+1) + (bin2+1)*(nbin1+2)] = v;
+   if (TiledHist::IsTiled(h2)) {
+      // do not allocate tile only to set zero
+      if ((v == 0.) && !TiledHist::FindTile(h2, bin1+1, bin2+1)) return;
+      void *tile = TiledHist::GetTile(fHistStorage, h2, bin1+1, bin2+1);
+      int indx = TiledHist::TileIndex(bin1+1, bin2+1);
+      if (fHistStorage == hist_Double)
+         ((double *) tile)[indx] = v;
+      else
+         CompactHist::Set(tile, indx, v);
+      return;
+   }
+
+   int indx = (bin1+1) + (bin2+1)*(nbin1+2);
+
+   if (fHistStorage != hist_Double)
+      CompactHist::Set(CompactHist::Bins(h2, CompactHist::H2HeaderSize), indx, v);
+   else
+      arr[6 + indx] = v;
+
+   if (void *dirty = GetHistDirty(h2, true))
+      HistDirty::MarkBin(dirty, indx);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
@@ -343,11 +706,338 @@ void base::ProcMgr::ClearH2(base::H2handle h2)
    if (!h2 || !InternalHistFormat()) return;
    double* arr = (double*) h2;
 
-   int nbin1 = (int) arr[0];
+   int nbin1 = (int) std::abs(arr[0]);
    int nbin2 = (int) arr[3];
+
+   if (TiledHist::IsTiled(h2)) {
+      // release tiles, they allocated again when filled
+      void **tiles = TiledHist::Tiles(h2);
+      void *dirty = GetHistDirty(h2, true);
+      int ntiles = TiledHist::NumTiles(nbin1) * TiledHist::NumTiles(nbin2);
+      for (int n = 0; n < ntiles; n++) {
+         if (dirty && tiles[n]) HistDirty::Mark(dirty, n);
+         delete [] (double *) tiles[n];
+         tiles[n] = nullptr;
+      }
+      return;
+   }
+
+   if (void *dirty = GetHistDirty(h2, true))
+      HistDirty::MarkAll(dirty, HistDirty::NumBlocks((nbin1+2)*(nbin2+2)));
+
+   if (fHistStorage != hist_Double) {
+      void *bins = CompactHist::Bins(h2, CompactHist::H2HeaderSize);
+      for (int n = 0; n < (nbin1+2)*(nbin2+2); n++)
+         CompactHist::Set(bins, n, 0.);
+      return;
+   }
+
    for (int n=0;n<(nbin1+2)*(nbin2+2);n++) arr[6+n] = 0.;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Export content of internal 2D histogram as dense array with (nbins1+2)*(nbins2+2) values
+/// Bins order is the same as for not-tiled histogram with double storage - X bin changes fastest,
+/// first bin is underflow. Can be used for all kinds of internal histograms
+
+bool base::ProcMgr::ExportH2(H2handle h2, std::vector<double> &bins)
+{
+   int nbin1 = 0, nbin2 = 0;
+   if (!GetH2NBins(h2, nbin1, nbin2)) return false;
+
+   int len1 = nbin1 + 2, len2 = nbin2 + 2;
+   bins.assign(len1 * len2, 0.);
+
+   if (TiledHist::IsTiled(h2)) {
+      int ntiles1 = TiledHist::NumTiles(nbin1), ntiles2 = TiledHist::NumTiles(nbin2);
+      void **tiles = TiledHist::Tiles(h2);
+      for (int t2 = 0; t2 < ntiles2; t2++)
+         for (int t1 = 0; t1 < ntiles1; t1++) {
+            void *tile = tiles[t2 * ntiles1 + t1];
+            if (!tile) continue;
+            int last1 = std::min(len1, (t1 + 1) * TiledHist::TileSize),
+                last2 = std::min(len2, (t2 + 1) * TiledHist::TileSize);
+            for (int i2 = t2 * TiledHist::TileSize; i2 < last2; i2++)
+               for (int i1 = t1 * TiledHist::TileSize; i1 < last1; i1++) {
+                  int indx = TiledHist::TileIndex(i1, i2);
+                  bins[i1 + i2 * len1] = fHistStorage == hist_Double ? ((double *) tile)[indx] : CompactHist::Get(tile, indx);
+               }
+         }
+   } else if (fHistStorage != hist_Double) {
+      void *src = CompactHist::Bins(h2, CompactHist::H2HeaderSize);
+      for (int n = 0; n < len1 * len2; n++)
+         bins[n] = CompactHist::Get(src, n);
+   } else {
+      std::copy((double *) h2 + 6, (double *) h2 + 6 + len1 * len2, bins.begin());
+   }
+
+   return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Allocate zero-initialized tile for tiled 2D histogram
+
+void *base::TiledHist::AllocTile(HistStorageKind kind)
+{
+   return new double[kind == hist_Double ? TileSize * TileSize : TileSize * TileSize / 2]();
+}
+
+namespace {
+
+   /** hash of histogram bins, size is multiple of 4 bytes */
+   uint64_t HashBins(const char *ptr, unsigned len)
+   {
+      uint64_t h = 0xcbf29ce484222325ULL, w;
+      unsigned n = 0;
+      for (; n + 8 <= len; n += 8) {
+         memcpy(&w, ptr + n, 8);
+         h = (h ^ w) * 0x100000001b3ULL;
+         h ^= h >> 32;
+      }
+      if (n < len) {
+         uint32_t w4;
+         memcpy(&w4, ptr + n, 4);
+         h = (h ^ w4) * 0x100000001b3ULL;
+         h ^= h >> 32;
+      }
+      return h;
+   }
+
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Register internal histogram for delta publishing
+/// When dirty bits are provided, only marked blocks are checked in \ref UpdateHistDeltas,
+/// otherwise bins are hashed. For tiled 2D histogram every tile is used as separate block
+
+void base::ProcMgr::RegisterDeltaHist(void *hist, const char *name, void *bins, unsigned nbins, bool tiled, void *dirty)
+{
+   if (!hist || (fDeltaIndex.find(hist) != fDeltaIndex.end())) return;
+
+   fDeltaIndex[hist] = fDeltaHists.size();
+
+   fDeltaHists.emplace_back();
+   auto &rec = fDeltaHists.back();
+   rec.hist = hist;
+   rec.name = name ? name : "";
+   rec.bins = bins;
+   rec.kind = InternalHistStorage();
+   rec.nbins = nbins;
+   rec.tiled = tiled;
+   rec.dirty = dirty;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Returns dirty bits of internal histogram created by \ref MakeH1 or \ref MakeH2,
+/// nullptr when manager does not use dirty bits
+
+void *base::ProcMgr::GetHistDirty(void *hist, bool is2d)
+{
+   if (!hist || !HasHistDirtyBits()) return nullptr;
+
+   if (is2d && TiledHist::IsTiled(hist))
+      return TiledHist::Dirty(hist);
+
+   if (fHistStorage != hist_Double)
+      return is2d ? CompactHist::DirtyH2(hist) : CompactHist::DirtyH1(hist);
+
+   return is2d ? HistDirty::DoubleH2(hist) : HistDirty::DoubleH1(hist);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Register 1D histogram for delta publishing
+/// Should be used by derived managers, which create internal histograms with own MakeH1 implementation.
+/// Called by \ref base::Processor::MakeH1, histograms of base implementation are registered already
+
+void base::ProcMgr::RegisterDeltaH1(H1handle h1, const char *name)
+{
+   int nbins = 0;
+   if (!GetH1NBins(h1, nbins)) return;
+
+   if (InternalHistStorage() != hist_Double)
+      RegisterDeltaHist(h1, name, CompactHist::Bins(h1, CompactHist::H1HeaderSize), nbins + 2);
+   else
+      RegisterDeltaHist(h1, name, (double *) h1 + 3, nbins + 2);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Register 2D histogram for delta publishing
+/// Should be used by derived managers, which create internal histograms with own MakeH2 implementation.
+/// Called by \ref base::Processor::MakeH2, histograms of base implementation are registered already
+
+void base::ProcMgr::RegisterDeltaH2(H2handle h2, const char *name)
+{
+   int nbins1 = 0, nbins2 = 0;
+   if (!GetH2NBins(h2, nbins1, nbins2)) return;
+
+   if (TiledHist::IsTiled(h2))
+      RegisterDeltaHist(h2, name, nullptr, (nbins1 + 2) * (nbins2 + 2), true);
+   else if (InternalHistStorage() != hist_Double)
+      RegisterDeltaHist(h2, name, CompactHist::Bins(h2, CompactHist::H2HeaderSize), (nbins1 + 2) * (nbins2 + 2));
+   else
+      RegisterDeltaHist(h2, name, (double *) h2 + 6, (nbins1 + 2) * (nbins2 + 2));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Detect changed bins of internal histograms
+/// For histograms with dirty bits only blocks marked by fill methods are taken and bits are reset,
+/// therefore method should be called from the thread which fills histograms.
+/// For other histograms blocks of HistDeltaBlock bins compared using content hash.
+/// Changed blocks marked with new version.
+/// Returns version, which corresponds to current content of all histograms
+
+uint64_t base::ProcMgr::UpdateHistDeltas()
+{
+   uint64_t newversion = fHistVersion + 1;
+   bool changed = false;
+
+   for (auto &rec : fDeltaHists) {
+      unsigned elemsize = rec.kind == hist_Double ? sizeof(double) : 4,
+               nblocks = (rec.nbins + HistDeltaBlock - 1) / HistDeltaBlock;
+      const char *bins = (const char *) rec.bins;
+      void **tiles = nullptr;
+
+      if (rec.tiled) {
+         int nbins1 = 0, nbins2 = 0;
+         GetH2NBins(rec.hist, nbins1, nbins2);
+         nblocks = TiledHist::NumTiles(nbins1) * TiledHist::NumTiles(nbins2);
+         tiles = TiledHist::Tiles(rec.hist);
+      }
+
+      bool init = rec.versions.empty();
+      if (init) {
+         rec.versions.resize(nblocks, newversion);
+         rec.version = newversion;
+         changed = true;
+      }
+
+      if (rec.dirty) {
+         uint64_t *bits = (uint64_t *) rec.dirty;
+         for (unsigned w = 0; w < (unsigned) HistDirty::AllocSize(nblocks); ++w) {
+            uint64_t mask = bits[w];
+            if (!mask) continue;
+            bits[w] = 0;
+            if (init) continue;
+            for (unsigned blk = w * 64; mask; mask >>= 1, ++blk)
+               if (mask & 1)
+                  rec.versions[blk] = newversion;
+            rec.version = newversion;
+            changed = true;
+         }
+         continue;
+      }
+
+      if (init)
+         rec.hashes.resize(nblocks, 0);
+
+      for (unsigned blk = 0; blk < nblocks; ++blk) {
+         uint64_t h = 0;
+         if (!tiles) {
+            unsigned first = blk * HistDeltaBlock,
+                     cnt = std::min((unsigned) HistDeltaBlock, rec.nbins - first);
+            h = HashBins(bins + first * elemsize, cnt * elemsize);
+         } else if (tiles[blk]) {
+            h = HashBins((const char *) tiles[blk], TiledHist::TileSize * TiledHist::TileSize * elemsize);
+         }
+         if (init || (h != rec.hashes[blk])) {
+            rec.hashes[blk] = h;
+            rec.versions[blk] = newversion;
+            rec.version = newversion;
+            changed = true;
+         }
+      }
+   }
+
+   if (changed)
+      fHistVersion = newversion;
+
+   return fHistVersion;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Produce compact deltas of internal histograms, changed after version since
+/// Only changed bins ranges are delivered, adjacent changed blocks are merged.
+/// With since = 0 full content of all histograms is returned.
+/// Returns version, which should be used as since argument in next call
+
+uint64_t base::ProcMgr::GetHistDeltas(uint64_t since, std::vector<HistDelta> &deltas)
+{
+   deltas.clear();
+
+   uint64_t version = UpdateHistDeltas();
+
+   for (unsigned indx = 0; indx < fDeltaHists.size(); ++indx) {
+      auto &rec = fDeltaHists[indx];
+      if (rec.version <= since) continue;
+
+      if (rec.tiled) {
+         ProduceTiledDeltas(indx, since, deltas);
+         continue;
+      }
+
+      unsigned nblocks = rec.versions.size(), blk = 0;
+      while (blk < nblocks) {
+         if (rec.versions[blk] <= since) { blk++; continue; }
+
+         unsigned last = blk;
+         while ((last + 1 < nblocks) && (rec.versions[last + 1] > since)) last++;
+
+         unsigned first = blk * HistDeltaBlock,
+                  stop = std::min((last + 1) * HistDeltaBlock, rec.nbins);
+
+         deltas.emplace_back();
+         auto &delta = deltas.back();
+         delta.indx = indx;
+         delta.hist = rec.hist;
+         delta.first = first;
+         delta.values.resize(stop - first);
+         for (unsigned n = first; n < stop; ++n)
+            delta.values[n - first] = rec.kind == hist_Double ? ((double *) rec.bins)[n] : CompactHist::Get(rec.bins, n);
+
+         blk = last + 1;
+      }
+   }
+
+   return version;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Produce deltas for tiled 2D histogram - one entry for every row of changed tile
+
+void base::ProcMgr::ProduceTiledDeltas(unsigned indx, uint64_t since, std::vector<HistDelta> &deltas)
+{
+   auto &rec = fDeltaHists[indx];
+
+   int nbins1 = 0, nbins2 = 0;
+   GetH2NBins(rec.hist, nbins1, nbins2);
+
+   int len1 = nbins1 + 2, len2 = nbins2 + 2, ntiles1 = TiledHist::NumTiles(nbins1);
+   void **tiles = TiledHist::Tiles(rec.hist);
+
+   for (unsigned blk = 0; blk < rec.versions.size(); ++blk) {
+      if (rec.versions[blk] <= since) continue;
+
+      int first1 = (blk % ntiles1) * TiledHist::TileSize,
+          first2 = (blk / ntiles1) * TiledHist::TileSize,
+          last1 = std::min(len1, first1 + TiledHist::TileSize),
+          last2 = std::min(len2, first2 + TiledHist::TileSize);
+
+      for (int i2 = first2; i2 < last2; ++i2) {
+         deltas.emplace_back();
+         auto &delta = deltas.back();
+         delta.indx = indx;
+         delta.hist = rec.hist;
+         delta.first = first1 + i2 * len1;
+         delta.values.assign(last1 - first1, 0.);
+         if (tiles[blk])
+            for (int i1 = first1; i1 < last1; ++i1) {
+               int tindx = TiledHist::TileIndex(i1, i2);
+               delta.values[i1 - first1] = rec.kind == hist_Double ? ((double *) tiles[blk])[tindx] : CompactHist::Get(tiles[blk], tindx);
+            }
+      }
+   }
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////
 /// create condition
 
@@ -381,6 +1071,55 @@ double base::ProcMgr::GetC1Limit(C1handle c1, bool isleft)
    return 0;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Create data store
+/// Without ROOT only columnar store can be created, see \ref base::ColumnStoreWriter
+/// File name must have ".strm" extension
+/// Processors with enabled store add their columns in UserPreLoop
+
+bool base::ProcMgr::CreateStore(const char* storename)
+{
+   if (fColumnStore) return true;
+
+   if (!ColumnFile::IsColumnFile(storename)) {
+      printf("Cannot create store %s - only columnar store with .strm extension is supported\n", storename ? storename : "");
+      return false;
+   }
+
+   fColumnStore = new ColumnStoreWriter;
+   if (!fColumnStore->Open(storename)) {
+      delete fColumnStore;
+      fColumnStore = nullptr;
+      return false;
+   }
+
+   return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Close data store
+
+bool base::ProcMgr::CloseStore()
+{
+   if (!fColumnStore) return false;
+
+   bool res = fColumnStore->Close();
+   printf("Columnar store closed, %lu events written\n", (long unsigned) fColumnStore->GetNumEvents());
+
+   delete fColumnStore;
+   fColumnStore = nullptr;
+
+   return res;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Store event - close event in columnar store
+
+bool base::ProcMgr::StoreEvent()
+{
+   return fColumnStore ? fColumnStore->FillEvent() : false;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////
 /// pre-loop
 
@@ -393,9 +1132,15 @@ void base::ProcMgr::UserPreLoop(Processor* only_proc, bool call_when_running)
       if (fProc[n]->fAnalysisKind != kind_RawOnly)
          fProc[n]->fAnalysisKind = fAnalysisKind;
 
+      if (IsTimesliceMode())
+         fProc[n]->CheckTimesliceMode();
+
       if (fTree && fProc[n]->IsStoreEnabled())
          fProc[n]->CreateBranch(fTree);
 
+      if (fColumnStore && fProc[n]->IsStoreEnabled())
+         fProc[n]->CreateColumns(fColumnStore);
+
       if (!IsStreamAnalysis())
          fProc[n]->SetSynchronisationKind(base::StreamProc::sync_None);
 
@@ -432,6 +1177,27 @@ void base::ProcMgr::UserPostLoop(Processor* only_proc)
 
    // close store file already here
    if (!only_proc) CloseStore();
+
+   if (!only_proc)
+      PrintProfiling();
+
+   if (!only_proc && (fNumSyncLost || fNumSyncNotEnough))
+      printf("Sync analysis: %lu sync markers lost, %lu times not enough syncs\n", fNumSyncLost, fNumSyncNotEnough);
+
+   if (!only_proc) {
+      unsigned long rejected = 0;
+      for (auto proc : fProc)
+         rejected += proc->GetNumRejectedBufs();
+      if (rejected > 0)
+         printf("%lu buffers rejected while processors queues reached limit, data source should check CanAcceptRawData()\n", rejected);
+   }
+
+   if (!only_proc && (fDebug > 0)) {
+      for (auto proc : fProc)
+         printf("%s queues high water: buffers %u markers %u rejected buffers %lu skipped scans %lu\n", proc->GetName(),
+                proc->GetBufsQueueHighWater(), proc->GetMarksQueueHighWater(), proc->GetNumRejectedBufs(), proc->GetNumSkippedScans());
+      printf("Triggers queue high water %u\n", fTriggers.high_water());
+   }
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
@@ -489,12 +1255,59 @@ void base::ProcMgr::SetTimeSorting(bool on)
       fProc[n]->SetTimeSorting(on);
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Configure initial capacity and limit of triggers queue
+/// Queue grows up to the limit when many triggers are in work and shrinks afterwards
+
+void base::ProcMgr::SetTriggersQueueCapacity(unsigned capacity, unsigned limit)
+{
+   if (limit) fTriggersLimit = limit;
+   if (capacity < fTriggers.size()) capacity = fTriggers.size();
+   if (capacity > 0) fTriggers.Resize(capacity);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Configure timeslice mode for stream analysis
+///
+/// Instead of triggers, data split into timeslices with fixed length. Each timeslice contains hits
+/// of all streams, sorted by global time, see \ref base::Timeslice. Timeslice also includes hits
+/// from overlap interval before its start. Overlap should be smaller than timeslice length.
+/// Timeslices are built when flush logic closes their boundaries, if several timeslices
+/// are ready at once, they are filled and sorted in nthreads threads.
+/// Length 0 disables timeslice mode
+
+void base::ProcMgr::SetTimesliceMode(double length, double overlap, unsigned nthreads)
+{
+   delete fTimesliceWorkers;
+   fTimesliceWorkers = nullptr;
+
+   fTimesliceLength = length > 0. ? length : 0.;
+   fTimesliceOverlap = (overlap > 0.) && (overlap < fTimesliceLength) ? overlap : 0.;
+   fTimesliceThreads = nthreads;
+   fNextTimesliceTm = 0.;
+   fTimesliceStarted = false;
+   fTimesliceTail.Clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Returns false when any stream processor reached limit of its buffers queue
+/// Reader can use it to throttle data delivery instead of loosing buffers
+
+bool base::ProcMgr::CanAcceptRawData() const
+{
+   for (auto proc : fProc)
+      if (proc->IsQueueAtLimit())
+         return false;
+   return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////
 /// Method to provide raw data on base of data kind to the processor
+/// Returns false when buffer was not accepted because processor queue reached its limit
 
-void base::ProcMgr::ProvideRawData(const Buffer& buf, bool fast_process)
+bool base::ProcMgr::ProvideRawData(const Buffer& buf, bool fast_process)
 {
-   if (buf.null()) return;
+   if (buf.null()) return true;
 
    if (buf().boardid >= MaxBrdId) {
       printf("Board id %u is too high - failure\n", buf().boardid);
@@ -505,12 +1318,15 @@ void base::ProcMgr::ProvideRawData(const Buffer& buf, bool fast_process)
 
    auto iter = fMap.find(index);
 
-   if (iter == fMap.end()) return;
+   if (iter == fMap.end()) return true;
 
-   iter->second->AddNextBuffer(buf);
+   if (!iter->second->AddNextBuffer(buf))
+      return false;
 
    if (fast_process)
       iter->second->ScanNewBuffers();
+
+   return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
@@ -588,14 +1404,19 @@ bool base::ProcMgr::AnalyzeSyncMarkers()
    for (unsigned n=0;n<fProc.size();n++) {
 
       if (fProc[n]->numSyncs() < fProc[n]->minNumSyncRequired()) {
-          printf("No enough %u syncs on processor %s!!!\n", fProc[n]->numSyncs(), fProc[n]->GetName());
+          if (fDebug > 0)
+             printf("No enough %u syncs on processor %s!!!\n", fProc[n]->numSyncs(), fProc[n]->GetName());
           // exit(5);
           isenough = false;
+          break;
       }
 
    }
 
-   if (!isenough) return false;
+   if (!isenough) {
+      fNumSyncNotEnough++;
+      return false;
+   }
 
 
    master = fProc[fTimeMasterIndex];
@@ -619,34 +1440,39 @@ bool base::ProcMgr::AnalyzeSyncMarkers()
 
          bool is_slave_ok = false;
 
-         while (slave->fSyncScanIndex < slave->numSyncs()) {
+         // syncs older than master sync are counted and erased at once
+         unsigned first_stale = slave->fSyncScanIndex, num_stale = 0;
+
+         for (unsigned indx = first_stale; indx < slave->numSyncs(); indx++) {
 
-            SyncMarker& slave_marker = slave->getSync(slave->fSyncScanIndex);
+            SyncMarker& slave_marker = slave->getSync(indx);
 
             int diff = SyncIdDiff(master_marker.uniqueid, slave_marker.uniqueid);
 
+            // master sync is bigger, slave sync must be ignored
+            // we even remove it while no any reasonable stamp can be assigned to it
+            if (diff<0) {
+               if (fDebug > 0)
+                  printf("Erase SYNC %u in processor %s\n", slave_marker.uniqueid, slave->GetName());
+               num_stale++;
+               continue;
+            }
+
             // find same sync as master - very nice
             if (diff==0) {
                slave_marker.globaltm = master_marker.localtm;
-               is_slave_ok = true;
                slave->fSyncFlag = true; // indicate that this slave has same sync
-               break;
             }
 
-            // master sync is bigger, slave sync must be ignored
-            if (diff<0) {
-               // we even remove it while no any reasonable stamp can be assigned to it
-               printf("Erase SYNC %u in processor %s\n", slave_marker.uniqueid, slave->GetName());
-               slave->eraseSyncAt(slave->fSyncScanIndex);
-               continue;
-            }
+            // when slave sync id is bigger, stop analyzing, but could do calibration
+            is_slave_ok = true;
+            break;
+         }
 
-            // slave sync id is bigger, stop analyzing, but could do calibration
-            if (diff>0) {
-               // printf("Find hole in SYNC sequences in processor %u\n", n);
-               is_slave_ok = true;
-               break;
-            }
+         if (num_stale > 0) {
+            slave->eraseSyncsAt(first_stale, num_stale);
+            slave->fNumSyncLost += num_stale;
+            fNumSyncLost += num_stale;
          }
 
          if (!is_slave_ok) is_curr_sync_ok = false;
@@ -708,7 +1534,7 @@ bool base::ProcMgr::CollectNewTriggers()
 
       // be sure to have at least one trigger in the list
       if (fTriggers.size()==0)
-         fTriggers.push(GlobalMarker(0.));
+         fTriggers.push_adaptive(GlobalMarker(0.), fTriggersLimit);
    } else
    // create flush event when master has already two buffers and
    // time is reached by all sub-systems
@@ -717,8 +1543,13 @@ bool base::ProcMgr::CollectNewTriggers()
       unsigned use_indx = fTimeMasterIndex < fProc.size() ? fTimeMasterIndex : 0;
 
       // if we request flush time, it should be bigger than last trigger marker
-      GlobalTime_t flush_time =
-            fProc[use_indx]->ProvidePotentialFlushTime(fTriggers.size() > 0 ? fTriggers.back().globaltm : 0.);
+      GlobalTime_t last_marker = fTriggers.size() > 0 ? fTriggers.back().globaltm : 0.;
+
+      // in timeslice mode flush time should be after end of next timeslice
+      if (IsTimesliceMode() && fTimesliceStarted)
+         last_marker = fNextTimesliceTm + fTimesliceLength;
+
+      GlobalTime_t flush_time = fProc[use_indx]->ProvidePotentialFlushTime(last_marker);
 
 //      printf("Try flush time %12.9f\n", flush_time);
 
@@ -733,10 +1564,12 @@ bool base::ProcMgr::CollectNewTriggers()
 
 //      flush_time = 0.;
 
-      if (flush_time != 0.) {
+      if ((flush_time != 0.) && IsTimesliceMode()) {
+         AddTimesliceMarkers(flush_time);
+      } else if (flush_time != 0.) {
 //         printf("FLUSH: %12.9f\n", flush_time);
-         fTriggers.push(GlobalMarker(flush_time));
-         fTriggers.back().isflush = true;
+         if (fTriggers.push_adaptive(GlobalMarker(flush_time), fTriggersLimit))
+            fTriggers.back().isflush = true;
       }
    }
 
@@ -749,6 +1582,29 @@ bool base::ProcMgr::CollectNewTriggers()
    return true;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Create markers for all timeslices which end before flush time
+/// Timeslices start at multiple of timeslice length, window of each marker is [0, length)
+
+void base::ProcMgr::AddTimesliceMarkers(GlobalTime_t flush_time)
+{
+   if (!fTimesliceStarted) {
+      // grid starts from earliest data, otherwise hits before first flush time are lost
+      GlobalTime_t first_tm = flush_time, tm = 0.;
+      for (unsigned n = 0; n < fProc.size(); n++)
+         if (fProc[n]->ProvideFirstDataTime(tm) && (tm < first_tm))
+            first_tm = tm;
+      fNextTimesliceTm = std::floor(first_tm / fTimesliceLength) * fTimesliceLength;
+      fTimesliceStarted = true;
+   }
+
+   while (fNextTimesliceTm + fTimesliceLength <= flush_time) {
+      // when triggers queue at limit, timeslice will be created next time
+      if (!fTriggers.push_adaptive(GlobalMarker(fNextTimesliceTm), fTriggersLimit)) break;
+      fNextTimesliceTm += fTimesliceLength;
+   }
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////
 /// Method to produce data for new triggers
 ///
@@ -781,6 +1637,18 @@ bool base::ProcMgr::AnalyzeNewData(base::Event* &evt)
       fTrigEvent = evt;
    }
 
+   if (fProfiler.IsActive() && (fProfilingInterval > 0)) {
+      double tm = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+      if (fProfilingLastTm <= 0)
+         fProfilingLastTm = tm;
+      else if (tm > fProfilingLastTm + fProfilingInterval) {
+         fProfilingLastTm = tm;
+         PrintProfiling();
+      }
+   }
+
+   ProfilerGuard grd(fProfiler, "scan", 0);
+
    // scan new data in the processors
    for (unsigned n = 0; n < fProc.size(); n++)
       fProc[n]->ScanNewBuffers();
@@ -793,6 +1661,8 @@ bool base::ProcMgr::AnalyzeNewData(base::Event* &evt)
       return true;
    }
 
+   grd.Next("sync", 1);
+
    // analyze new sync markers
    if (AnalyzeSyncMarkers()) {
       // get and redistribute new triggers
@@ -801,6 +1671,8 @@ bool base::ProcMgr::AnalyzeNewData(base::Event* &evt)
       ScanDataForNewTriggers();
    }
 
+   grd.Next("event", 2);
+
    return ProduceNextEvent(evt);
 }
 
@@ -834,6 +1706,9 @@ bool base::ProcMgr::ProduceNextEvent(base::Event* &evt)
 {
    if (!IsStreamAnalysis()) return false;
 
+   if (IsTimesliceMode())
+      return ProduceNextTimeslice(evt);
+
    unsigned numready = fTriggers.size();
 
    for (unsigned n=0;n<fProc.size();n++) {
@@ -877,6 +1752,104 @@ bool base::ProcMgr::ProduceNextEvent(base::Event* &evt)
    return false;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Fill timeslice with hits from subevents of all processors and sort it
+/// Called from worker threads, only reads subevents
+
+void base::ProcMgr::FillTimeslice(base::Timeslice *ts, base::Event *evt)
+{
+   for (unsigned n = 0; n < fProc.size(); n++) {
+      base::SubEvent *sub = evt->GetSubEvent(fProc[n]->GetName());
+      if (sub) fProc[n]->FillTimeslice(*ts, sub, n);
+   }
+
+   ts->Sort();
+
+   evt->DestroyEvents();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Build timeslices for all ready markers
+///
+/// First subevents of all processors are collected for each timeslice,
+/// than timeslices filled and sorted - when several are ready, in persistent worker threads.
+/// At the end hits from overlap with previous timeslice are inserted
+
+bool base::ProcMgr::BuildTimeslices()
+{
+   unsigned numready = fTriggers.size();
+
+   for (unsigned n = 0; n < fProc.size(); n++) {
+      if (fProc[n]->IsRawAnalysis()) continue;
+      unsigned local = fProc[n]->NumReadySubevents();
+      if (local < numready) numready = local;
+   }
+
+   if (numready == 0) return false;
+
+   if (!fTimesliceWorkers)
+      fTimesliceWorkers = new TimesliceWorkers(fTimesliceThreads > 1 ? fTimesliceThreads - 1 : 0);
+
+   auto workers = fTimesliceWorkers;
+   workers->numtasks = 0;
+
+   unsigned first = fTimeslices.size();
+
+   while (numready-- > 0) {
+      if (fTriggers.front().isflush) {
+         for (unsigned n = 0; n < fProc.size(); n++)
+            fProc[n]->AppendSubevent(nullptr);
+         fTriggers.pop();
+         continue;
+      }
+
+      fTimeslices.emplace_back(new base::Timeslice(fTriggers.front().globaltm, fTimesliceLength, fTimesliceOverlap));
+
+      auto evt = workers->AddTask();
+      for (unsigned n = 0; n < fProc.size(); n++)
+         fProc[n]->AppendSubevent(evt);
+      fTriggers.pop();
+   }
+
+   workers->func = [this, first, workers](unsigned k) { FillTimeslice(fTimeslices[first + k], workers->events[k]); };
+   workers->Run();
+
+   // hits from overlap interval are taken from previous timeslice
+   if (fTimesliceOverlap > 0.)
+      for (unsigned k = first; k < fTimeslices.size(); k++) {
+         auto ts = fTimeslices[k];
+         ts->InsertFront(fTimesliceTail);
+         fTimesliceTail.CopyHits(*ts, ts->GetEndTime() - fTimesliceOverlap);
+      }
+
+   return fTimeslicesPos < fTimeslices.size();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Deliver next timeslice as event with single "Timeslice" subevent
+
+bool base::ProcMgr::ProduceNextTimeslice(base::Event* &evt)
+{
+   if (fTimeslicesPos >= fTimeslices.size()) {
+      fTimeslices.clear();
+      fTimeslicesPos = 0;
+      if (!BuildTimeslices()) return false;
+   }
+
+   if (!evt)
+      evt = new base::Event;
+   else
+      evt->DestroyEvents();
+
+   auto ts = fTimeslices[fTimeslicesPos];
+   fTimeslices[fTimeslicesPos++] = nullptr;
+
+   evt->SetTriggerTime(ts->GetStart());
+   evt->AddSubEvent("Timeslice", ts);
+
+   return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////
 /// Process event - consequently calls all event processors
 
@@ -885,13 +1858,22 @@ bool base::ProcMgr::ProcessEvent(base::Event* evt)
    if (!evt)
       return false;
 
+   ProfilerGuard grd(fProfiler, "evproc", 3);
+
    // call event processors one after another until event is discarded
    for (unsigned n = 0; n < fEvProc.size(); n++)
-      if (!fEvProc[n]->Process(evt))
+      if (!fEvProc[n]->Process(evt)) {
+         // pointers on event data may be set during triggered analysis, reset them
+         for (unsigned k = 0; k < fProc.size(); k++)
+            if (fProc[k]->IsStoreEnabled())
+               fProc[k]->ResetStore();
          return false;
+      }
 
    bool isanystore = false;
 
+   grd.Next("store", 4);
+
    for (unsigned n=0;n<fProc.size();n++)
       if (fProc[n]->IsStoreEnabled()) {
          fProc[n]->Store(evt);
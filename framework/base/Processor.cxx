@@ -1,5 +1,6 @@
 #include "base/Processor.h"
 
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cmath>
@@ -17,8 +18,16 @@ base::Processor::Processor(const char* name, unsigned brdid) :
    fSubPrefixD(),
    fSubPrefixN(),
    fHistFilling(99),
+   fHistSampling(1),
+   fHistSamplingTm(0.),
+   fSampledEvent(true),
+   fSampledWeight(1.),
+   fSampledSkip(0),
+   fSampledLastTm(0.),
    fStoreKind(0),
-   fIntHistFormat(false)
+   fIntHistFormat(false),
+   fIntHistStorage(hist_Double),
+   fIntHistDirty(false)
 {
    if (brdid != DummyBrdId) {
       char sbuf[100];
@@ -31,6 +40,8 @@ base::Processor::Processor(const char* name, unsigned brdid) :
    fPathPrefix = fName;
    fPrefix = fName;
 
+   fProfiler.SetActive(false);
+
    SetManager(base::ProcMgr::instance());
 }
 
@@ -50,11 +61,55 @@ void base::Processor::SetManager(base::ProcMgr* m)
 
    if (fMgr) {
       fIntHistFormat = fMgr->InternalHistFormat();
+      fIntHistStorage = fMgr->InternalHistStorage();
+      fIntHistDirty = fMgr->HasHistDirtyBits();
       fHistFilling = fMgr->fDfltHistLevel;
+      SetHistSampling(fMgr->fDfltHistSampling, fMgr->fDfltHistSamplingRate);
+      SetProfiling(fMgr->fDfltProfiling);
       fStoreKind = fMgr->fDfltStoreKind;
    }
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Configure sampled filling of expensive histograms (like per-channel histograms in TDC).
+/// Such histograms filled only for 1 of n events and not more often than hz times per second.
+/// Sampled event filled with weight, equal to number of events since previous sampled event,
+/// therefore histograms content remains comparable with not sampled histograms.
+/// Can be changed at any time, n=1 and hz=0 disables sampling
+
+void base::Processor::SetHistSampling(unsigned n, double hz)
+{
+   fHistSampling = n > 1 ? n : 1;
+   fHistSamplingTm = hz > 0 ? 1./hz : 0.;
+   fSampledEvent = true;
+   fSampledWeight = 1.;
+   fSampledSkip = 0;
+   fSampledLastTm = 0.;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Select if current event is sampled, only called when sampling is enabled
+
+bool base::Processor::DoSelectSampledEvent()
+{
+   fSampledEvent = ++fSampledSkip >= fHistSampling;
+
+   if (fSampledEvent && (fHistSamplingTm > 0)) {
+      double tm = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+      if (tm < fSampledLastTm + fHistSamplingTm)
+         fSampledEvent = false;
+      else
+         fSampledLastTm = tm;
+   }
+
+   if (fSampledEvent) {
+      fSampledWeight = fSampledSkip;
+      fSampledSkip = 0;
+   }
+
+   return fSampledEvent;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 /// set sub-prefixes
 
@@ -129,6 +184,7 @@ void base::Processor::SetSubPrefix2(const char* name, int indx, const char* subn
 
 /////////////////////////////////////////////////////////////////////////
 /// Adds processor prefix to histogram name and calls \ref base::ProcMgr::MakeH1 method
+/// Histogram in internal format registered for delta publishing
 
 base::H1handle base::Processor::MakeH1(const char* name, const char* title, int nbins, double left, double right, const char* xtitle)
 {
@@ -152,12 +208,16 @@ base::H1handle base::Processor::MakeH1(const char* name, const char* title, int
       right = iter->second.right;
    }
 
-   return mgr()->MakeH1(hname.c_str(), htitle.c_str(), nbins, left, right, xtitle);
+   H1handle h1 = mgr()->MakeH1(hname.c_str(), htitle.c_str(), nbins, left, right, xtitle);
+   if (h1 && fIntHistFormat)
+      mgr()->RegisterDeltaH1(h1, hname.c_str());
+   return h1;
 }
 
 
 /////////////////////////////////////////////////////////////////////////
 /// Adds processor prefix to histogram name and calls \ref base::ProcMgr::MakeH2 method
+/// Histogram in internal format registered for delta publishing
 
 base::H2handle base::Processor::MakeH2(const char* name, const char* title, int nbins1, double left1, double right1, int nbins2, double left2, double right2, const char* options)
 {
@@ -181,7 +241,10 @@ base::H2handle base::Processor::MakeH2(const char* name, const char* title, int
       right2 = iter->second.right;
    }
 
-   return mgr()->MakeH2(hname.c_str(), htitle.c_str(), nbins1, left1, right1, nbins2, left2, right2, options);
+   H2handle h2 = mgr()->MakeH2(hname.c_str(), htitle.c_str(), nbins1, left1, right1, nbins2, left2, right2, options);
+   if (h2 && fIntHistFormat)
+      mgr()->RegisterDeltaH2(h2, hname.c_str());
+   return h2;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,387 @@
+#include "base/ShmProcMgr.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#ifndef STREAM_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+   /** copy string into fixed-size field */
+   void CopyName(char *tgt, const char *src)
+   {
+      strncpy(tgt, src ? src : "", base::ShmHist::NameLength - 1);
+      tgt[base::ShmHist::NameLength - 1] = 0;
+   }
+
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Constructor
+/// Creates shared memory segment of specified size with directory for maxhist histograms.
+/// Memory pages are only used when histograms are created.
+/// If segment with same name already exists, it may belong to running analysis - creation fails.
+/// With force flag existing segment is removed before creation
+
+base::ShmProcMgr::ShmProcMgr(const char *shmname, uint64_t size, unsigned maxhist, bool force) :
+   ProcMgr(),
+   fShmName(shmname ? shmname : "")
+{
+#ifdef STREAM_WINDOWS
+   printf("Shared memory histograms not supported on Windows\n");
+   (void) size;
+   (void) maxhist;
+   (void) force;
+#else
+   uint64_t dataoffset = sizeof(ShmHist::Header) + (uint64_t) maxhist * sizeof(ShmHist::Entry);
+   dataoffset = (dataoffset + 63) & ~((uint64_t) 63);
+
+   if (size < dataoffset + 0x10000) size = dataoffset + 0x10000;
+
+   if (force)
+      shm_unlink(fShmName.c_str());
+
+   int fd = shm_open(fShmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+   if (fd < 0) {
+      if (errno == EEXIST)
+         printf("Shared memory %s already exists, remove it or use force flag\n", fShmName.c_str());
+      else
+         printf("Fail to create shared memory %s\n", fShmName.c_str());
+      return;
+   }
+
+   if (ftruncate(fd, size) != 0) {
+      printf("Fail to resize shared memory %s to %lu bytes\n", fShmName.c_str(), (long unsigned) size);
+      close(fd);
+      shm_unlink(fShmName.c_str());
+      return;
+   }
+
+   void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+
+   if (mem == MAP_FAILED) {
+      printf("Fail to map shared memory %s\n", fShmName.c_str());
+      shm_unlink(fShmName.c_str());
+      return;
+   }
+
+   fSegment = (char *) mem;
+   fSegmentSize = size;
+
+   // segment is zero-initialized, atomics can be used directly
+   auto hdr = header();
+   hdr->layout = ShmHist::Layout;
+   hdr->maxhist = maxhist;
+   hdr->size = size;
+   hdr->dataoffset = dataoffset;
+   hdr->numhist.store(0, std::memory_order_relaxed);
+   hdr->dataused.store(0, std::memory_order_relaxed);
+   hdr->dirversion.store(0, std::memory_order_relaxed);
+   hdr->events.store(0, std::memory_order_relaxed);
+   hdr->fillseq.store(0, std::memory_order_relaxed);
+   memcpy(hdr->magic, "STRMHIST", 8);
+   std::atomic_thread_fence(std::memory_order_release);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Destructor
+/// Histograms in segment cannot be used afterwards, therefore processors deleted first
+
+base::ShmProcMgr::~ShmProcMgr()
+{
+   DeleteAllProcessors();
+
+#ifndef STREAM_WINDOWS
+   if (fSegment) {
+      munmap(fSegment, fSegmentSize);
+      if (fUnlink)
+         shm_unlink(fShmName.c_str());
+   }
+#endif
+   fSegment = nullptr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Allocate histogram in shared memory and add entry to the directory
+/// Histogram with "reuse" option and same name is shared
+
+double *base::ShmProcMgr::AllocateHist(unsigned size, const char *name, const char *title, const char *options,
+                                       int nbins1, double left1, double right1,
+                                       int nbins2, double left2, double right2)
+{
+   if (!fSegment)
+      return ProcMgr::AllocateHist(size, name, title, options, nbins1, left1, right1, nbins2, left2, right2);
+
+   auto hdr = header();
+   unsigned numhist = hdr->numhist.load(std::memory_order_relaxed);
+
+   if (options && strstr(options, "reuse"))
+      for (unsigned n = 0; n < numhist; ++n) {
+         auto e = entry(n);
+         if ((strncmp(e->name, name, ShmHist::NameLength - 1) == 0) && (e->nbins1 == nbins1) && (e->nbins2 == nbins2) &&
+             (e->size == size * sizeof(double)))
+            return (double *) (fSegment + e->offset);
+      }
+
+   uint64_t used = hdr->dataused.load(std::memory_order_relaxed),
+            nbytes = ((uint64_t) size * sizeof(double) + 63) & ~((uint64_t) 63);
+
+   if ((numhist >= hdr->maxhist) || (hdr->dataoffset + used + nbytes > fSegmentSize)) {
+      printf("Shared memory %s is full, histogram %s allocated in normal memory\n", fShmName.c_str(), name);
+      return ProcMgr::AllocateHist(size, name, title, options, nbins1, left1, right1, nbins2, left2, right2);
+   }
+
+   auto e = entry(numhist);
+   CopyName(e->name, name);
+   CopyName(e->title, title);
+   CopyName(e->options, options);
+   e->ndim = nbins2 > 0 ? 2 : 1;
+   e->storage = InternalHistStorage();
+   e->nbins1 = nbins1;
+   e->nbins2 = nbins2;
+   e->left1 = left1;
+   e->right1 = right1;
+   e->left2 = left2;
+   e->right2 = right2;
+   e->offset = hdr->dataoffset + used;
+   e->size = (uint64_t) size * sizeof(double);
+   e->version.store(0, std::memory_order_relaxed);
+
+   double *res = (double *) (fSegment + e->offset);
+   fEntries[res] = numhist;
+
+   hdr->dataused.store(used + nbytes, std::memory_order_relaxed);
+   hdr->numhist.store(numhist + 1, std::memory_order_release);
+   hdr->dirversion.fetch_add(1, std::memory_order_release);
+
+   return res;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Increment version of histogram, signals reader that content was changed not only by filling
+
+void base::ShmProcMgr::IncVersion(void *hist)
+{
+   auto iter = fEntries.find(hist);
+   if (iter != fEntries.end())
+      entry(iter->second)->version.fetch_add(1, std::memory_order_release);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Set content of 1D histogram
+
+void base::ShmProcMgr::SetH1Content(H1handle h1, int bin, double v)
+{
+   ProcMgr::SetH1Content(h1, bin, v);
+   IncVersion(h1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Clear 1D histogram
+
+void base::ShmProcMgr::ClearH1(H1handle h1)
+{
+   ProcMgr::ClearH1(h1);
+   IncVersion(h1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Copy 1D histogram
+
+void base::ShmProcMgr::CopyH1(H1handle tgt, H1handle src)
+{
+   ProcMgr::CopyH1(tgt, src);
+   IncVersion(tgt);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Set content of 2D histogram
+
+void base::ShmProcMgr::SetH2Content(H2handle h2, int bin1, int bin2, double v)
+{
+   ProcMgr::SetH2Content(h2, bin1, bin2, v);
+   IncVersion(h2);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Clear 2D histogram
+
+void base::ShmProcMgr::ClearH2(H2handle h2)
+{
+   ProcMgr::ClearH2(h2);
+   IncVersion(h2);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Mark begin of histograms filling, fill sequence becomes odd
+/// Only outermost call changes sequence
+
+void base::ShmProcMgr::BeginFill()
+{
+   if (!fSegment || (fFillDepth++ > 0)) return;
+
+   header()->fillseq.fetch_add(1, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Mark end of histograms filling, fill sequence becomes even again
+
+void base::ShmProcMgr::EndFill()
+{
+   if (!fSegment || (fFillDepth == 0) || (--fFillDepth > 0)) return;
+
+   header()->fillseq.fetch_add(1, std::memory_order_release);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Analyze new data, histograms filled during scan are covered by fill sequence
+
+bool base::ShmProcMgr::AnalyzeNewData(base::Event* &evt)
+{
+   BeginFill();
+
+   bool res = ProcMgr::AnalyzeNewData(evt);
+
+   EndFill();
+
+   return res;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Process event, counter of events in segment header is incremented
+
+bool base::ShmProcMgr::ProcessEvent(base::Event* evt)
+{
+   BeginFill();
+
+   bool res = ProcMgr::ProcessEvent(evt);
+
+   if (fSegment && evt)
+      header()->events.fetch_add(1, std::memory_order_release);
+
+   EndFill();
+
+   return res;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Returns true when histograms were not modified since fill sequence value was taken
+/// Usage: take GetFillSeq(), read bins, then check IsExactSnapshot(seq)
+
+bool base::ShmHistReader::IsExactSnapshot(uint64_t seq) const
+{
+   if (!fSegment || (seq % 2 != 0)) return false;
+
+   std::atomic_thread_fence(std::memory_order_acquire);
+
+   return header()->fillseq.load(std::memory_order_relaxed) == seq;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// destructor
+
+base::ShmHistReader::~ShmHistReader()
+{
+   Close();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Attach shared memory segment in read-only mode
+
+bool base::ShmHistReader::Open(const char *shmname)
+{
+   Close();
+
+#ifdef STREAM_WINDOWS
+   (void) shmname;
+   return false;
+#else
+   int fd = shm_open(shmname, O_RDONLY, 0);
+   if (fd < 0) return false;
+
+   struct stat st;
+   if ((fstat(fd, &st) != 0) || ((uint64_t) st.st_size < sizeof(ShmHist::Header))) {
+      close(fd);
+      return false;
+   }
+
+   void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (mem == MAP_FAILED) return false;
+
+   fSegment = (const char *) mem;
+   fSegmentSize = st.st_size;
+
+   if ((memcmp(header()->magic, "STRMHIST", 8) != 0) || (header()->layout != ShmHist::Layout)) {
+      printf("Shared memory %s does not contain histograms\n", shmname);
+      Close();
+      return false;
+   }
+
+   return true;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Detach segment
+
+void base::ShmHistReader::Close()
+{
+#ifndef STREAM_WINDOWS
+   if (fSegment)
+      munmap((void *) fSegment, fSegmentSize);
+#endif
+   fSegment = nullptr;
+   fSegmentSize = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Find histogram by name, returns -1 if not found
+
+int base::ShmHistReader::FindHist(const char *name) const
+{
+   unsigned numhist = NumHist();
+   for (unsigned n = 0; n < numhist; ++n)
+      if (strncmp(GetEntry(n).name, name, ShmHist::NameLength - 1) == 0)
+         return n;
+   return -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+/// Read histogram bins, including underflow and overflow bins
+/// For 2D histogram (nbins1+2)*(nbins2+2) values returned, X bin index changes fastest
+
+bool base::ShmHistReader::ReadBins(unsigned n, std::vector<double> &bins) const
+{
+   if (n >= NumHist()) return false;
+
+   auto &e = GetEntry(n);
+   if (e.offset + e.size > fSegmentSize) return false;
+
+   unsigned hdrsize = e.ndim == 2 ? 6 : 3,
+            nbins = e.ndim == 2 ? (e.nbins1 + 2) * (e.nbins2 + 2) : e.nbins1 + 2;
+
+   const double *arr = (const double *) (fSegment + e.offset);
+
+   bins.resize(nbins);
+
+   if (e.storage == hist_Double) {
+      for (unsigned k = 0; k < nbins; ++k)
+         bins[k] = arr[hdrsize + k];
+   } else {
+      void *src = CompactHist::Bins((void *) arr, e.ndim == 2 ? CompactHist::H2HeaderSize : CompactHist::H1HeaderSize);
+      for (unsigned k = 0; k < nbins; ++k)
+         bins[k] = CompactHist::Get(src, k);
+   }
+
+   return true;
+}
@@ -3,12 +3,15 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cmath>
+#include <algorithm>
 
 #include "base/ProcMgr.h"
 #include "base/Event.h"
 
-unsigned base::StreamProc::fMarksQueueCapacity = 10000;
+unsigned base::StreamProc::fMarksQueueCapacity = 1000;
 unsigned base::StreamProc::fBufsQueueCapacity = 100;
+unsigned base::StreamProc::fMarksQueueMaxCapacity = 100000;
+unsigned base::StreamProc::fBufsQueueMaxCapacity = 10000;
 
 ////////////////////////////////////////////////////////////////////////////////////////////
 /// constructor
@@ -31,7 +34,9 @@ base::StreamProc::StreamProc(const char* name, unsigned brdid, bool basehist) :
    fTimeSorting(false),
    fTriggerTm(nullptr),
    fMultipl(nullptr),
-   fTriggerWindow(nullptr)
+   fTriggerWindow(nullptr),
+   fBufsQueueLimit(fBufsQueueMaxCapacity),
+   fMarksQueueLimit(fMarksQueueMaxCapacity)
 {
    fMgr = base::ProcMgr::AddProc(this);
 
@@ -58,6 +63,8 @@ void base::StreamProc::CreateTriggerHist(unsigned multipl, unsigned nbins, doubl
    SetSubPrefix();
 
    fTriggerTm = MakeH1("TriggerTm", "Time relative to trigger", nbins, left, right, "reuse;s");
+   fTriggerTmLeft = SecondsToPs(left);
+   fTriggerTmRight = SecondsToPs(right);
    fMultipl = MakeH1("Multipl", "Subevent multiplicity", multipl, 0, multipl, "reuse;hits");
    fTriggerWindow = MakeC1("TrWindow", 5e-7, 10e-7, fTriggerTm);
 }
@@ -180,16 +187,16 @@ base::GlobalTime_t base::StreamProc::LocalToGlobalTime(base::GlobalTime_t localt
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
-/// add next buffer
+/// Add next buffer to the queue
+/// Also used when buffer provided as rvalue, therefore subclasses should override only this method
 
 bool base::StreamProc::AddNextBuffer(const Buffer& buf)
 {
-   // printf("%4s Add buffer queue size %u\n", GetName(), fQueue.size());
-
-   if (fQueue.full())
-      printf("%s queue if full size %u\n", GetName(), fQueue.size());
-
-   fQueue.push(buf);
+   if (IsQueueAtLimit() || !fQueue.push_adaptive(buf, fBufsQueueLimit)) {
+      if (fNumRejectedBufs++ == 0)
+         printf("%s queue reached limit %u, buffers will be rejected\n", GetName(), fQueue.size());
+      return false;
+   }
 
    return true;
 }
@@ -278,6 +285,25 @@ base::GlobalTime_t base::StreamProc::ProvidePotentialFlushTime(GlobalTime_t last
    return 0.;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////
+/// Provide earliest global time of data in the queue
+///
+/// Used to define start of timeslices grid. Returns false when no buffer time assigned yet
+
+bool base::StreamProc::ProvideFirstDataTime(GlobalTime_t &tm)
+{
+   if (IsRawAnalysis() || (fQueueScanIndexTm == 0)) return false;
+
+   const base::Buffer& buf = fQueue.item(0);
+
+   tm = buf().global_tm;
+   if (buf().hits_range && (buf().hits_cnt > 0))
+      tm = std::min(tm, LocalToGlobalTime(buf().hits_min_tm));
+   tm -= MaximumDisorderTm();
+
+   return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 /// verify flush time
 ///
@@ -316,7 +342,8 @@ void base::StreamProc::AddSyncMarker(base::SyncMarker& marker)
 
    marker.globaltm = 0.;
    marker.bufid = fQueueScanIndex;
-   fSyncs.push(marker);
+   if (!fSyncs.push_adaptive(marker, fMarksQueueLimit))
+      fNumSyncLost++;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -324,8 +351,8 @@ void base::StreamProc::AddSyncMarker(base::SyncMarker& marker)
 
 bool base::StreamProc::AddTriggerMarker(LocalTimeMarker& marker, double tm_range)
 {
-   // ignore trigger marker when not doing stream analysis
-   if (!IsStreamAnalysis()) return true;
+   // ignore trigger marker when not doing stream analysis or when timeslices are produced
+   if (!IsStreamAnalysis() || mgr()->IsTimesliceMode()) return true;
 
    // last local trigger is remembered to exclude trigger duplication or
    // too close distances
@@ -343,13 +370,11 @@ bool base::StreamProc::AddTriggerMarker(LocalTimeMarker& marker, double tm_range
       }
    }
 
-   if (fLocalMarks.full()) {
-      printf("Local markers queue is full in processor %s\n", GetName());
-      exit(7);
+   if (!fLocalMarks.push_adaptive(marker, fMarksQueueLimit)) {
+      printf("Local markers queue reached limit %u in processor %s\n", fLocalMarks.size(), GetName());
+      return false;
    }
 
-   fLocalMarks.push(marker);
-
 //   printf("Add trigger %12.9f\n", marker.localtm);
 
    // keep time of last trigger
@@ -382,6 +407,47 @@ bool base::StreamProc::eraseSyncAt(unsigned indx)
    return false;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////
+/// Returns maximal number of items in the markers queues
+
+unsigned base::StreamProc::GetMarksQueueHighWater() const
+{
+   unsigned res = fSyncs.high_water();
+   if (fLocalMarks.high_water() > res) res = fLocalMarks.high_water();
+   if (fGlobalMarks.high_water() > res) res = fGlobalMarks.high_water();
+   return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+/// Release memory of queues which grow during peak load, but mostly empty now
+/// Capacity never goes below initial value
+
+void base::StreamProc::AdjustQueuesCapacity()
+{
+   fQueue.ShrinkUnused(fBufsQueueCapacity);
+   fSyncs.ShrinkUnused(fMarksQueueCapacity);
+   fLocalMarks.ShrinkUnused(fMarksQueueCapacity);
+   fGlobalMarks.ShrinkUnused(fMarksQueueCapacity);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+/// erase cnt sync markers starting from specified position
+/// remaining markers are moved only once, scan index adjusted
+
+bool base::StreamProc::eraseSyncsAt(unsigned indx, unsigned cnt)
+{
+   if ((indx >= fSyncs.size()) || (cnt == 0)) return false;
+
+   if (cnt > fSyncs.size() - indx) cnt = fSyncs.size() - indx;
+
+   fSyncs.erase_items(indx, cnt);
+
+   if (fSyncScanIndex > indx)
+      fSyncScanIndex -= (fSyncScanIndex - indx < cnt) ? fSyncScanIndex - indx : cnt;
+
+   return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 /// erase first sync markers
 
@@ -451,6 +517,8 @@ bool base::StreamProc::SkipBuffers(unsigned num_skip)
       }
    }
 
+   AdjustQueuesCapacity();
+
    return true;
 }
 
@@ -465,6 +533,8 @@ void base::StreamProc::SkipAllData()
 
    fLocalMarks.clear();
    fGlobalMarks.clear();
+   fGlobalTrigHint = 0;
+   fGlobalMarksOrdered = true;
 
    fSyncs.clear();
    fSyncScanIndex = 0;
@@ -507,13 +577,27 @@ bool base::StreamProc::CollectTriggers(GlobalMarksQueue& trigs)
       }
 
 
+      // when triggers queue at limit, marker remains for next time
+      if (!trigs.push_adaptive(marker, mgr()->GetTriggersQueueLimit())) break;
+
       fLocalMarks.pop();
-      trigs.push(marker);
    }
 
    return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////
+/// Returns left or right limit of window around trigger
+/// In timeslice mode window covers complete timeslice
+
+double base::StreamProc::GetTriggerWindowLimit(bool isleft)
+{
+   if (mgr()->IsTimesliceMode())
+      return isleft ? 0. : mgr()->GetTimesliceLength();
+
+   return GetC1Limit(fTriggerWindow, isleft);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 /// distribute triggers
 
@@ -525,16 +609,30 @@ bool base::StreamProc::DistributeTriggers(const base::GlobalMarksQueue& queue)
    // no need for trigger when doing only raw scan
    if (IsRawAnalysis()) return true;
 
+   // global markers mirror triggers queue of the manager, therefore limit cannot be smaller
+   unsigned limit = fMarksQueueLimit > mgr()->GetTriggersQueueLimit() ? fMarksQueueLimit : mgr()->GetTriggersQueueLimit();
+
    while (fGlobalMarks.size() < queue.size()) {
       unsigned indx = fGlobalMarks.size();
 
-      fGlobalMarks.push(queue.item(indx));
+      // if queue cannot grow, remaining triggers stay in source queue for the next call
+      if (!fGlobalMarks.push_adaptive(queue.item(indx), limit)) {
+         printf("Global markers queue cannot grow above %u in processor %s\n", fGlobalMarks.size(), GetName());
+         break;
+      }
 
       // when trigger window not specified and trigger analysis is configured, than accept all hits
       if (IsTriggeredAnalysis() && !fTriggerWindow)
          fGlobalMarks.back().SetInterval(-1e50, 1e50);
       else
-         fGlobalMarks.back().SetInterval(GetC1Limit(fTriggerWindow, true), GetC1Limit(fTriggerWindow, false));
+         fGlobalMarks.back().SetInterval(GetTriggerWindowLimit(true), GetTriggerWindowLimit(false));
+
+      // window can be changed at any time, binary search in TestHitTime only possible for ordered boundaries
+      if (indx > 0) {
+         const GlobalMarker &prev = fGlobalMarks.item(indx - 1), &last = fGlobalMarks.back();
+         if ((last.leftps < prev.leftps) || (last.rightps < prev.rightps))
+            fGlobalMarksOrdered = false;
+      }
 
 //      if (fGlobalMarks.back().normal())
 //         printf("%s trigger %12.9f %12.9f\n", GetName(), fGlobalMarks.back().lefttm, fGlobalTrig.back().righttm);
@@ -576,6 +674,12 @@ bool base::StreamProc::AppendSubevent(base::Event* evt)
 
    fGlobalMarks.pop();
 
+   if (fGlobalTrigHint > 0)
+      fGlobalTrigHint--;
+
+   if (fGlobalMarks.size() == 0)
+      fGlobalMarksOrdered = true;
+
    if (fGlobalTrigScanIndex == 0) {
       printf("Index of ready event is 0 - how to understand???\n");
       exit(12);
@@ -590,12 +694,161 @@ bool base::StreamProc::AppendSubevent(base::Event* evt)
    return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////
+/// Find first trigger in range [fGlobalTrigScanIndex, fGlobalTrigRightIndex) with right boundary after hit time
+/// Requires ordered trigger boundaries. Search starts from position found for previous hit -
+/// while hits are almost time-ordered, normally only one or two triggers are checked
+
+unsigned base::StreamProc::FindFirstTriggerRight(GlobalTimePs_t hitps)
+{
+   unsigned lo = fGlobalTrigScanIndex, hi = fGlobalTrigRightIndex;
+
+   if ((fGlobalTrigHint > lo) && (fGlobalTrigHint < hi)) {
+      if (fGlobalMarks.item(fGlobalTrigHint - 1).rightps <= hitps)
+         lo = fGlobalTrigHint;
+      else
+         hi = fGlobalTrigHint - 1;
+   }
+
+   // check closest position, than use binary search
+   if ((lo < hi) && (hitps < fGlobalMarks.item(lo).rightps))
+      hi = lo;
+
+   while (lo < hi) {
+      unsigned mid = lo + (hi - lo) / 2;
+      if (fGlobalMarks.item(mid).rightps <= hitps)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   fGlobalTrigHint = lo;
+
+   return lo;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+/// Check if second scan of the buffer can be skipped
+/// Possible when first scan recorded time range of buffer hits and this range does not overlap
+/// with window of any normal trigger in work. When trigger time histogram is filled, histogram range
+/// is checked as well - hits of skipped buffer then only missing in underflow/overflow bins
+
+bool base::StreamProc::CanSkipSecondScan(const base::Buffer& buf)
+{
+   if (!fSkipEmptyScans || !IsStreamAnalysis() || !buf().hits_range) return false;
+
+   if (buf().hits_cnt == 0) return true;
+
+   // small margin to compensate rounding in time conversion
+   GlobalTimePs_t margin = SecondsToPs(MaximumDisorderTm()) + 1000,
+                  minps = SecondsToPs(LocalToGlobalTime(buf().hits_min_tm)) - margin,
+                  maxps = SecondsToPs(LocalToGlobalTime(buf().hits_max_tm)) + margin;
+
+   for (unsigned indx = fGlobalTrigScanIndex; indx < fGlobalTrigRightIndex; indx++) {
+      GlobalMarker& marker = fGlobalMarks.item(indx);
+      if (fGlobalMarksOrdered && !fTriggerTm && (marker.leftps > maxps)) break;
+      if (!marker.normal()) continue;
+      if ((marker.leftps <= maxps) && (marker.rightps >= minps))
+         return false;
+      if (fTriggerTm && (marker.globalps + fTriggerTmLeft <= maxps) && (marker.globalps + fTriggerTmRight >= minps))
+         return false;
+   }
+
+   return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 /// test hit time
+///
+/// Hit time converted to picoseconds, all further comparisons done with integers
 
 unsigned base::StreamProc::TestHitTime(const base::GlobalTime_t& hittime, bool normal_hit, bool can_close_event)
 {
-   double dist(0.), best_dist(-1e15), best_trigertm(-1e15);
+   return TestHitTimePs(SecondsToPs(hittime), normal_hit, can_close_event);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+/// test hit time in picoseconds
+///
+/// Trigger boundaries normally ordered in time, therefore binary search is used to locate
+/// triggers around the hit. Result is the same as with linear scan of all triggers -
+/// including selection of closest trigger for the histogram and declaring events ready
+
+unsigned base::StreamProc::TestHitTimePs(GlobalTimePs_t hitps, bool normal_hit, bool can_close_event)
+{
+   // for few triggers linear scan is faster
+   if (!fGlobalMarksOrdered || (fGlobalTrigRightIndex < fGlobalTrigScanIndex + 8))
+      return TestHitTimeLinear(hitps, normal_hit, can_close_event);
+
+   if (fGlobalTrigRightIndex > fGlobalMarks.size()) {
+      printf("ALARM!!!!\n");
+      exit(10);
+   }
+
+   GlobalTimePs_t dist(0), best_dist(0), best_trigertm(0);
+
+   unsigned res_indx(fGlobalMarks.size()), best_indx(fGlobalMarks.size());
+
+   unsigned first = FindFirstTriggerRight(hitps);
+
+   // all triggers before first are left from the hit, closest is last normal trigger
+   // among triggers with same boundary the first one is used
+   for (unsigned indx = first; indx-- > fGlobalTrigScanIndex; ) {
+      if (!fGlobalMarks.item(indx).normal()) continue;
+
+      GlobalTimePs_t rightps = fGlobalMarks.item(indx).rightps;
+      for (unsigned n = indx; n-- > fGlobalTrigScanIndex; ) {
+         if (fGlobalMarks.item(n).rightps != rightps) break;
+         if (fGlobalMarks.item(n).normal()) indx = n;
+      }
+
+      GlobalMarker &marker = fGlobalMarks.item(indx);
+      best_dist = hitps - marker.rightps;
+      best_trigertm = hitps - marker.globalps;
+      best_indx = indx;
+      break;
+   }
+
+   // triggers from first are on the right side or contain the hit,
+   // with ordered boundaries only first normal trigger should be checked
+   for (unsigned indx = first; indx < fGlobalTrigRightIndex; indx++) {
+      GlobalMarker& marker = fGlobalMarks.item(indx);
+      if (!marker.normal()) continue;
+
+      int test = marker.TestHitTimePs(hitps, &dist);
+
+      if ((best_indx == fGlobalMarks.size()) || (std::abs(best_dist) > std::abs(dist))) {
+         best_dist = dist;
+         best_trigertm = hitps - marker.globalps;
+         best_indx = indx;
+      }
+
+      if (test == 0)
+         res_indx = indx;
+      break;
+   }
+
+   // triggers far away left from the hit can be declared ready
+   if (can_close_event && IsStreamAnalysis()) {
+      GlobalTimePs_t disorder = SecondsToPs(MaximumDisorderTm());
+      while ((fGlobalTrigScanIndex < first) && (hitps - fGlobalMarks.item(fGlobalTrigScanIndex).rightps > disorder))
+         fGlobalTrigScanIndex++;
+   }
+
+   // account hit time in histogram
+   if (normal_hit && (best_indx<fGlobalMarks.size()))
+      FillH1(fTriggerTm, PsToSeconds(best_trigertm));
+
+   return normal_hit ? res_indx : fGlobalMarks.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+/// test hit time, checking all triggers one after another
+/// used when trigger boundaries are not ordered or when only few triggers are in work
+
+unsigned base::StreamProc::TestHitTimeLinear(GlobalTimePs_t hitps, bool normal_hit, bool can_close_event)
+{
+   GlobalTimePs_t dist(0), best_dist(0), best_trigertm(0), disorder(SecondsToPs(MaximumDisorderTm()));
 
    unsigned res_indx(fGlobalMarks.size()), best_indx(fGlobalMarks.size());
 
@@ -608,16 +861,16 @@ unsigned base::StreamProc::TestHitTime(const base::GlobalTime_t& hittime, bool n
 
        GlobalMarker& marker = fGlobalMarks.item(indx);
 
-       int test = marker.TestHitTime(hittime, &dist);
+       int test = marker.TestHitTimePs(hitps, &dist);
 
        // remember best distance for normal trigger,
        // message can go inside only for normal trigger
        // but we need to check position relative to trigger to be able perform flushing
 
        if (marker.normal()) {
-          if (fabs(best_dist) > fabs(dist)) {
+          if ((best_indx == fGlobalMarks.size()) || (std::abs(best_dist) > std::abs(dist))) {
              best_dist = dist;
-             best_trigertm = hittime - marker.globaltm;
+             best_trigertm = hitps - marker.globalps;
              best_indx = indx;
           }
 
@@ -635,7 +888,7 @@ unsigned base::StreamProc::TestHitTime(const base::GlobalTime_t& hittime, bool n
 
 //        printf("Find message on the right side from event %u distance %8.6f time %8.6f\n", indx, dist, triggertm);
 
-          if (can_close_event && IsStreamAnalysis() && (dist>MaximumDisorderTm())) {
+          if (can_close_event && IsStreamAnalysis() && (dist>disorder)) {
              if (indx==fGlobalTrigScanIndex) {
 //                if (fGlobalTrig[indx].normal())
 //                   printf("Declare trigger %12.9f ready\n", marker.globaltm);
@@ -644,7 +897,7 @@ unsigned base::StreamProc::TestHitTime(const base::GlobalTime_t& hittime, bool n
              } else {
                 printf("Check hit time error trig_indx:%u trig_tm:%12.9f left_indx:%u left_tm:%12.9f dist:%12.9f- check \n",
                       indx, marker.globaltm,
-                      fGlobalTrigScanIndex, fGlobalMarks.item(fGlobalTrigScanIndex).globaltm, dist);
+                      fGlobalTrigScanIndex, fGlobalMarks.item(fGlobalTrigScanIndex).globaltm, PsToSeconds(dist));
                 exit(17);
              }
           }
@@ -656,7 +909,7 @@ unsigned base::StreamProc::TestHitTime(const base::GlobalTime_t& hittime, bool n
 
    // account hit time in histogram
    if (normal_hit && (best_indx<fGlobalMarks.size()))
-      FillH1(fTriggerTm, best_trigertm);
+      FillH1(fTriggerTm, PsToSeconds(best_trigertm));
 
    //printf("Test message %12.9f again trigger %12.9f test = %d dist = %9.0f\n", globaltm*1e-9, fGlobalTrig[indx].globaltm*1e-9, test, dist);
 
@@ -720,7 +973,7 @@ bool base::StreamProc::ScanDataForNewTriggers()
             if (buffer_index_tm==0) return true;
          }
          // this is maximum time for the trigger which has chance to get all data from buffer with index fQueue.size()-2
-         double trigger_time_limit = fQueue.item(buffer_index_tm).rec().global_tm - GetC1Limit(fTriggerWindow, false) - MaximumDisorderTm();
+         double trigger_time_limit = fQueue.item(buffer_index_tm).rec().global_tm - GetTriggerWindowLimit(false) - MaximumDisorderTm();
 
          //      printf("Trigger time limit is %12.9f\n", trigger_time_limit*1e-9);
 
@@ -738,7 +991,7 @@ bool base::StreamProc::ScanDataForNewTriggers()
       // at the same time, we must define upper_buf_limit to exclude case
       // that trigger time will be generated after we scan and drop buffer
 
-      double buffer_timeboundary = fGlobalMarks.item(fGlobalTrigRightIndex-1).globaltm + GetC1Limit(fTriggerWindow, true) - MaximumDisorderTm();
+      double buffer_timeboundary = fGlobalMarks.item(fGlobalTrigRightIndex-1).globaltm + GetTriggerWindowLimit(true) - MaximumDisorderTm();
 
       while (upper_buf_limit < fQueueScanIndexTm - 1) {
          // only when next buffer start tm less than left boundary of last trigger,
@@ -786,8 +1039,16 @@ bool base::StreamProc::ScanDataForNewTriggers()
 
       Buffer& buf = fQueue.item(nbuf);
 
-      if (!buf.null())
+      if (buf.null()) continue;
+
+      if (CanSkipSecondScan(buf)) {
+         // hits cannot be assigned to any event, only flushing done by second scan is repeated
+         fNumSkippedScans++;
+         if (buf().flush_tm != 0)
+            TestHitTime(LocalToGlobalTime(buf().flush_tm), false, true);
+      } else {
          SecondBufferScan(buf);
+      }
    }
 
    // at the end all these buffer can be skipped from the queue
@@ -0,0 +1,78 @@
+#include "base/Timeslice.h"
+
+#include <algorithm>
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Remove all hits
+
+void base::Timeslice::Clear()
+{
+   fTime.clear();
+   fSource.clear();
+   fChannel.clear();
+   fFlags.clear();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Sort hits by time
+/// Stable sort is used - hits with same time remain in order they were added
+
+void base::Timeslice::Sort()
+{
+   unsigned sz = Size();
+
+   if (std::is_sorted(fTime.begin(), fTime.end())) return;
+
+   fOrder.resize(sz);
+   for (unsigned n = 0; n < sz; ++n)
+      fOrder[n] = n;
+
+   std::stable_sort(fOrder.begin(), fOrder.end(), [this](unsigned a, unsigned b) { return fTime[a] < fTime[b]; });
+
+   std::vector<GlobalTime_t> tm(sz);
+   std::vector<uint16_t> src(sz), ch(sz);
+   std::vector<uint8_t> fl(sz);
+
+   for (unsigned n = 0; n < sz; ++n) {
+      unsigned indx = fOrder[n];
+      tm[n] = fTime[indx];
+      src[n] = fSource[indx];
+      ch[n] = fChannel[indx];
+      fl[n] = fFlags[indx];
+   }
+
+   fTime.swap(tm);
+   fSource.swap(src);
+   fChannel.swap(ch);
+   fFlags.swap(fl);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Replace hits by hits of sorted timeslice, starting from specified time
+/// Used to keep hits which belong to overlap of next timeslice
+
+void base::Timeslice::CopyHits(const Timeslice &src, GlobalTime_t from)
+{
+   unsigned first = std::lower_bound(src.fTime.begin(), src.fTime.end(), from) - src.fTime.begin();
+
+   fTime.assign(src.fTime.begin() + first, src.fTime.end());
+   fSource.assign(src.fSource.begin() + first, src.fSource.end());
+   fChannel.assign(src.fChannel.begin() + first, src.fChannel.end());
+   fFlags.assign(src.fFlags.begin() + first, src.fFlags.end());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Insert hits of sorted timeslice, which are in overlap range, before existing hits
+
+void base::Timeslice::InsertFront(const Timeslice &src)
+{
+   unsigned first = std::lower_bound(src.fTime.begin(), src.fTime.end(), GetFirstTime()) - src.fTime.begin(),
+            last = std::lower_bound(src.fTime.begin(), src.fTime.end(), fStart) - src.fTime.begin();
+
+   if (first >= last) return;
+
+   fTime.insert(fTime.begin(), src.fTime.begin() + first, src.fTime.begin() + last);
+   fSource.insert(fSource.begin(), src.fSource.begin() + first, src.fSource.begin() + last);
+   fChannel.insert(fChannel.begin(), src.fChannel.begin() + first, src.fChannel.begin() + last);
+   fFlags.insert(fFlags.begin(), src.fFlags.begin() + first, src.fFlags.begin() + last);
+}
@@ -0,0 +1,186 @@
+// async_store_check - verifies asynchronous TTree store of TRootProcMgr
+//
+// Same generated data stored with synchronous and asynchronous store,
+// afterwards content of all branches compared entry by entry.
+// Returns non-zero code if trees differ.
+//
+// Usage: async_store_check [--events N] [--tmpdir dir]
+
+#include "root/TRootProcMgr.h"
+#include "base/Event.h"
+#include "hadaq/DataGenerator.h"
+#include "hadaq/HldProcessor.h"
+#include "hadaq/TrbProcessor.h"
+#include "hadaq/TdcProcessor.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TBranch.h"
+#include "TObjArray.h"
+#include "TClass.h"
+#include "TBufferFile.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Process generated events and store them in ROOT file
+
+bool WriteTree(const std::string &fname, unsigned numevents, unsigned storekind, unsigned asyncqueue)
+{
+   hadaq::DataGenerator gen;
+   gen.SetLayout(2, 2, 33);
+   gen.SetHits(1.);
+   gen.SetTrigger(10000., 0x1, 0);
+   gen.SetSeed(4321);
+
+   TRootProcMgr mgr;
+   mgr.SetTriggeredAnalysis(true);
+   mgr.SetHistFilling(0);
+   mgr.SetAsyncStore(asyncqueue);
+   if (!mgr.CreateStore(fname.c_str())) {
+      fprintf(stderr, "Fail to create %s\n", fname.c_str());
+      return false;
+   }
+
+   hadaq::TdcProcessor::SetDefaults(600);
+   auto hld = new hadaq::HldProcessor();
+   for (unsigned ntrb = 0; ntrb < 2; ++ntrb) {
+      auto trb = new hadaq::TrbProcessor(0x8000 + ntrb, hld);
+      for (unsigned ntdc = 0; ntdc < 2; ++ntdc) {
+         auto tdc = new hadaq::TdcProcessor(trb, 0x100 + ntrb * 2 + ntdc, 33, 3);
+         tdc->SetLinearCalibration(0, 20, 480);
+      }
+   }
+   mgr.SetStoreKind(storekind);
+
+   mgr.UserPreLoop();
+
+   base::Event *evt = nullptr;
+
+   for (unsigned n = 0; n < numevents; ++n) {
+      base::Buffer buf;
+      gen.FillBuffer(buf, 1, 1);
+      hld->AddNextBuffer(buf);
+      if (mgr.AnalyzeNewData(evt) && evt)
+         mgr.ProcessEvent(evt);
+   }
+
+   mgr.UserPostLoop();
+   mgr.CloseStore();
+
+   delete evt;
+
+   return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Compare all branches of two trees, objects serialized again and compared byte by byte
+
+bool CompareTrees(const std::string &fname1, const std::string &fname2)
+{
+   std::unique_ptr<TFile> f1(TFile::Open(fname1.c_str())), f2(TFile::Open(fname2.c_str()));
+   if (!f1 || !f2) return false;
+
+   auto t1 = f1->Get<TTree>("T"), t2 = f2->Get<TTree>("T");
+   if (!t1 || !t2) {
+      fprintf(stderr, "Tree not found\n");
+      return false;
+   }
+
+   if ((t1->GetEntries() == 0) || (t1->GetEntries() != t2->GetEntries())) {
+      fprintf(stderr, "Different number of entries %lld %lld\n", t1->GetEntries(), t2->GetEntries());
+      return false;
+   }
+
+   auto branches = t1->GetListOfBranches();
+   if (branches->GetEntries() != t2->GetListOfBranches()->GetEntries()) {
+      fprintf(stderr, "Different number of branches\n");
+      return false;
+   }
+
+   bool res = true;
+
+   for (int n = 0; (n < branches->GetEntries()) && res; ++n) {
+      auto br1 = (TBranch *) branches->At(n);
+      auto br2 = t2->GetBranch(br1->GetName());
+      TClass *cl = TClass::GetClass(br1->GetClassName());
+      if (!br2 || !cl) {
+         fprintf(stderr, "Branch %s cannot be compared\n", br1->GetName());
+         return false;
+      }
+
+      void *obj1 = cl->New(), *obj2 = cl->New();
+      br1->SetAddress(&obj1);
+      br2->SetAddress(&obj2);
+
+      TBufferFile b1(TBuffer::kWrite), b2(TBuffer::kWrite);
+
+      for (Long64_t entry = 0; entry < t1->GetEntries(); ++entry) {
+         br1->GetEntry(entry);
+         br2->GetEntry(entry);
+         b1.Reset();
+         b2.Reset();
+         cl->Streamer(obj1, b1);
+         cl->Streamer(obj2, b2);
+         if ((b1.Length() != b2.Length()) || memcmp(b1.Buffer(), b2.Buffer(), b1.Length())) {
+            fprintf(stderr, "Branch %s differs in entry %lld\n", br1->GetName(), entry);
+            res = false;
+            break;
+         }
+      }
+
+      br1->ResetAddress();
+      br2->ResetAddress();
+      cl->Destructor(obj1);
+      cl->Destructor(obj2);
+   }
+
+   return res;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+   unsigned numevents = 2000;
+   std::string tmpdir = ".";
+
+   for (int n = 1; n < argc; ++n) {
+      if (!strcmp(argv[n], "--events") && (n < argc - 1))
+         numevents = std::strtoul(argv[++n], nullptr, 10);
+      else if (!strcmp(argv[n], "--tmpdir") && (n < argc - 1))
+         tmpdir = argv[++n];
+      else {
+         fprintf(stderr, "Usage: async_store_check [--events N] [--tmpdir dir]\n");
+         return 1;
+      }
+   }
+
+   if (numevents == 0) numevents = 1;
+
+   int res = 0;
+
+   for (unsigned kind = 1; kind <= 4; ++kind) {
+      std::string fsync = tmpdir + "/async_check_sync.root",
+                  fasync = tmpdir + "/async_check_async.root";
+
+      if (!WriteTree(fsync, numevents, kind, 0) || !WriteTree(fasync, numevents, kind, 16) || !CompareTrees(fsync, fasync)) {
+         fprintf(stderr, "Store kind %u: asynchronous store differs from synchronous\n", kind);
+         res = 2;
+      } else {
+         fprintf(stderr, "Store kind %u: trees are identical\n", kind);
+      }
+
+      std::remove(fsync.c_str());
+      std::remove(fasync.c_str());
+   }
+
+   return res;
+}
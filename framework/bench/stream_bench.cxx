@@ -0,0 +1,772 @@
+// stream_bench - throughput benchmark of main processing paths
+//
+// All data produced by hadaq::DataGenerator, therefore results of different
+// versions can be directly compared. Results printed as JSON to stdout
+// or stored in file specified with --json option. Output of processors
+// redirected to stderr, therefore stdout contains only JSON.
+// Events and hits are counted by processors, returns non-zero code
+// if any benchmark did not process data.
+// With --check option only equivalence of specialised and generic
+// TDC scan kernels is verified, no benchmarks are performed.
+//
+// Usage: stream_bench [--quick] [--check] [--events N] [--json file] [--tmpdir dir]
+
+#include "base/ProcMgr.h"
+#include "base/Event.h"
+#include "hadaq/DataGenerator.h"
+#include "hadaq/HldProcessor.h"
+#include "hadaq/TrbProcessor.h"
+#include "hadaq/TdcProcessor.h"
+#include "hadaq/TdcSubEvent.h"
+#include "hadaq/TrbIterator.h"
+#include "hadaq/HldFile.h"
+#include "dogma/DogmaFile.h"
+#include "dogma/defines.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+const unsigned kNumTrbs = 2;         ///< number of TRBs in HLD event
+const unsigned kNumTdcs = 4;         ///< number of TDCs per TRB
+const unsigned kNumChannels = 33;    ///< number of channels per TDC
+const unsigned kTrbId = 0x8000;      ///< id of first TRB
+const unsigned kTdcId = 0x0100;      ///< id of first TDC
+
+/** result of single benchmark case */
+struct BenchResult {
+   std::string name;          ///< case name
+   unsigned long events{0};   ///< number of processed events
+   unsigned long hits{0};     ///< number of processed hits
+   double seconds{0.};        ///< processing time
+   bool withhits{true};       ///< if hits should be processed
+};
+
+std::vector<BenchResult> gResults;
+
+/** simple stop watch */
+class Timer {
+   std::chrono::steady_clock::time_point fStart;
+public:
+   Timer() : fStart(std::chrono::steady_clock::now()) {}
+   double Seconds() const { return std::chrono::duration<double>(std::chrono::steady_clock::now() - fStart).count(); }
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Store result of benchmark case
+/// withhits = false when case does not process hits, like file reading
+
+void AddResult(const char *name, unsigned long events, unsigned long hits, double seconds, bool withhits = true)
+{
+   BenchResult res;
+   res.name = name;
+   res.events = events;
+   res.hits = hits;
+   res.seconds = seconds;
+   res.withhits = withhits;
+   gResults.emplace_back(res);
+
+   fprintf(stderr, "%-20s %8lu events %10lu hits %8.3f s %12.0f ev/s %14.0f hits/s\n", name, events, hits, seconds,
+           seconds > 0 ? events / seconds : 0., seconds > 0 ? hits / seconds : 0.);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Configure generator with layout used in all benchmarks
+
+void ConfigureGenerator(hadaq::DataGenerator &gen, bool dogma = false, unsigned calibrperiod = 0)
+{
+   gen.SetDogma(dogma);
+   gen.SetLayout(kNumTrbs, kNumTdcs, kNumChannels);
+   gen.SetIds(kTrbId, kTdcId);
+   gen.SetHits(1.);
+   gen.SetTrigger(10000., 0x1, calibrperiod);
+   gen.SetSeed(1234);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Produce buffers with single event, as required by triggered analysis
+
+void MakeBuffers(hadaq::DataGenerator &gen, unsigned numevents, std::vector<base::Buffer> &bufs)
+{
+   bufs.resize(numevents);
+   for (auto &buf : bufs)
+      gen.FillBuffer(buf, 1, 1); // buffer allocated with exact size of event
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Sum of hits, processed by all TDCs of HLD processor
+
+unsigned long CountHits(hadaq::HldProcessor *hld)
+{
+   unsigned long hits = 0;
+   for (unsigned n = 0; n < hld->NumberOfTDC(); ++n)
+      hits += hld->GetTDC(n)->GetNumHits();
+   return hits;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Create HLD processor with all TRBs and TDCs
+/// With with_tdcs = false only TRB processors are created, TDC data is skipped by them
+
+hadaq::HldProcessor *CreateHld(bool linear_calibr = false, bool with_tdcs = true)
+{
+   hadaq::TdcProcessor::SetDefaults(600);
+
+   auto hld = new hadaq::HldProcessor();
+
+   for (unsigned ntrb = 0; ntrb < kNumTrbs; ++ntrb) {
+      auto trb = new hadaq::TrbProcessor(kTrbId + ntrb, hld);
+      for (unsigned ntdc = 0; with_tdcs && (ntdc < kNumTdcs); ++ntdc) {
+         auto tdc = new hadaq::TdcProcessor(trb, kTdcId + ntrb * kNumTdcs + ntdc, kNumChannels, 3);
+         if (linear_calibr)
+            tdc->SetLinearCalibration(0, 20, 480);
+      }
+   }
+
+   return hld;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Process all buffers with HLD processor, returns processing time
+
+double RunHld(base::ProcMgr &mgr, hadaq::HldProcessor *hld, std::vector<base::Buffer> &bufs)
+{
+   base::Event *evt = nullptr;
+
+   mgr.UserPreLoop();
+
+   Timer tm;
+
+   for (auto &buf : bufs) {
+      hld->AddNextBuffer(buf);
+      if (mgr.AnalyzeNewData(evt) && evt)
+         mgr.ProcessEvent(evt);
+   }
+
+   double res = tm.Seconds();
+
+   mgr.UserPostLoop();
+
+   delete evt;
+
+   return res;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Split of HLD events into TRB subevents, TDC processors are not created
+/// Measures HLD and TRB processing alone, therefore hits are not counted
+
+void BenchHldScan(unsigned numevents)
+{
+   hadaq::DataGenerator gen;
+   ConfigureGenerator(gen);
+   std::vector<base::Buffer> bufs;
+   MakeBuffers(gen, numevents, bufs);
+
+   base::ProcMgr mgr;
+   mgr.SetRawAnalysis(true);
+   mgr.SetHistFilling(0);
+   auto hld = CreateHld(false, false);
+
+   double tm = RunHld(mgr, hld, bufs);
+
+   AddResult("hld_scan", hld->GetNumEvents(), 0, tm, false);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// First scan of TDC data with different histogram filling levels
+
+void BenchTdcScan(unsigned numevents, int hlevel)
+{
+   hadaq::DataGenerator gen;
+   ConfigureGenerator(gen);
+   std::vector<base::Buffer> bufs;
+   MakeBuffers(gen, numevents, bufs);
+
+   base::ProcMgr mgr;
+   mgr.SetRawAnalysis(true);
+   mgr.SetHistFilling(hlevel);
+   auto hld = CreateHld();
+
+   double tm = RunHld(mgr, hld, bufs);
+
+   std::string name = "tdc_scan_hl" + std::to_string(hlevel);
+   AddResult(name.c_str(), hld->GetNumEvents(), CountHits(hld), tm);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Triggered analysis with different store kinds
+
+void BenchStoreKind(unsigned numevents, unsigned kind)
+{
+   hadaq::DataGenerator gen;
+   ConfigureGenerator(gen);
+   std::vector<base::Buffer> bufs;
+   MakeBuffers(gen, numevents, bufs);
+
+   base::ProcMgr mgr;
+   mgr.SetTriggeredAnalysis(true);
+   mgr.SetHistFilling(0);
+   mgr.SetStoreKind(kind);
+   auto hld = CreateHld(true);
+
+   double tm = RunHld(mgr, hld, bufs);
+
+   std::string name = "store_kind" + std::to_string(kind);
+   AddResult(name.c_str(), hld->GetNumEvents(), CountHits(hld), tm);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Transformation of events with calibrated fine counters
+
+void BenchTransform(unsigned numevents)
+{
+   hadaq::DataGenerator gen;
+   ConfigureGenerator(gen);
+   std::vector<base::Buffer> bufs;
+   MakeBuffers(gen, numevents, bufs);
+
+   base::ProcMgr mgr;
+   mgr.SetHistFilling(0);
+   auto hld = CreateHld(true);
+   mgr.UserPreLoop();
+
+   std::vector<char> tgt;
+   unsigned long nevents = 0;
+
+   Timer tm;
+
+   for (auto &buf : bufs) {
+      unsigned len = buf.datalen();
+      if (tgt.size() < len) tgt.resize(len*2);
+      if (hld->TransformEvent(buf.ptr(), len, tgt.data(), tgt.size()) == 0) {
+         fprintf(stderr, "Fail to transform event\n");
+         break;
+      }
+      nevents++;
+   }
+
+   AddResult("transform", nevents, CountHits(hld), tm.Seconds());
+
+   mgr.UserPostLoop();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Accumulate calibration statistic with 0xD triggers and produce calibrations
+
+void BenchCalibration(unsigned numevents)
+{
+   hadaq::DataGenerator gen;
+   ConfigureGenerator(gen, false, 1);
+   std::vector<base::Buffer> bufs;
+   MakeBuffers(gen, numevents, bufs);
+
+   base::ProcMgr mgr;
+   mgr.SetRawAnalysis(true);
+   mgr.SetHistFilling(0);
+   auto hld = CreateHld();
+   hld->ConfigureCalibration("", 0, 1 << 0xD);
+
+   double filltm = RunHld(mgr, hld, bufs);
+
+   AddResult("calibr_fill", hld->GetNumEvents(), CountHits(hld), filltm);
+
+   Timer tm;
+
+   unsigned numtdc = 0;
+   for (unsigned ntrb = 0; ntrb < kNumTrbs; ++ntrb) {
+      auto trb = hld->FindTRB(kTrbId + ntrb);
+      for (unsigned ntdc = 0; trb && (ntdc < kNumTdcs); ++ntdc) {
+         auto tdc = trb->GetTDC(kTdcId + ntrb * kNumTdcs + ntdc, true);
+         if (tdc) {
+            tdc->ProduceCalibration(true);
+            numtdc++;
+         }
+      }
+   }
+
+   // calibration does not depend on number of events, count produced TDC calibrations instead
+   AddResult("calibr_produce", numtdc, 0, tm.Seconds(), false);
+}
+
+/** FNV-like hash over 64-bit words, used to compare results of different scan kernels */
+class Digest {
+   uint64_t fHash{0xcbf29ce484222325ULL};
+   void Mix(uint64_t w) { fHash = (fHash ^ w) * 0x100000001b3ULL; fHash ^= fHash >> 32; }
+public:
+   void Add(const void *ptr, unsigned len)
+   {
+      auto p = (const char *) ptr;
+      uint64_t w;
+      for (; len >= 8; p += 8, len -= 8) {
+         memcpy(&w, p, 8);
+         Mix(w);
+      }
+      if (len > 0) {
+         w = 0;
+         memcpy(&w, p, len);
+         Mix(w);
+      }
+   }
+   template<class T> void AddValue(T v) { Add(&v, sizeof(v)); }
+   uint64_t Value() const { return fHash; }
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Add channels, edges and stamps of stored TDC messages to the digest
+
+template<class SubEvent>
+void AddStored(Digest &dig, base::SubEvent *sub)
+{
+   auto subev = dynamic_cast<SubEvent *>(sub);
+   if (!subev) return;
+   for (auto &msg : subev->view()) {
+      dig.AddValue(msg.getCh());
+      dig.AddValue(msg.getEdge());
+      dig.AddValue(msg.getStamp());
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Triggered analysis of buffers, returns digest of stored events, statistic and histograms
+/// kernels = false forces generic scan code of TDC processor
+
+uint64_t ScanDigest(std::vector<base::Buffer> &bufs, unsigned kind, int hlevel, bool epochreset, bool kernels)
+{
+   hadaq::TdcProcessor::SetScanKernels(kernels);
+
+   base::ProcMgr mgr;
+   mgr.SetTriggeredAnalysis(true);
+   mgr.SetHistFilling(hlevel);
+   mgr.SetStoreKind(kind);
+
+   hadaq::TdcProcessor::SetDefaults(600);
+   auto hld = new hadaq::HldProcessor();
+   for (unsigned ntrb = 0; ntrb < kNumTrbs; ++ntrb) {
+      auto trb = new hadaq::TrbProcessor(kTrbId + ntrb, hld);
+      trb->SetCompensateEpochReset(epochreset);
+      for (unsigned ntdc = 0; ntdc < kNumTdcs; ++ntdc) {
+         auto tdc = new hadaq::TdcProcessor(trb, kTdcId + ntrb * kNumTdcs + ntdc, kNumChannels, 3);
+         tdc->SetLinearCalibration(0, 20, 480);
+      }
+   }
+
+   Digest dig;
+   base::Event *evt = nullptr;
+
+   mgr.UserPreLoop();
+
+   for (auto &buf : bufs) {
+      hld->AddNextBuffer(buf);
+      if (mgr.AnalyzeNewData(evt) && evt) {
+         mgr.ProcessEvent(evt);
+         for (auto &entry : evt->GetEventsMap()) {
+            dig.Add(entry.first.data(), entry.first.length());
+            switch (kind) {
+               case 1: {
+                  auto subev = dynamic_cast<hadaq::TdcSubEvent *>(entry.second);
+                  if (subev)
+                     for (auto &msg : subev->view()) {
+                        dig.AddValue(msg.msg().getData());
+                        dig.AddValue(msg.GetGlobalTime());
+                     }
+                  break;
+               }
+               case 2: AddStored<hadaq::TdcSubEventFloat>(dig, entry.second); break;
+               case 3: AddStored<hadaq::TdcSubEventDouble>(dig, entry.second); break;
+               case 4: AddStored<hadaq::TdcSubEventInt>(dig, entry.second); break;
+            }
+         }
+      }
+   }
+
+   mgr.UserPostLoop();
+
+   for (unsigned n = 0; n < hld->NumberOfTDC(); ++n) {
+      auto tdc = hld->GetTDC(n);
+      dig.AddValue(tdc->GetNumHits());
+   }
+
+   std::vector<base::HistDelta> deltas;
+   mgr.GetHistDeltas(0, deltas);
+   for (auto &delta : deltas)
+      dig.Add(delta.values.data(), delta.values.size() * sizeof(double));
+
+   delete evt;
+
+   hadaq::TdcProcessor::SetScanKernels(true);
+
+   return dig.Value();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Compare results of specialised and generic TDC scan kernels
+/// All store kinds with and without histograms and epoch reset compensation are tested
+
+bool CheckScanKernels(unsigned numevents)
+{
+   hadaq::DataGenerator gen;
+   ConfigureGenerator(gen, false, 10);
+   std::vector<base::Buffer> bufs;
+   MakeBuffers(gen, numevents, bufs);
+
+   bool res = true;
+
+   for (unsigned kind = 0; kind <= 4; ++kind)
+      for (int hlevel : { 0, 4 })
+         for (bool epochreset : { false, true }) {
+            uint64_t dig1 = ScanDigest(bufs, kind, hlevel, epochreset, true),
+                     dig2 = ScanDigest(bufs, kind, hlevel, epochreset, false);
+            bool same = dig1 == dig2;
+            fprintf(stderr, "scan_check store %u hlevel %d epochreset %d: %s\n", kind, hlevel, epochreset ? 1 : 0, same ? "identical" : "DIFFERENT");
+            if (!same) res = false;
+         }
+
+   return res;
+}
+
+/** Manager with simple window conditions, base::ProcMgr does not implement them.
+  * Required for trigger window of stream analysis */
+class StreamMgr : public base::ProcMgr {
+   struct Window { double left, right; };
+   std::vector<Window *> fWindows;
+public:
+   ~StreamMgr() override
+   {
+      DeleteAllProcessors();
+      for (auto w : fWindows)
+         delete w;
+   }
+
+   base::C1handle MakeC1(const char *, double left, double right, base::H1handle) override
+   {
+      fWindows.emplace_back(new Window{left, right});
+      return (base::C1handle) fWindows.back();
+   }
+
+   void ChangeC1(base::C1handle c1, double left, double right) override
+   {
+      if (c1) *((Window *) c1) = Window{left, right};
+   }
+
+   int TestC1(base::C1handle c1, double value, double *dist = nullptr) override
+   {
+      auto w = (Window *) c1;
+      if (dist) *dist = 0.;
+      if (!w) return 0;
+      if (value < w->left) { if (dist) *dist = value - w->left; return -1; }
+      if (value > w->right) { if (dist) *dist = value - w->right; return 1; }
+      return 0;
+   }
+
+   double GetC1Limit(base::C1handle c1, bool isleft = true) override
+   {
+      auto w = (Window *) c1;
+      return w ? (isleft ? w->left : w->right) : 0.;
+   }
+};
+
+/** TDC which uses channel 0 hits as triggers in stream mode */
+class StreamTdc : public hadaq::TdcProcessor {
+public:
+   StreamTdc(unsigned tdcid) : hadaq::TdcProcessor(nullptr, tdcid, kNumChannels, 3)
+   {
+      fUseNativeTrigger = true;
+      SetSynchronisationKind(sync_None);
+   }
+
+   bool doTriggerSelection() const override { return true; }
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Stream analysis of single TDC, triggers from channel 0 matched with hits
+
+void BenchStreamMatching(unsigned numevents)
+{
+   hadaq::DataGenerator gen;
+   ConfigureGenerator(gen);
+   gen.SetLayout(1, 1, kNumChannels);
+
+   // extract data of single TDC from HLD events, one buffer per event as delivered by TDC readout
+   std::vector<base::Buffer> bufs;
+   std::vector<uint32_t> words;
+
+   for (unsigned cnt = 0; cnt < numevents; ++cnt) {
+      unsigned size = 0;
+      auto evnt = gen.NextEvent(size);
+      hadaq::TrbIterator iter((void *) evnt, size);
+      iter.nextEvent();
+      words.clear();
+      while (auto sub = iter.nextSubevent()) {
+         unsigned ix = 0, trbSubEvSize = sub->GetNrOfDataWords();
+         while (ix < trbSubEvSize) {
+            uint32_t hdr = sub->Data(ix++);
+            unsigned datalen = hdr >> 16;
+            for (unsigned n = 0; (n < datalen) && (ix < trbSubEvSize); ++n)
+               words.emplace_back(sub->Data(ix++));
+         }
+      }
+
+      if (words.empty()) continue;
+
+      base::Buffer buf;
+      buf.makecopyof(words.data(), words.size() * sizeof(uint32_t));
+      buf().kind = 0x1; // for TDC data kind is trigger type
+      buf().boardid = kTdcId;
+      buf().format = 1;
+      bufs.emplace_back(buf);
+   }
+
+   StreamMgr mgr;
+   mgr.SetTriggeredAnalysis(false);
+   mgr.SetHistFilling(0);
+   auto tdc = new StreamTdc(kTdcId);
+   tdc->SetStoreKind(3);
+   tdc->SetLinearCalibration(0, 20, 480);
+   tdc->CreateTriggerHist(16, 3000, -2e-6, 2e-6); // without histograms only creates trigger window
+   tdc->SetTriggerWindow(-1e-6, 0.1e-6);
+
+   mgr.UserPreLoop();
+
+   base::Event *evt = nullptr;
+   unsigned long nevents = 0, nmatched = 0;
+
+   Timer tm;
+
+   for (auto &buf : bufs) {
+      tdc->AddNextBuffer(buf);
+      while (mgr.AnalyzeNewData(evt)) {
+         nevents++;
+         auto sub = evt->GetSubEvent(tdc->GetName());
+         if (sub) nmatched += sub->Multiplicity();
+         mgr.ProcessEvent(evt);
+      }
+   }
+
+   double tmsec = tm.Seconds();
+
+   // events without matched hits indicate problem with trigger window
+   if (nmatched == 0)
+      nevents = 0;
+
+   AddResult("stream_matching", nevents, tdc->GetNumHits(), tmsec);
+
+   mgr.UserPostLoop();
+
+   delete evt;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Scan of DOGMA events with TDC5 data
+
+void BenchDogmaScan(unsigned numevents)
+{
+   hadaq::DataGenerator gen;
+   ConfigureGenerator(gen, true);
+   std::vector<base::Buffer> bufs;
+   MakeBuffers(gen, numevents, bufs);
+
+   base::ProcMgr mgr;
+   mgr.SetTriggeredAnalysis(true);
+   mgr.SetHistFilling(0);
+   hadaq::TdcProcessor::SetDefaults(410);
+   auto trb = new hadaq::TrbProcessor(0, nullptr, 0, true);
+   for (unsigned n = 0; n < kNumTrbs * kNumTdcs; ++n)
+      trb->CreateTDC5(kTdcId + n);
+
+   mgr.UserPreLoop();
+
+   base::Event *evt = nullptr;
+   unsigned long nevents = 0;
+
+   Timer tm;
+
+   for (auto &buf : bufs) {
+      trb->AddNextBuffer(buf);
+      if (mgr.AnalyzeNewData(evt) && evt) {
+         nevents++;
+         mgr.ProcessEvent(evt);
+      }
+   }
+
+   double tmsec = tm.Seconds();
+
+   unsigned long hits = 0;
+   for (unsigned n = 0; n < trb->NumberOfTDC(); ++n)
+      hits += trb->GetTDCWithIndex(n)->GetNumHits();
+
+   AddResult("dogma_scan", nevents, hits, tmsec);
+
+   mgr.UserPostLoop();
+
+   delete evt;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Reading of HLD or DOGMA files, including iteration over events
+
+void BenchFileRead(unsigned numevents, bool dogma, const std::string &tmpdir)
+{
+   hadaq::DataGenerator gen;
+   ConfigureGenerator(gen, dogma);
+
+   std::string fname = tmpdir + (dogma ? "/stream_bench.dld" : "/stream_bench.hld");
+   if (!gen.WriteFile(fname.c_str(), numevents)) {
+      fprintf(stderr, "Fail to create %s, skip file reading\n", fname.c_str());
+      return;
+   }
+
+   std::vector<char> buf(0x100000);
+   unsigned long nevents = 0;
+   bool isopen;
+
+   hadaq::HldFile hldfile;
+   dogma::DogmaFile dogmafile;
+
+   Timer tm;
+
+   isopen = dogma ? dogmafile.OpenRead(fname.c_str()) : hldfile.OpenRead(fname.c_str());
+
+   while (isopen) {
+      uint32_t bufsize = buf.size();
+      if (dogma) {
+         if (!dogmafile.ReadBuffer(buf.data(), &bufsize)) break;
+         char *ptr = buf.data();
+         while (bufsize >= sizeof(dogma::DogmaEvent)) {
+            auto evnt = (dogma::DogmaEvent *) ptr;
+            unsigned len = evnt->GetEventLen();
+            if ((len == 0) || (len > bufsize)) break;
+            nevents++;
+            ptr += len;
+            bufsize -= len;
+         }
+      } else {
+         if (!hldfile.ReadBuffer(buf.data(), &bufsize)) break;
+         hadaq::TrbIterator iter(buf.data(), bufsize);
+         while (iter.nextEvent())
+            nevents++;
+      }
+   }
+
+   double tmsec = tm.Seconds();
+
+   if (dogma)
+      dogmafile.Close();
+   else
+      hldfile.Close();
+
+   std::remove(fname.c_str());
+
+   if (nevents != numevents)
+      fprintf(stderr, "Read %lu events from %s, expected %u\n", nevents, fname.c_str(), numevents);
+
+   // hits are not decoded when reading file
+   AddResult(dogma ? "dogma_file_read" : "hld_file_read", nevents, 0, tmsec, false);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Print results as JSON
+
+void PrintJson(FILE *f, unsigned numevents)
+{
+   fprintf(f, "{\n");
+   fprintf(f, "  \"benchmark\": \"stream_bench\",\n");
+   fprintf(f, "  \"events\": %u,\n", numevents);
+   fprintf(f, "  \"layout\": { \"trbs\": %u, \"tdcs\": %u, \"channels\": %u },\n", kNumTrbs, kNumTdcs, kNumChannels);
+   fprintf(f, "  \"results\": [\n");
+   for (unsigned n = 0; n < gResults.size(); ++n) {
+      auto &res = gResults[n];
+      fprintf(f, "    { \"name\": \"%s\", \"events\": %lu, \"hits\": %lu, \"seconds\": %.6f, \"events_per_s\": %.1f, \"hits_per_s\": %.1f }%s\n",
+              res.name.c_str(), res.events, res.hits, res.seconds,
+              res.seconds > 0 ? res.events / res.seconds : 0.,
+              res.seconds > 0 ? res.hits / res.seconds : 0.,
+              n < gResults.size() - 1 ? "," : "");
+   }
+   fprintf(f, "  ]\n");
+   fprintf(f, "}\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+   unsigned numevents = 20000;
+   const char *jsonname = nullptr;
+   std::string tmpdir = ".";
+   bool check = false;
+
+   for (int n = 1; n < argc; ++n) {
+      if (!strcmp(argv[n], "--quick"))
+         numevents = 2000;
+      else if (!strcmp(argv[n], "--check"))
+         check = true;
+      else if (!strcmp(argv[n], "--events") && (n < argc - 1))
+         numevents = std::strtoul(argv[++n], nullptr, 10);
+      else if (!strcmp(argv[n], "--json") && (n < argc - 1))
+         jsonname = argv[++n];
+      else if (!strcmp(argv[n], "--tmpdir") && (n < argc - 1))
+         tmpdir = argv[++n];
+      else {
+         printf("Usage: stream_bench [--quick] [--check] [--events N] [--json file] [--tmpdir dir]\n");
+         return 1;
+      }
+   }
+
+   if (numevents == 0) numevents = 1;
+
+   // processors print diagnostic to stdout, redirect it to stderr to keep JSON output clean
+   fflush(stdout);
+   int jsonfd = dup(STDOUT_FILENO);
+   dup2(STDERR_FILENO, STDOUT_FILENO);
+
+   if (check)
+      return CheckScanKernels(numevents) ? 0 : 3;
+
+   BenchHldScan(numevents);
+   for (int lvl = 0; lvl <= 4; ++lvl)
+      BenchTdcScan(numevents, lvl);
+   for (unsigned kind = 1; kind <= 3; ++kind)
+      BenchStoreKind(numevents, kind);
+   BenchTransform(numevents);
+   BenchCalibration(numevents);
+   BenchStreamMatching(numevents);
+   BenchDogmaScan(numevents);
+   BenchFileRead(numevents, false, tmpdir);
+   BenchFileRead(numevents, true, tmpdir);
+
+   fflush(stdout);
+   dup2(jsonfd, STDOUT_FILENO);
+   close(jsonfd);
+
+   FILE *f = jsonname ? fopen(jsonname, "w") : stdout;
+   if (!f) {
+      fprintf(stderr, "Fail to create %s\n", jsonname);
+      return 1;
+   }
+
+   PrintJson(f, numevents);
+
+   if (f != stdout)
+      fclose(f);
+
+   for (auto &res : gResults) {
+      if (res.events == 0) {
+         fprintf(stderr, "Benchmark %s did not process any event\n", res.name.c_str());
+         return 2;
+      }
+      if (res.withhits && (res.hits == 0)) {
+         fprintf(stderr, "Benchmark %s did not process any hit\n", res.name.c_str());
+         return 2;
+      }
+   }
+
+   return 0;
+}
@@ -0,0 +1,430 @@
+#include "hadaq/DataGenerator.h"
+
+#include "hadaq/definess.h"
+#include "hadaq/HldFile.h"
+#include "hadaq/TdcMessage.h"
+#include "hadaq/TdcProcessor.h"
+#include "dogma/defines.h"
+#include "dogma/DogmaFile.h"
+#include "dogma/tdc5.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// constructor
+
+hadaq::DataGenerator::DataGenerator()
+{
+   Reset();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Restart sequence of events, counters are cleared
+
+void hadaq::DataGenerator::Reset()
+{
+   fRandom = fSeed ^ 0x9E3779B97F4A7C15ULL;
+   if (!fRandom) fRandom = 1;
+
+   fSeqNr = 0;
+   fTrigTime = 0;
+   fEvent.clear();
+   fEventSize = 0;
+   fPending = false;
+
+   fNumEvents = 0;
+   fNumHits = 0;
+   fNumErrors = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Random number with Poisson distribution and fMeanHits mean value
+
+unsigned hadaq::DataGenerator::RandomPoisson()
+{
+   unsigned k = 0;
+   double p = RandomUniform();
+   while (p > fExpMean) {
+      k++;
+      p *= RandomUniform();
+   }
+   return k;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Produce hits of single TDC, sorted by channel and time
+/// Calibration trigger has exactly one hit in every channel with ToT of internal pulser
+
+void hadaq::DataGenerator::MakeHits(bool calibr)
+{
+   fHits.clear();
+
+   // reference hit in channel 0 at trigger time
+   fHits.push_back({fTrigTime, 0, RandomFine(), true});
+
+   uint64_t window = ToCoarse(fWindow), tot = ToCoarse(calibr ? (double) hadaq::ToTvalue : fTot);
+   if (window < 1) window = 1;
+
+   for (unsigned ch = 1; ch < fNumChannels; ++ch) {
+      unsigned nhits = calibr ? 1 : RandomPoisson();
+      for (unsigned n = 0; n < nhits; ++n) {
+         uint64_t tm = fTrigTime - tot - 1 - Random() % window;
+         fHits.push_back({tm, ch, RandomFine(), true});
+         if (tot > 0)
+            fHits.push_back({tm + tot, ch, RandomFine(), false});
+      }
+   }
+
+   std::sort(fHits.begin() + 1, fHits.end(), [](const HitRec &a, const HitRec &b) {
+      return (a.ch < b.ch) || ((a.ch == b.ch) && (a.tm < b.tm));
+   });
+
+   fNumHits += fHits.size();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Inject error of random kind into hits of current TDC
+/// Returns kind of injected error, err_Header should be applied when TDC data are produced
+
+unsigned hadaq::DataGenerator::InjectError()
+{
+   unsigned mask = fErrorMask & (fDogma ? (err_All & ~err_Header) : err_All);
+   if (!mask) return 0;
+
+   unsigned kind = 0;
+   while (!kind)
+      kind = mask & (1 << (Random() % 4));
+
+   auto &hit = fHits[Random() % fHits.size()];
+
+   switch (kind) {
+      case err_MissingHit:
+         // TDC5 has 9-bit fine counter, maximal value is used
+         hit.fine = fDogma ? 0x1ff : 0x3ff;
+         break;
+      case err_Channel:
+         hit.ch = fNumChannels;
+         std::stable_sort(fHits.begin(), fHits.end(), [](const HitRec &a, const HitRec &b) { return a.ch < b.ch; });
+         break;
+      case err_Fine:
+         hit.fine = fDogma ? 0x1fe : 0x3fe;
+         break;
+      default:
+         break;
+   }
+
+   fNumErrors++;
+
+   return kind;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Add TDC v3 data with sub-sub event header to current event
+/// Epoch message produced before first hit and every time when epoch changes
+
+void hadaq::DataGenerator::AddTdc3Data(unsigned tdcid, bool errheader)
+{
+   unsigned start = fEvent.size();
+
+   fEvent.push_back(0); // sub-sub event header, filled at the end
+   fEvent.push_back(hadaq::tdckind_Header | (errheader ? 0x1 : 0x0));
+
+   uint32_t epoch = 0;
+   bool first = true;
+
+   for (auto &hit : fHits) {
+      uint64_t tm = hit.tm & 0x7FFFFFFFFFULL; // 28-bit epoch and 11-bit coarse counter
+      uint32_t e = (tm >> 11) & 0xFFFFFFF;
+      if (first || (e != epoch)) {
+         fEvent.push_back(hadaq::tdckind_Epoch | e);
+         epoch = e;
+         first = false;
+      }
+
+      fEvent.push_back(hadaq::tdckind_Hit | ((hit.ch & 0x7F) << 22) | ((hit.fine & 0x3FF) << 12) |
+                       (hit.rising ? 0x800 : 0x0) | (tm & 0x7FF));
+   }
+
+   fEvent[start] = ((fEvent.size() - start - 1) << 16) | (tdcid & 0xFFFF);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Add TDC5 packet to current event
+/// Channels are grouped in blocks of 8 with flags byte, hit times are relative to trigger time
+
+void hadaq::DataGenerator::AddTdc5Packet(unsigned tdcid, unsigned trigtype)
+{
+   const unsigned finelen = 9;
+
+   fPacket.clear();
+
+   auto put16 = [this](unsigned v) {
+      fPacket.push_back((v >> 8) & 0xff);
+      fPacket.push_back(v & 0xff);
+   };
+
+   unsigned pos = 0, lastch = fHits.back().ch;
+
+   for (unsigned block = 0; block * 8 <= lastch; ++block) {
+      unsigned flagpos = fPacket.size();
+      fPacket.push_back(0);
+
+      for (unsigned ch = block * 8; ch < block * 8 + 8; ++ch) {
+         if ((pos >= fHits.size()) || (fHits[pos].ch != ch))
+            continue;
+
+         fPacket[flagpos] |= 1 << (ch - block * 8);
+
+         uint64_t last = 0;
+         bool first = true;
+
+         while ((pos < fHits.size()) && (fHits[pos].ch == ch)) {
+            auto &hit = fHits[pos++];
+            bool islast = (pos >= fHits.size()) || (fHits[pos].ch != ch);
+
+            // first time is distance to trigger, others - difference to previous time
+            uint64_t rel = fTrigTime - hit.tm,
+                     v = (((first ? rel : last - rel) << (finelen + 1)) | ((hit.fine & 0x1ff) << 1) | (hit.rising ? 0 : 1)) & 0x3FFFFFFF;
+            last = rel;
+            first = false;
+
+            if (v < 0x400000) {
+               put16((v >> 8) | (islast ? 0x8000 : 0));
+               fPacket.push_back(v & 0xff);
+            } else {
+               put16((v >> 16) | 0x4000 | (islast ? 0x8000 : 0));
+               put16(v & 0xffff);
+            }
+         }
+      }
+   }
+
+   unsigned start = fEvent.size();
+
+   fEvent.resize(start + sizeof(dogma::DogmaTu) / 4 + (fPacket.size() + 3) / 4, 0);
+
+   uint32_t *hdr = fEvent.data() + start;
+
+   // header fields in big-endian format as expected by tdc5_parse_header()
+   uint32_t magic = TDC5_MAGIC | ((uint32_t) (Tdc5FreqMhz / 10) << 10) | finelen,
+            typenum = (trigtype << 28) | (fSeqNr & 0xFFFFFFF),
+            hi = fTrigTime >> 32, lo = fTrigTime & 0xFFFFFFFF;
+
+   hdr[0] = SWAP_VALUE(magic);
+   hdr[1] = SWAP_VALUE(typenum);
+   hdr[2] = SWAP_VALUE(tdcid);
+   hdr[3] = SWAP_VALUE(hi);
+   hdr[4] = SWAP_VALUE(lo);
+   hdr[5] = 0;
+
+   memcpy(hdr + sizeof(dogma::DogmaTu) / 4, fPacket.data(), fPacket.size());
+
+   ((dogma::DogmaTu *) hdr)->SetTdc5PaketLength(sizeof(dogma::DogmaTu) + fPacket.size());
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Build HLD event with one subevent per TRB
+/// Subevent ends with 0x5555 trailer, subevents and event are padded to 8 bytes
+
+void hadaq::DataGenerator::BuildHldEvent(unsigned trigtype, int errtdc)
+{
+   fEvent.clear();
+   fEvent.resize(sizeof(hadaqs::RawEvent) / 4, 0);
+
+   int indx = 0;
+
+   for (unsigned trb = 0; trb < fNumTrbs; ++trb) {
+      unsigned substart = fEvent.size(),
+               datastart = substart + sizeof(hadaqs::RawSubevent) / 4;
+
+      fEvent.resize(datastart, 0);
+
+      for (unsigned tdc = 0; tdc < fNumTdcs; ++tdc, ++indx) {
+         MakeHits(trigtype == 0xD);
+         unsigned err = (indx == errtdc) ? InjectError() : 0;
+         AddTdc3Data(fTdcId + indx, err == err_Header);
+      }
+
+      fEvent.push_back((1 << 16) | 0x5555);
+      fEvent.push_back(0x1);
+
+      unsigned subsize = (fEvent.size() - substart) * 4;
+
+      if (fSwapped)
+         hadaqs::SwapCopy4(fEvent.data() + datastart, fEvent.data() + datastart, fEvent.size() - datastart);
+
+      auto sub = (hadaqs::RawSubevent *) (fEvent.data() + substart);
+      sub->InitDecoding((0x2 << 16) | (trigtype << 4) | hadaqs::EvtDecoding_default, fSwapped);
+      sub->SetSize(subsize);
+      sub->SetId(fTrbId + trb);
+      sub->Init((fSeqNr << 8) | (fSeqNr & 0xff));
+
+      if (fEvent.size() % 2)
+         fEvent.push_back(0);
+   }
+
+   auto evnt = (hadaqs::RawEvent *) fEvent.data();
+   evnt->Init(fSeqNr, fRunId, (hadaqs::EvtId_DABC & ~0xf) | trigtype);
+   evnt->SetSize(fEvent.size() * 4);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Build DOGMA event with TDC5 packets of all TDCs
+
+void hadaq::DataGenerator::BuildDogmaEvent(unsigned trigtype, int errtdc)
+{
+   fEvent.clear();
+   fEvent.resize(sizeof(dogma::DogmaEvent) / 4, 0);
+
+   unsigned numtdc = fNumTrbs * fNumTdcs;
+
+   for (unsigned indx = 0; indx < numtdc; ++indx) {
+      MakeHits(trigtype == 0xD);
+      if ((int) indx == errtdc)
+         InjectError();
+      AddTdc5Packet(fTdcId + indx, trigtype);
+   }
+
+   auto evnt = (dogma::DogmaEvent *) fEvent.data();
+   evnt->Init(fSeqNr, trigtype, fSeqNr);
+   evnt->SetPayloadLen(fEvent.size() - sizeof(dogma::DogmaEvent) / 4);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Build next event, trigger time advanced by configured period
+
+void hadaq::DataGenerator::BuildEvent()
+{
+   if (fNumEvents == 0) {
+      if (fDogma) {
+         fCoarseUnit = hadaq::TdcMessage::CoarseUnit300() * 1e9;
+         fFineMin = Tdc5FineMin;
+         fFineMax = Tdc5FineMax;
+      } else {
+         fCoarseUnit = hadaq::TdcMessage::CoarseUnit() * 1e9;
+         fFineMin = hadaq::TdcMessage::GetFineMinValue();
+         fFineMax = hadaq::TdcMessage::GetFineMaxValue();
+      }
+      if (fFineMax < fFineMin)
+         fFineMax = fFineMin;
+
+      uint64_t period = ToCoarse(fTrigPeriod), full = 1ULL << 39;
+
+      // hits generated before trigger time within window, start time must not let them underflow
+      uint64_t minstart = std::max<uint64_t>(ToCoarse(fWindow), 1) + std::max(ToCoarse(fTot), ToCoarse(hadaq::ToTvalue)) + 1;
+
+      if (!fDogma && fEpochWrap && (fEpochWrap * period < full))
+         fTrigTime = std::max(full - fEpochWrap * period, minstart);
+      else
+         fTrigTime = ToCoarse(fWindow + fTot + hadaq::ToTvalue) + 0x10000;
+   } else {
+      uint64_t period = ToCoarse(fTrigPeriod);
+      fTrigTime += period ? period : 1;
+   }
+
+   fExpMean = std::exp(-fMeanHits);
+
+   unsigned trigtype = (fCalibrPeriod > 0) && (fSeqNr % fCalibrPeriod == fCalibrPeriod - 1) ? 0xD : fTrigType;
+
+   int errtdc = -1;
+   if ((fErrorRate > 0) && (fErrorMask & err_All) && (RandomUniform() < fErrorRate))
+      errtdc = Random() % (fNumTrbs * fNumTdcs);
+
+   if (fDogma)
+      BuildDogmaEvent(trigtype, errtdc);
+   else
+      BuildHldEvent(trigtype, errtdc);
+
+   fEventSize = fEvent.size() * 4;
+   fPending = true;
+
+   fSeqNr++;
+   fNumEvents++;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Produce next event, returns pointer on internal storage valid until next call
+
+const void *hadaq::DataGenerator::NextEvent(unsigned &size)
+{
+   if (!fPending)
+      BuildEvent();
+
+   fPending = false;
+   size = fEventSize;
+   return fEvent.data();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Fill buffer with up to maxevents events, which can be directly provided to HLD or TRB processor
+/// Event which does not fit into buffer is kept for the next call
+/// Returns number of events in the buffer
+
+unsigned hadaq::DataGenerator::FillBuffer(base::Buffer &buf, unsigned maxevents, unsigned bufsize)
+{
+   buf.makenew(bufsize);
+
+   unsigned cnt = 0, pos = 0;
+
+   while (cnt < maxevents) {
+      if (!fPending)
+         BuildEvent();
+
+      if (pos + fEventSize > buf.datalen()) {
+         if (pos > 0) break;
+         // single event does not fit into empty buffer
+         buf.makenew(fEventSize);
+      }
+
+      memcpy(buf.ptr(pos), fEvent.data(), fEventSize);
+      pos += fEventSize;
+      fPending = false;
+      cnt++;
+   }
+
+   buf.setdatalen(pos);
+
+   if (!buf.null()) {
+      buf().kind = fDogma ? base::proc_DOGMAEvent : base::proc_TRBEvent;
+      buf().boardid = 0;
+      buf().format = 0;
+   }
+
+   return cnt;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Write specified number of events into HLD or DOGMA file
+
+bool hadaq::DataGenerator::WriteFile(const char *fname, unsigned numevents)
+{
+   hadaq::HldFile hldfile;
+   dogma::DogmaFile dogmafile;
+
+   if (fDogma ? !dogmafile.OpenWrite(fname) : !hldfile.OpenWrite(fname, fRunId))
+      return false;
+
+   base::Buffer buf;
+   bool res = true;
+
+   while (res && (numevents > 0)) {
+      unsigned cnt = FillBuffer(buf, numevents);
+      if (cnt == 0) break;
+      numevents -= cnt;
+
+      res = fDogma ? dogmafile.WriteBuffer(buf.ptr(), buf.datalen()) : hldfile.WriteBuffer(buf.ptr(), buf.datalen());
+   }
+
+   if (fDogma)
+      dogmafile.Close();
+   else
+      hldfile.Close();
+
+   if (!res)
+      printf("Fail to write generated events into %s\n", fname);
+
+   return res;
+}
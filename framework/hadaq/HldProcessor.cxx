@@ -92,6 +92,7 @@ hadaq::HldProcessor::~HldProcessor()
 void hadaq::HldProcessor::AddTrb(TrbProcessor* trb, unsigned id)
 {
    fMap[id] = trb;
+   fTrbDispatchDirty = true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -123,6 +124,25 @@ hadaq::TrbProcessor* hadaq::HldProcessor::FindTRB(unsigned trbid) const
    return iter == fMap.end() ? nullptr : iter->second;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////
+/// Build dispatch table for subevent ids
+/// Used to find TRB processor with single indexed load instead of map search
+
+void hadaq::HldProcessor::BuildTrbDispatch()
+{
+   fTrbDispatch.assign(0x10000, 0);
+   fTrbDispatchProcs.clear();
+   fTrbDispatchProcs.emplace_back(nullptr);
+
+   for (auto &entry : fMap) {
+      if ((entry.first > 0xffff) || (fTrbDispatchProcs.size() > 0xffff)) continue;
+      fTrbDispatch[entry.first] = fTrbDispatchProcs.size();
+      fTrbDispatchProcs.emplace_back(entry.second);
+   }
+
+   fTrbDispatchDirty = false;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////
 /// Return number of TDCs in all TRBs
@@ -388,6 +408,8 @@ bool hadaq::HldProcessor::FirstBufferScan(const base::Buffer& buf)
 
    unsigned evcnt = 0;
 
+   unsigned long rejected = GetNumRejectedSubBufs();
+
    while ((ev = iter.nextEvent()) != nullptr) {
 
       evcnt++;
@@ -403,10 +425,14 @@ bool hadaq::HldProcessor::FirstBufferScan(const base::Buffer& buf)
       if ((fEventTypeSelect <= 0xf) && ((ev->GetId() & 0xf) != fEventTypeSelect)) continue;
       if (fFilterStatusEvents && (((ev->GetId() & 0xf) == 0x9) || ((ev->GetId() & 0xf) == 0xe))) continue;
 
+      fNumEvents++;
+
       if (IsPrintRawData()) ev->Dump();
 
       DefFillH1(fEvSize, ev->GetPaddedSize(), 1.);
 
+      base::ProfilerGuard grd(fProfiler, "split", 0);
+
       if (!use_threads) {
          for (auto &entry : fMap)
             entry.second->BeforeEventScan();
@@ -423,13 +449,13 @@ bool hadaq::HldProcessor::FirstBufferScan(const base::Buffer& buf)
          // use only 16-bit in trigger number while CTS make a lot of errors in higher 8 bits
          // AccountTriggerId((sub->GetTrigNr() >> 8) & 0xffff);
 
-         auto iter = fMap.find(sub->GetId());
+         TrbProcessor *trbproc = LookupTRB(sub->GetId());
 
-         if (iter != fMap.end()) {
-            if (use_threads && iter->second->fThreadData) {
-               iter->second->fThreadData->subevents.emplace_back(sub);
+         if (trbproc) {
+            if (use_threads && trbproc->fThreadData) {
+               trbproc->fThreadData->subevents.emplace_back(sub);
             } else {
-               iter->second->ScanSubEvent(sub, fMsg.run_nr, fMsg.seq_nr);
+               trbproc->ScanSubEvent(sub, fMsg.run_nr, fMsg.seq_nr);
             }
          } else if (fAutoCreate) {
             TrbProcessor* trb = new TrbProcessor(sub->GetId(), this);
@@ -455,12 +481,22 @@ bool hadaq::HldProcessor::FirstBufferScan(const base::Buffer& buf)
 
       if (!use_threads) {
 
+         grd.Next("scan", 1);
+
          for (auto &entry : fMap)
             entry.second->AfterEventScan();
 
+         grd.Next("fill", 2);
+
          for (auto &entry : fMap)
             entry.second->AfterEventFill();
 
+         unsigned long new_rejected = GetNumRejectedSubBufs();
+         if (new_rejected != rejected) {
+            fNumIncompleteEvents++;
+            rejected = new_rejected;
+         }
+
          if (fAutoCreate) {
             fAutoCreate = false; // with first event
             if (!fAfterFunc.empty())
@@ -473,6 +509,8 @@ bool hadaq::HldProcessor::FirstBufferScan(const base::Buffer& buf)
 
    if (use_threads) {
 
+      base::ProfilerGuard grd(fProfiler, "threads", 3);
+
       for (auto &entry : fMap) {
          auto data = entry.second->fThreadData;
          if (!data || data->subevents.empty()) continue;
@@ -494,6 +532,10 @@ bool hadaq::HldProcessor::FirstBufferScan(const base::Buffer& buf)
             data->cv.wait(lk, [data]{ return data->canceled || !data->working; });
          }
       }
+
+      // with threads rejected buffers can be only accounted for complete HLD buffer
+      if (GetNumRejectedSubBufs() != rejected)
+         fNumIncompleteEvents++;
    }
 
 
@@ -507,6 +549,7 @@ bool hadaq::HldProcessor::FirstBufferScan(const base::Buffer& buf)
       auto tm = ::time(NULL);
       if (fLastHadesTm <= 0) fLastHadesTm = tm;
       if (tm - fLastHadesTm > hadaq::TdcProcessor::GetHadesMonitorInterval()) {
+         base::ProfilerGuard grd(fProfiler, "qa", 4);
          fLastHadesTm = tm;
          for (auto &item : fMap) {
             unsigned num = item.second->NumberOfTDC();
@@ -522,6 +565,17 @@ bool hadaq::HldProcessor::FirstBufferScan(const base::Buffer& buf)
    return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////
+/// Returns number of sub-buffers, rejected in all TRBs because queues of sub-processors reached limit
+
+unsigned long hadaq::HldProcessor::GetNumRejectedSubBufs() const
+{
+   unsigned long cnt = 0;
+   for (auto &entry : fMap)
+      cnt += entry.second->GetNumRejectedSubBufs();
+   return cnt;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////
 /// Fill QA summary histograms
 
@@ -608,13 +662,13 @@ unsigned hadaq::HldProcessor::TransformEvent(void* src, unsigned len, void* tgt,
    }
 
    while (auto sub = iter.nextSubevent()) {
-      auto iter = fMap.find(sub->GetId());
-      if (iter != fMap.end()) {
+      TrbProcessor *trbproc = LookupTRB(sub->GetId());
+      if (trbproc) {
          if (curr && (tgtlen-reslen < sub->GetPaddedSize())) {
             fprintf(stderr,"not enough space for subevent in output buffer\n");
             return 0;
          }
-         unsigned sublen = iter->second->TransformSubEvent(sub, curr, tgtlen - reslen);
+         unsigned sublen = trbproc->TransformSubEvent(sub, curr, tgtlen - reslen);
          if (curr) {
             curr += sublen;
             reslen += sublen;
@@ -655,6 +709,8 @@ void hadaq::HldProcessor::UserPreLoop()
       CreatePerTDCHisto();
       CreatePerMDCHisto();
    }
+
+   BuildTrbDispatch();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
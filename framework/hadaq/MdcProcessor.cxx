@@ -67,6 +67,7 @@ void hadaq::MdcProcessor::CreateBranch(TTree*)
 void hadaq::MdcProcessor::Store(base::Event* ev)
 {
    // always set to dummy
+   fDummyFloat.clear();
    pStoreFloat = &fDummyFloat;
 
    // in case of triggered analysis all pointers already set
@@ -79,7 +80,7 @@ void hadaq::MdcProcessor::Store(base::Event* ev)
       auto sub = dynamic_cast<hadaq::MdcSubEvent *> (sub0);
       // when subevent exists, use directly pointer on messages vector
       if (sub) {
-         pStoreFloat = sub->vect_ptr();
+         pStoreFloat = sub->store_ptr(fDummyFloat);
       }
    }
 }
@@ -94,9 +95,10 @@ bool hadaq::MdcProcessor::FirstBufferScan(const base::Buffer &buf)
 
    if (IsTriggeredAnalysis() && IsStoreEnabled() && mgr()->HasTrigEvent() && (GetStoreKind() > 0)) {
       dostore = true;
-      auto subevnt = new hadaq::MdcSubEvent(len - 1); // expected number of messages
+      auto subevnt = new hadaq::MdcSubEvent;
       mgr()->AddToTrigEvent(GetName(), subevnt);
-      pStoreFloat = subevnt->vect_ptr();
+      subevnt->AttachArena(mgr()->GetTrigEventArena(), len - 1); // expected number of messages
+      pEvent = subevnt;
    }
 
    uint32_t data0 = arr[0];
@@ -146,7 +148,7 @@ bool hadaq::MdcProcessor::FirstBufferScan(const base::Buffer &buf)
          timeToT += 8192 * 0.4;
 
       if (dostore) {
-         pStoreFloat->emplace_back(channel, timeDiff, timeToT);
+         pEvent->EmplaceMsg(channel, timeDiff, timeToT);
       }
 
 
@@ -0,0 +1,246 @@
+#include "hadaq/TdcDecoder.h"
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TDC_DECODER_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+   /** configured instructions set: -1 - not configured, 0 - scalar, 1 - SSE4.1, 2 - AVX2
+     * atomic while several HLD threads may use decoder at the same time */
+   std::atomic<int> gSimdLevel{-1};
+
+   /** instructions set supported by CPU, detected only once */
+   int SupportedSimdLevel()
+   {
+      static const int level = []() {
+         int lvl = 0;
+#ifdef TDC_DECODER_X86
+         if (__builtin_cpu_supports("avx2"))
+            lvl = 2;
+         else if (__builtin_cpu_supports("sse4.1"))
+            lvl = 1;
+#endif
+         return lvl;
+      }();
+      return level;
+   }
+
+   /** swap bytes of single word */
+   inline uint32_t SwapWord(uint32_t w)
+   {
+      return ((w & 0xFF) << 24) | ((w & 0xFF00) << 8) | ((w >> 8) & 0xFF00) | (w >> 24);
+   }
+
+   /** scalar decoding of messages in range [first, last) */
+   void DecodeScalar(const uint32_t *src, unsigned first, unsigned last, bool swapped,
+                     uint32_t *words, uint8_t *kind, uint8_t *chan, uint8_t *edge,
+                     uint16_t *coarse, uint16_t *fine, int32_t *epindx, int32_t carry)
+   {
+      for (unsigned n = first; n < last; ++n) {
+         uint32_t w = swapped ? SwapWord(src[n]) : src[n];
+         words[n] = w;
+         kind[n] = w >> 29;
+         chan[n] = (w >> 22) & 0x7F;
+         edge[n] = (w >> 11) & 1;
+         coarse[n] = w & 0x7FF;
+         fine[n] = (w >> 12) & 0x3FF;
+         if (kind[n] == hadaq::TdcDecoder::kEpoch)
+            carry = (int32_t) n;
+         epindx[n] = carry;
+      }
+   }
+
+#ifdef TDC_DECODER_X86
+
+   /** SSE4.1 decoding, 4 messages at once */
+   __attribute__((target("sse4.1")))
+   unsigned DecodeSSE(const uint32_t *src, unsigned len, bool swapped,
+                      uint32_t *words, uint8_t *kind, uint8_t *chan, uint8_t *edge,
+                      uint16_t *coarse, uint16_t *fine, int32_t *epindx, int32_t &carry)
+   {
+      const __m128i swapmask = _mm_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3);
+      const __m128i mask7f = _mm_set1_epi32(0x7F), mask7ff = _mm_set1_epi32(0x7FF),
+                    mask3ff = _mm_set1_epi32(0x3FF), mask1 = _mm_set1_epi32(1),
+                    epkind = _mm_set1_epi32(hadaq::TdcDecoder::kEpoch),
+                    minus1 = _mm_set1_epi32(-1), lane0 = _mm_set_epi32(0, 0, 0, -1),
+                    lane01 = _mm_set_epi32(0, 0, -1, -1), step = _mm_set1_epi32(4);
+
+      __m128i indx = _mm_set_epi32(3, 2, 1, 0), vcarry = _mm_set1_epi32(carry);
+
+      unsigned n = 0;
+      for (; n + 4 <= len; n += 4) {
+         __m128i w = _mm_loadu_si128((const __m128i *) (src + n));
+         if (swapped) w = _mm_shuffle_epi8(w, swapmask);
+         _mm_storeu_si128((__m128i *) (words + n), w);
+
+         __m128i k = _mm_srli_epi32(w, 29);
+         __m128i c = _mm_and_si128(_mm_srli_epi32(w, 22), mask7f);
+         __m128i e = _mm_and_si128(_mm_srli_epi32(w, 11), mask1);
+         __m128i crs = _mm_and_si128(w, mask7ff);
+         __m128i f = _mm_and_si128(_mm_srli_epi32(w, 12), mask3ff);
+
+         __m128i k16 = _mm_packus_epi32(k, c);      // k0..k3 c0..c3
+         __m128i k8 = _mm_packus_epi16(k16, _mm_packus_epi32(e, e));  // k, c, e, e
+         uint32_t tmp[4];
+         _mm_storeu_si128((__m128i *) tmp, k8);
+         memcpy(kind + n, &tmp[0], 4);
+         memcpy(chan + n, &tmp[1], 4);
+         memcpy(edge + n, &tmp[2], 4);
+
+         _mm_storel_epi64((__m128i *) (coarse + n), _mm_packus_epi32(crs, crs));
+         _mm_storel_epi64((__m128i *) (fine + n), _mm_packus_epi32(f, f));
+
+         // epoch index - prefix maximum of index of epoch messages
+         __m128i ep = _mm_blendv_epi8(minus1, indx, _mm_cmpeq_epi32(k, epkind));
+         ep = _mm_max_epi32(ep, _mm_or_si128(_mm_slli_si128(ep, 4), lane0));
+         ep = _mm_max_epi32(ep, _mm_or_si128(_mm_slli_si128(ep, 8), lane01));
+         ep = _mm_max_epi32(ep, vcarry);
+         _mm_storeu_si128((__m128i *) (epindx + n), ep);
+         vcarry = _mm_shuffle_epi32(ep, 0xFF);
+
+         indx = _mm_add_epi32(indx, step);
+      }
+
+      carry = _mm_cvtsi128_si32(vcarry);
+      return n;
+   }
+
+   /** AVX2 decoding, 8 messages at once */
+   __attribute__((target("avx2")))
+   unsigned DecodeAVX2(const uint32_t *src, unsigned len, bool swapped,
+                       uint32_t *words, uint8_t *kind, uint8_t *chan, uint8_t *edge,
+                       uint16_t *coarse, uint16_t *fine, int32_t *epindx, int32_t &carry)
+   {
+      const __m256i swapmask = _mm256_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3,
+                                               12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3);
+      const __m256i mask7f = _mm256_set1_epi32(0x7F), mask7ff = _mm256_set1_epi32(0x7FF),
+                    mask3ff = _mm256_set1_epi32(0x3FF), mask1 = _mm256_set1_epi32(1),
+                    epkind = _mm256_set1_epi32(hadaq::TdcDecoder::kEpoch),
+                    minus1 = _mm256_set1_epi32(-1), step = _mm256_set1_epi32(8),
+                    shift1 = _mm256_set_epi32(6, 5, 4, 3, 2, 1, 0, 0),
+                    shift2 = _mm256_set_epi32(5, 4, 3, 2, 1, 0, 0, 0),
+                    shift4 = _mm256_set_epi32(3, 2, 1, 0, 0, 0, 0, 0),
+                    last = _mm256_set1_epi32(7);
+
+      __m256i indx = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0), vcarry = _mm256_set1_epi32(carry);
+
+      unsigned n = 0;
+      for (; n + 8 <= len; n += 8) {
+         __m256i w = _mm256_loadu_si256((const __m256i *) (src + n));
+         if (swapped) w = _mm256_shuffle_epi8(w, swapmask);
+         _mm256_storeu_si256((__m256i *) (words + n), w);
+
+         __m256i k = _mm256_srli_epi32(w, 29);
+         __m256i c = _mm256_and_si256(_mm256_srli_epi32(w, 22), mask7f);
+         __m256i e = _mm256_and_si256(_mm256_srli_epi32(w, 11), mask1);
+         __m256i crs = _mm256_and_si256(w, mask7ff);
+         __m256i f = _mm256_and_si256(_mm256_srli_epi32(w, 12), mask3ff);
+
+         // pack 32-bit lanes into 16-bit, packus works inside 128-bit halves - fix order with permute
+         __m128i crs16 = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(crs, crs), 0x08));
+         __m128i f16 = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(f, f), 0x08));
+         __m128i k16 = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(k, k), 0x08));
+         __m128i c16 = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(c, c), 0x08));
+         __m128i e16 = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(e, e), 0x08));
+
+         _mm_storeu_si128((__m128i *) (coarse + n), crs16);
+         _mm_storeu_si128((__m128i *) (fine + n), f16);
+         _mm_storel_epi64((__m128i *) (kind + n), _mm_packus_epi16(k16, k16));
+         _mm_storel_epi64((__m128i *) (chan + n), _mm_packus_epi16(c16, c16));
+         _mm_storel_epi64((__m128i *) (edge + n), _mm_packus_epi16(e16, e16));
+
+         // epoch index - prefix maximum of index of epoch messages
+         __m256i ep = _mm256_blendv_epi8(minus1, indx, _mm256_cmpeq_epi32(k, epkind));
+         ep = _mm256_max_epi32(ep, _mm256_blend_epi32(_mm256_permutevar8x32_epi32(ep, shift1), minus1, 0x01));
+         ep = _mm256_max_epi32(ep, _mm256_blend_epi32(_mm256_permutevar8x32_epi32(ep, shift2), minus1, 0x03));
+         ep = _mm256_max_epi32(ep, _mm256_blend_epi32(_mm256_permutevar8x32_epi32(ep, shift4), minus1, 0x0F));
+         ep = _mm256_max_epi32(ep, vcarry);
+         _mm256_storeu_si256((__m256i *) (epindx + n), ep);
+         vcarry = _mm256_permutevar8x32_epi32(ep, last);
+
+         indx = _mm256_add_epi32(indx, step);
+      }
+
+      carry = _mm256_cvtsi256_si32(vcarry);
+      return n;
+   }
+
+#endif
+
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Returns used instructions set: 0 - scalar, 1 - SSE4.1, 2 - AVX2
+/// When not configured, detected from CPU capabilities
+
+int hadaq::TdcDecoder::GetSimdLevel()
+{
+   int lvl = gSimdLevel.load(std::memory_order_relaxed);
+   return lvl < 0 ? SupportedSimdLevel() : lvl;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Configure instructions set used for decoding: 0 - scalar, 1 - SSE4.1, 2 - AVX2
+/// Level cannot be higher than supported by CPU
+
+void hadaq::TdcDecoder::SetSimdLevel(int lvl)
+{
+   int supported = SupportedSimdLevel();
+   gSimdLevel.store((lvl < 0) ? 0 : (lvl > supported ? supported : lvl), std::memory_order_relaxed);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Ensure that arrays are large enough
+
+void hadaq::TdcDecoder::Reserve(unsigned len)
+{
+   if (fWords.size() >= len) return;
+
+   fWords.resize(len);
+   fKind.resize(len);
+   fChannel.resize(len);
+   fEdge.resize(len);
+   fCoarse.resize(len);
+   fFine.resize(len);
+   fEpochIndx.resize(len);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Decode len words from src, if swapped is true bytes order of every word will be changed
+/// Returns number of decoded messages
+
+unsigned hadaq::TdcDecoder::Decode(const uint32_t *src, unsigned len, bool swapped)
+{
+   fSize = src ? len : 0;
+   if (fSize == 0) return 0;
+
+   Reserve(fSize);
+
+   unsigned n = 0;
+   int32_t carry = -1;
+
+#ifdef TDC_DECODER_X86
+   switch (GetSimdLevel()) {
+      case 2:
+         n = DecodeAVX2(src, fSize, swapped, fWords.data(), fKind.data(), fChannel.data(), fEdge.data(),
+                        fCoarse.data(), fFine.data(), fEpochIndx.data(), carry);
+         break;
+      case 1:
+         n = DecodeSSE(src, fSize, swapped, fWords.data(), fKind.data(), fChannel.data(), fEdge.data(),
+                       fCoarse.data(), fFine.data(), fEpochIndx.data(), carry);
+         break;
+      default:
+         break;
+   }
+#endif
+
+   DecodeScalar(src, n, fSize, swapped, fWords.data(), fKind.data(), fChannel.data(), fEdge.data(),
+                fCoarse.data(), fFine.data(), fEpochIndx.data(), carry);
+
+   return fSize;
+}
@@ -9,6 +9,7 @@
 
 #include "base/defines.h"
 #include "base/ProcMgr.h"
+#include "base/ColumnStore.h"
 
 #include "dogma/defines.h"
 #include "dogma/tdc5.h"
@@ -45,6 +46,8 @@ bool hadaq::TdcProcessor::gIgnoreCalibrMsgs = false;
 bool hadaq::TdcProcessor::gStoreCalibrTables = false;
 bool hadaq::TdcProcessor::gPreventFineCalibration = false;
 int hadaq::TdcProcessor::gTimeRefKind = -1;
+bool hadaq::TdcProcessor::gScanKernels = true;
+bool hadaq::TdcProcessor::gFastTransform = true;
 
 const unsigned BUBBLE_SIZE = 19;
 
@@ -130,6 +133,24 @@ void hadaq::TdcProcessor::SetUseDTrigForRef(bool on)
    gUseDTrigForRef = on;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Enable usage of specialised scan kernels
+/// When disabled, generic scan code with all histograms checks is always used
+
+void hadaq::TdcProcessor::SetScanKernels(bool on)
+{
+   gScanKernels = on;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Enable usage of fast transform kernel with integer correction tables
+/// When disabled, generic transform code is always used
+
+void hadaq::TdcProcessor::SetFastTransform(bool on)
+{
+   gFastTransform = on;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////
 /// Use all data as 0xD trigger
 
@@ -235,11 +256,16 @@ hadaq::TdcProcessor::TdcProcessor(TrbProcessor* trb, unsigned tdcid, unsigned nu
    fCalibrTempSum2(0),
    fDummyVect(),
    pStoreVect(nullptr),
+   pEventVect(nullptr),
    fDummyFloat(),
    pStoreFloat(nullptr),
    pEventFloat(nullptr),
    fDummyDouble(),
    pStoreDouble(nullptr),
+   pEventDouble(nullptr),
+   fDummyInt(),
+   pStoreInt(nullptr),
+   pEventInt(nullptr),
    fEdgeMask(edge_mask),
    fCalibrCounts(0),
    fAutoCalibr(false),
@@ -451,6 +477,8 @@ void hadaq::TdcProcessor::Set400Mhz(bool on)
    for (unsigned ch = 0; ch < fNumChannels; ch++)
       if (!fCh[ch].hascalibr)
          fCh[ch].FillCalibr(fNumFineBins, GetTdcCoarseUnit());
+
+   fCalibrTableDirty = fTransformTableDirty = true;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -464,6 +492,8 @@ void hadaq::TdcProcessor::SetCustomMhz(float freq)
    for (unsigned ch = 0; ch < fNumChannels; ch++)
       if (!fCh[ch].hascalibr)
          fCh[ch].FillCalibr(fNumFineBins, GetTdcCoarseUnit());
+
+   fCalibrTableDirty = fTransformTableDirty = true;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -612,10 +642,28 @@ void hadaq::TdcProcessor::ConfigureToTByHwType(unsigned hwtype)
    }
 
    if (recognized) {
+      fPendingToTLog = true;
+      if (!fDelayedCalibr) ProcessDelayedCalibr();
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Perform calibration checks and logging, delayed during parallel transform
+/// Must be called from the thread which owns histograms and manager
+
+void hadaq::TdcProcessor::ProcessDelayedCalibr()
+{
+   if (fPendingToTLog) {
+      fPendingToTLog = false;
       char msg[1000];
       snprintf(msg, sizeof(msg), "%s assign ToT config len:%4.1f hmin:%4.1f hmax:%4.1f", GetName(), fToTvalue, fToThmin, fToThmax);
       mgr()->PrintLog(msg);
    }
+
+   if (fPendingCalibrCheck) {
+      fPendingCalibrCheck = false;
+      CheckCalibrProgress();
+   }
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -912,23 +960,32 @@ void hadaq::TdcProcessor::BeforeFill()
 
 void hadaq::TdcProcessor::AfterFill(SubProcMap* subprocmap)
 {
+   base::ProfilerGuard grd(fProfiler, "fill", 1);
 
    bool regular_ch0 = IsRegularChannel0();
 
+   // reference times always calculated, histograms filled only for sampled events
+   const bool sampled = IsSampledEvent();
+   const double sampled_w = SampledWeight();
+
    // complete logic only when hist level is specified
    if (HistFillLevel() >= 4)
    for (unsigned ch = 0; ch < NumChannels(); ch++) {
 
       ChannelRec &rec = fCh[ch];
 
-      DefFillH1(rec.fRisingMult, rec.rising_cnt, 1.); rec.rising_cnt = 0;
-      DefFillH1(rec.fFallingMult, rec.falling_cnt, 1.); rec.falling_cnt = 0;
+      if (sampled) {
+         DefFillH1(rec.fRisingMult, rec.rising_cnt, sampled_w);
+         DefFillH1(rec.fFallingMult, rec.falling_cnt, sampled_w);
+      }
+      rec.rising_cnt = 0;
+      rec.falling_cnt = 0;
 
       if (rec.fRisingTmdsRef && (rec.refch_tmds < NumChannels())) {
          double tm1 = rec.rising_tmds;
          double tm0 = fCh[rec.refch_tmds].rising_tmds;
-         if ((tm1!=0) && (tm0!=0))
-            DefFillH1(rec.fRisingTmdsRef, (tm1-tm0) * 1e9, 1.);
+         if ((tm1!=0) && (tm0!=0) && sampled)
+            DefFillH1(rec.fRisingTmdsRef, (tm1-tm0) * 1e9, sampled_w);
       }
 
       unsigned ref = rec.refch;
@@ -973,13 +1030,15 @@ void hadaq::TdcProcessor::AfterFill(SubProcMap* subprocmap)
             // if (diff > 150 && diff < 160)
             // printf("%s ch %u diff %f tm %12.3f tm_ref %12.3f\n", GetName(), ch, diff, tm*1e9, tm_ref*1e9);
 
-            // when refch is 0 on same board, histogram already filled
-            if ((ref > 0) || regular_ch0 || (refproc != this))
-               DefFillH1(rec.fRisingRef, diff, 1.);
+            if (sampled) {
+               // when refch is 0 on same board, histogram already filled
+               if ((ref > 0) || regular_ch0 || (refproc != this))
+                  DefFillH1(rec.fRisingRef, diff, sampled_w);
 
-            DefFillH2(rec.fRisingRef2D, diff, rec.rising_fine, 1.);
-            DefFillH2(rec.fRisingRef2D, (diff-1.), refproc->fCh[ref].rising_fine, 1.);
-            DefFillH2(rec.fRisingRef2D, (diff-2.), rec.rising_coarse/4, 1.);
+               DefFillH2(rec.fRisingRef2D, diff, rec.rising_fine, sampled_w);
+               DefFillH2(rec.fRisingRef2D, (diff-1.), refproc->fCh[ref].rising_fine, sampled_w);
+               DefFillH2(rec.fRisingRef2D, (diff-2.), rec.rising_coarse/4, sampled_w);
+            }
             RAWPRINT("Difference rising %04x:%02u\t %04x:%02u\t %12.3f\t %12.3f\t %7.3f  coarse %03x - %03x = %4d  fine %03x %03x \n",
                   GetID(), ch, reftdc, ref,
                   tm*1e9,  tm_ref*1e9, diff,
@@ -1012,14 +1071,16 @@ void hadaq::TdcProcessor::AfterFill(SubProcMap* subprocmap)
          }
 
          if (refproc && (ref<refproc->NumChannels()) && ((ref != ch) || (refproc != this))) {
-            if ((rec.rising_ref_tm != 0) && (refproc->fCh[ref].rising_ref_tm != 0)) {
-               DefFillH1(rec.fRisingRefRef, (rec.rising_ref_tm - refproc->fCh[ref].rising_ref_tm)*1e9, 1.);
-               DefFillH2(rec.fRisingDoubleRef, rec.rising_ref_tm*1e9, refproc->fCh[ref].rising_ref_tm*1e9, 1.);
+            if ((rec.rising_ref_tm != 0) && (refproc->fCh[ref].rising_ref_tm != 0) && sampled) {
+               DefFillH1(rec.fRisingRefRef, (rec.rising_ref_tm - refproc->fCh[ref].rising_ref_tm)*1e9, sampled_w);
+               DefFillH2(rec.fRisingDoubleRef, rec.rising_ref_tm*1e9, refproc->fCh[ref].rising_ref_tm*1e9, sampled_w);
             }
          }
       }
    }
 
+   grd.Next("calibr", 2);
+
    fCalibrProgress = TestCanCalibrate(false);
    if ((fCalibrProgress>=1.) && fAutoCalibr) PerformAutoCalibrate();
 }
@@ -1170,6 +1231,10 @@ float hadaq::TdcProcessor::ExtractCalibr(const std::vector<float> &func, unsigne
    if (!fCalibrUseTemp || (fCalibrTemp <= 0) || (fCurrentTemp <= 0) || (fCalibrTempCoef<=0))
       return ExtractCalibrDirect(func, bin);
 
+   // temperature scaling only implemented for complete lookup table
+   if ((func.size() <= 100) && (func.size() != fNumFineBins))
+      return ExtractCalibrDirect(func, bin);
+
    // TODO: if using temperature, also extrapolate linear approximation
    float temp = fCurrentTemp + fTempCorrection;
 
@@ -1177,7 +1242,7 @@ float hadaq::TdcProcessor::ExtractCalibr(const std::vector<float> &func, unsigne
 
    double coarse_unit = GetTdcCoarseUnit();
 
-   if ((temp < fCalibrTemp) && (func[bin] >= coarse_unit*0.9999)) {
+   if ((temp < fCalibrTemp) && (func[bin] >= coarse_unit*0.9999) && (bin >= 80)) {
       // special case - lower temperature and bin which was not observed during calibration
       // just take linear extrapolation, using points bin-30 and bin-80
 
@@ -1189,6 +1254,110 @@ float hadaq::TdcProcessor::ExtractCalibr(const std::vector<float> &func, unsigne
    return val < coarse_unit ? val : coarse_unit;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Compile calibration curves of all channels into single contiguous table
+///
+/// Layout is [channel][edge][fine], edge 0 is rising and 1 is falling.
+/// Each entry is complete correction in seconds, which is subtracted from coarse time.
+/// ToT shift and temperature compensation for current temperature are already included.
+/// Table is rebuild when calibration changed or new temperature value is measured while compensation is active
+
+void hadaq::TdcProcessor::BuildCalibrTable()
+{
+   fCalibrTable.resize(fNumChannels * 2 * fNumFineBins);
+
+   bool do_temp_comp = IsTempCompensation() && (fabs(fCurrentTemp - fCalibrTemp) < 30.);
+
+   float *tgt = fCalibrTable.data();
+
+   for (unsigned ch = 0; ch < fNumChannels; ch++) {
+      ChannelRec &rec = fCh[ch];
+
+      // negative while value should be add to the stamp
+      double temp_shift = do_temp_comp ? (fCurrentTemp + fTempCorrection - fCalibrTemp) * rec.time_shift_per_grad * 1e-9 : 0.;
+
+      for (unsigned edge = 0; edge < 2; edge++) {
+         const std::vector<float> &func = edge == 0 ? rec.rising_calibr : rec.falling_calibr;
+
+         // apply TOT shift for falling edge
+         double shift = (edge == 0 ? 0. : rec.tot_shift*1e-9) - temp_shift;
+
+         for (unsigned fine = 0; fine < fNumFineBins; fine++)
+            *tgt++ = func.empty() ? 0. : ExtractCalibr(func, fine) + shift;
+      }
+   }
+
+   fCalibrTableTemp = IsTempCompensation() ? fCurrentTemp : -1.;
+   fCalibrTableDirty = false;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Compile calibration into integer correction table, used by fast transform
+///
+/// Layout is [channel][edge][fine], edge 0 is rising and 1 is falling.
+/// For every channel and edge extra entry at position fNumFineBins is calculated without correction,
+/// it is used for hits with hard failure.
+/// Mode 1 produces values for transformation in place, mode 2 - for transformation into target buffer.
+/// Values are produced with exactly the same arithmetic as in generic TransformTdcData code
+
+void hadaq::TdcProcessor::BuildTransformTable(unsigned mode)
+{
+   unsigned rowlen = fNumFineBins + 1;
+
+   fTransformTable.resize(fNumChannels * 2 * rowlen);
+
+   TransformEntry *tgt = fTransformTable.data();
+
+   for (unsigned ch = 0; ch < fNumChannels; ch++) {
+      ChannelRec &rec = fCh[ch];
+
+      for (unsigned edge = 0; edge < 2; edge++) {
+         const std::vector<float> &func = edge == 0 ? rec.rising_calibr : rec.falling_calibr;
+
+         for (unsigned fine = 0; fine < rowlen; fine++, tgt++) {
+            double corr = (func.empty() || (fine == fNumFineBins)) ? 0. : ExtractCalibrDirect(func, fine);
+
+            uint32_t new_fine;
+            int corr_coarse = 0;
+
+            if (mode == 2) {
+               if (edge == 0) {
+                  new_fine = (uint32_t) (corr/5e-9*0x3ffe);
+               } else {
+                  corr += rec.tot_shift*1e-9;
+                  new_fine = (uint32_t) (corr/5e-8*0x3ffe);
+               }
+               if (new_fine > 0x3ffe) new_fine = 0x3fff;
+            } else if (edge == 0) {
+               new_fine = (uint32_t) (corr/5e-12);
+               if (new_fine >= 1000) new_fine = 1000;
+            } else {
+               if (rec.tot_shift > 0.) {
+                  corr += rec.tot_shift*1e-9;
+                  unsigned cc = (unsigned) (corr/5e-9);
+                  corr -= cc*5e-9;
+                  // only lower 11 bits and overflow of coarse counter are relevant
+                  corr_coarse = (cc > 0x7ff) ? 0x800 + (cc & 0x7ff) : cc;
+               } else if (rec.tot_shift < 0.) {
+                  corr += rec.tot_shift*1e-9;
+                  // number of coarse units to shift, beyond 0x7ff hit always fails
+                  while ((corr < 0.) && (corr_coarse > -0x800)) { corr += 5e-9; corr_coarse--; }
+               }
+
+               new_fine = (uint32_t) (corr/10e-12);
+               if (new_fine >= 500) new_fine = 500;
+            }
+
+            tgt->fine = new_fine;
+            tgt->coarse = corr_coarse;
+         }
+      }
+   }
+
+   fTransformTableMode = mode;
+   fTransformTableDirty = false;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////
 /// Method transform TDC data, if output specified, use it otherwise change original data
 
@@ -1197,6 +1366,8 @@ unsigned hadaq::TdcProcessor::TransformTdcData(hadaqs::RawSubevent* sub, uint32_
    // do nothing in case of empty TDC sub-sub-event
    if (datalen == 0) return 0;
 
+   base::ProfilerGuard grd(fProfiler, "transform", 4);
+
    hadaq::TdcMessage msg, calibr;
 
    unsigned tgtindx0 = tgtindx, cnt = 0,
@@ -1214,6 +1385,10 @@ unsigned hadaq::TdcProcessor::TransformTdcData(hadaqs::RawSubevent* sub, uint32_
       use_in_calibr = true;
    }
 
+   // when neither calibration statistic nor histograms are required, use fast kernel
+   if (gFastTransform && !use_in_calibr && !fPairedChannels && (HistFillLevel() < 2))
+      return TransformTdcDataFast(sub, rawdata, indx, datalen, tgt, tgtindx);
+
    // do not check progress value too often - this requires extra computations
    bool check_calibr_progress = false;
    if (use_in_calibr) {
@@ -1230,6 +1405,10 @@ unsigned hadaq::TdcProcessor::TransformTdcData(hadaqs::RawSubevent* sub, uint32_
    bool isrising, hard_failure, fast_loop = HistFillLevel() < 2, changed_msg;
    double corr, ch0tm = 0;
 
+   // per-channel histograms may be filled only for sampled events
+   bool sampled = SelectSampledEvent();
+   double sampled_w = SampledWeight();
+
    // if (fAllTotMode==1) printf("%s dtrig %d do_tot %d dofalling %d\n", GetName(), is_0d_trig, do_tot, DoFallingEdge());
 
    while (datalen-- > 0) {
@@ -1257,6 +1436,9 @@ unsigned hadaq::TdcProcessor::TransformTdcData(hadaqs::RawSubevent* sub, uint32_
             epochcnt++;
          } else if (kind == hadaq::tdckind_Calibr) {
             DefFastFillH1(fMsgsKind, kind >> 29, 1);
+            // store pending calibration message, otherwise its place in output remains undefined
+            if ((calibr_num == 1) && tgtraw && calibr_indx)
+               tgtraw[calibr_indx] = HADAQ_SWAP4(calibr.getData());
             calibr.assign(msg.getData()); // copy message into
             calibr_indx = tgtindx;
             calibr_num = 0;
@@ -1473,9 +1655,9 @@ unsigned hadaq::TdcProcessor::TransformTdcData(hadaqs::RawSubevent* sub, uint32_
          CreateChannelHistograms(chid);
 
       if (isrising) {
-         FastFillH1(rec.fRisingFine, fine);
+         if (sampled) FastFillH1(rec.fRisingFine, fine, sampled_w);
       } else {
-         FastFillH1(rec.fFallingFine, fine);
+         if (sampled) FastFillH1(rec.fFallingFine, fine, sampled_w);
       }
    }
 
@@ -1485,6 +1667,8 @@ unsigned hadaq::TdcProcessor::TransformTdcData(hadaqs::RawSubevent* sub, uint32_
       calibr_indx = 0;
    }
 
+   fNumHits += hitcnt;
+
    if (hitcnt) DefFastFillH1(fMsgsKind, hadaq::tdckind_Hit >> 29, hitcnt);
    if (hit1cnt) DefFastFillH1(fMsgsKind, hadaq::tdckind_Hit1 >> 29, hit1cnt);
    if (epochcnt) DefFastFillH1(fMsgsKind, hadaq::tdckind_Epoch >> 29, epochcnt);
@@ -1537,19 +1721,161 @@ unsigned hadaq::TdcProcessor::TransformTdcData(hadaqs::RawSubevent* sub, uint32_
          rec.rising_new_value = false;
       }
 
-   if (check_calibr_progress) {
-      fCalibrProgress = TestCanCalibrate(true, &fCalibrStatus);
-      fCalibrQuality = (fCalibrProgress > 2) ? 0.9 : 0.7 + fCalibrProgress*0.1;
+   if (check_calibr_progress && fDelayedCalibr)
+      fPendingCalibrCheck = true;
+   else if (check_calibr_progress)
+      CheckCalibrProgress();
+
+   return tgt ? (tgtindx - tgtindx0) : cnt;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Check progress of calibration statistic
+/// Produces preliminary calibration for ToT and performs auto calibration when enough statistic collected
+
+void hadaq::TdcProcessor::CheckCalibrProgress()
+{
+   fCalibrProgress = TestCanCalibrate(true, &fCalibrStatus);
+   fCalibrQuality = (fCalibrProgress > 2) ? 0.9 : 0.7 + fCalibrProgress*0.1;
+
+   if ((fAllTotMode == 0) && (fCalibrProgress >= 0.5)) {
+      ProduceCalibration(false, fUseLinear, false, true);
+      fAllTotMode = 1; // now can start accumulate ToT values
+   }
+
+   if ((fCalibrProgress>=1.) && fAutoCalibr) PerformAutoCalibrate();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Fast variant of TransformTdcData
+/// Uses precomputed integer correction tables and processes contiguous runs of hit messages in one loop.
+/// Produces exactly same output as generic code, but does not accumulate calibration statistic
+/// and does not fill per-channel histograms
+
+unsigned hadaq::TdcProcessor::TransformTdcDataFast(hadaqs::RawSubevent* sub, uint32_t *rawdata, unsigned indx, unsigned datalen, hadaqs::RawSubevent* tgt, unsigned tgtindx)
+{
+   unsigned mode = tgt ? 2 : 1;
+   if (fTransformTableDirty || (fTransformTableMode != mode))
+      BuildTransformTable(mode);
+
+   const TransformEntry *table = fTransformTable.data();
+   const unsigned numch = NumChannels(), numfine = fNumFineBins, rowlen = numfine + 1;
+
+   hadaq::TdcMessage calibr;
+
+   unsigned tgtindx0 = tgtindx, hitcnt = 0, hit1cnt = 0, epochcnt = 0, errcnt = 0,
+            calibr_indx = 0, calibr_num = 0;
 
-      if ((fAllTotMode == 0) && (fCalibrProgress >= 0.5)) {
-         ProduceCalibration(false, fUseLinear, false, true);
-         fAllTotMode = 1; // now can start accumulate ToT values
+   uint32_t *src = rawdata + indx, *end = src + datalen,
+            *tgtraw = tgt ? (uint32_t *) tgt->RawData() : nullptr;
+
+   bool swapped = sub->IsSwapped();
+
+   while (src < end) {
+      uint32_t idata = *src, data = HADAQ_SWAP4(idata), kind = data & tdckind_Mask;
+
+      if ((kind != tdckind_Hit) && (kind != tdckind_Hit1)) {
+         if (kind == tdckind_Epoch) {
+            epochcnt++;
+         } else {
+            DefFastFillH1(fMsgsKind, kind >> 29, 1);
+            if (kind == tdckind_Calibr) {
+               // store pending calibration message, otherwise its place in output remains undefined
+               if ((calibr_num == 1) && tgtraw && calibr_indx)
+                  tgtraw[calibr_indx] = HADAQ_SWAP4(calibr.getData());
+               calibr.assign(data);
+               calibr_indx = tgtindx;
+               calibr_num = 0;
+            }
+         }
+
+         if (tgtraw) tgtraw[tgtindx++] = idata;
+         src++;
+         continue;
       }
 
-      if ((fCalibrProgress>=1.) && fAutoCalibr) PerformAutoCalibrate();
+      // process contiguous run of hit messages
+      do {
+         if (kind == tdckind_Hit) hitcnt++; else hit1cnt++;
+
+         unsigned chid = (data >> 22) & 0x7F, fine = (data >> 12) & 0x3FF;
+         bool isrising = (data & (1 << 11)) != 0, hard_failure = false;
+
+         if (chid >= numch) {
+            hard_failure = true;
+            chid = 0; // use dummy channel
+            errcnt++;
+         }
+
+         if (fine >= numfine) {
+            hard_failure = true;
+            errcnt++;
+         }
+
+         const TransformEntry &entry = table[(chid*2 + (isrising ? 0 : 1))*rowlen + (hard_failure ? numfine : fine)];
+
+         if (!tgtraw) {
+            uint32_t new_fine = entry.fine, coarse = data & 0x7FF;
+
+            if (entry.coarse > 0) {
+               if ((unsigned) entry.coarse > coarse)
+                  new_fine |= 0x200; // indicate that corrected time belongs to the previous epoch
+               coarse -= entry.coarse;
+            } else if (entry.coarse < 0) {
+               coarse += (unsigned) -entry.coarse;
+               if (coarse > 0x7FF) {
+                  coarse = 0x7FF;
+                  hard_failure = true;
+               }
+            }
+
+            if (hard_failure) new_fine = 0x3ff;
+
+            data = (data & ~(tdckind_Mask | (0x3FF << 12) | 0x7FF)) | tdckind_Hit2 | (new_fine << 12) | (coarse & 0x7FF);
+
+            *src = swapped ? HADAQ_SWAP4(data) : data;
+         } else {
+            if (calibr_indx == 0) {
+               calibr_indx = tgtindx++;
+               calibr_num = 0;
+               calibr.assign(tdckind_Calibr);
+            }
+
+            calibr.setCalibrFine(calibr_num++, hard_failure ? 0x3fff : entry.fine);
+
+            if (calibr_num == 2) {
+               tgtraw[calibr_indx] = HADAQ_SWAP4(calibr.getData());
+               calibr_indx = 0;
+               calibr_num = 0;
+            }
+
+            tgtraw[tgtindx++] = idata;
+         }
+
+         if (++src >= end) break;
+
+         idata = *src;
+         data = HADAQ_SWAP4(idata);
+         kind = data & tdckind_Mask;
+      } while ((kind == tdckind_Hit) || (kind == tdckind_Hit1));
    }
 
-   return tgt ? (tgtindx - tgtindx0) : cnt;
+   // if last calibration message not yet copied into output
+   if ((calibr_num == 1) && tgtraw && calibr_indx)
+      tgtraw[calibr_indx] = HADAQ_SWAP4(calibr.getData());
+
+   fNumHits += hitcnt;
+
+   if (hitcnt) DefFastFillH1(fMsgsKind, hadaq::tdckind_Hit >> 29, hitcnt);
+   if (hit1cnt) DefFastFillH1(fMsgsKind, hadaq::tdckind_Hit1 >> 29, hit1cnt);
+   if (epochcnt) DefFastFillH1(fMsgsKind, hadaq::tdckind_Epoch >> 29, epochcnt);
+
+   if (fMsgPerBrd) FastFillH1(*fMsgPerBrd, fSeqeunceId, datalen);
+   // fill number of "good" hits
+   if (hitcnt && fHitsPerBrd) FastFillH1(*fHitsPerBrd, fSeqeunceId, hitcnt);
+   if (errcnt && fErrPerBrd) FastFillH1(*fErrPerBrd, fSeqeunceId, errcnt);
+
+   return tgt ? (tgtindx - tgtindx0) : datalen;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -1823,12 +2149,88 @@ unsigned BubbleCheckCahit(unsigned* bubble, int &p1, int &p2, bool debug = false
 }
 
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Returns true if any histogram, filled for hits in the first scan, exists
+/// Used to select scan kernel without histograms filling
+
+bool hadaq::TdcProcessor::HasScanHistos() const
+{
+   // channels histograms only created with high fill level
+   if (HistFillLevel() > 2)
+      return true;
+
+   if (fChannels || fHits || fAllFine || fAllCoarse || fCorrHits || fHitsRate ||
+       fhTotVsChannel || fhTotMinusCounter || fhTotMoreCounter || fhSigmaTotVsChannel ||
+       fhRisingPrevDiffVsChannel)
+      return true;
+
+   // HLD and TRB provide pointers on own handles, which are null when histograms not created
+   auto exists = [](base::H2handle *h) { return h && *h; };
+
+   if (exists(fChHitsPerHld) || exists(fChCorrPerHld) || exists(fCalHitsPerBrd) || exists(fToTPerTDCChannel) ||
+       exists(fDevPerTDCChannel) || exists(fTPreviousPerTDCChannel) || exists(fToTCountPerTDCChannel))
+      return true;
+
+   for (auto &rec : fCh)
+      if (rec.fRisingFine || rec.fFallingFine || rec.fRisingRef || rec.fTot)
+         return true;
+
+   return false;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Scan all messages, find reference signals
 /// Major data analysis method
+/// Selects specialised kernel once per buffer - depending on scan kind, store kind, histograms filling
+/// and time options. Buffer format and temperature compensation are not part of the selection:
+/// format only changes the setup before the messages loop and temperature compensation
+/// is already included in the compiled calibration table
 
 bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
 {
+   typedef bool (TdcProcessor::*ScanKernel)(const base::Buffer &);
+
+   static const ScanKernel kernels[5][2][2] = {
+      { { &TdcProcessor::DoBufferScanT<true, 0, false, false>, &TdcProcessor::DoBufferScanT<true, 0, false, true> },
+        { &TdcProcessor::DoBufferScanT<true, 0, true, false>, &TdcProcessor::DoBufferScanT<true, 0, true, true> } },
+      { { &TdcProcessor::DoBufferScanT<true, 1, false, false>, &TdcProcessor::DoBufferScanT<true, 1, false, true> },
+        { &TdcProcessor::DoBufferScanT<true, 1, true, false>, &TdcProcessor::DoBufferScanT<true, 1, true, true> } },
+      { { &TdcProcessor::DoBufferScanT<true, 2, false, false>, &TdcProcessor::DoBufferScanT<true, 2, false, true> },
+        { &TdcProcessor::DoBufferScanT<true, 2, true, false>, &TdcProcessor::DoBufferScanT<true, 2, true, true> } },
+      { { &TdcProcessor::DoBufferScanT<true, 3, false, false>, &TdcProcessor::DoBufferScanT<true, 3, false, true> },
+        { &TdcProcessor::DoBufferScanT<true, 3, true, false>, &TdcProcessor::DoBufferScanT<true, 3, true, true> } },
+      { { &TdcProcessor::DoBufferScanT<true, 4, false, false>, &TdcProcessor::DoBufferScanT<true, 4, false, true> },
+        { &TdcProcessor::DoBufferScanT<true, 4, true, false>, &TdcProcessor::DoBufferScanT<true, 4, true, true> } }
+   };
+
+   bool timeopt = !gScanKernels || fIsCustomMhz || fCompensateEpochReset;
+
+   if (!first_scan)
+      return timeopt ? DoBufferScanT<false, 0, false, true>(buf) : DoBufferScanT<false, 0, false, false>(buf);
+
+   unsigned store = 0;
+   if (IsTriggeredAnalysis() && IsStoreEnabled() && mgr()->HasTrigEvent() && (GetStoreKind() < 5))
+      store = GetStoreKind();
+
+   bool hists = !gScanKernels || HasScanHistos();
+
+   return (this->*kernels[store][hists ? 1 : 0][timeopt ? 1 : 0])(buf);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Scan kernel, specialised for scan kind, store kind, histograms filling and time options
+/// With HISTS=true all histograms checked at runtime - like generic code
+/// With TIMEOPT=true custom frequency and epoch reset compensation checked at runtime
+
+template<bool FIRST, unsigned STORE, bool HISTS, bool TIMEOPT>
+bool hadaq::TdcProcessor::DoBufferScanT(const base::Buffer& buf)
+{
+   const bool first_scan = FIRST;
+
+   // custom frequency and epoch reset compensation checked only in kernels selected for them
+   const bool custom_mhz = TIMEOPT && fIsCustomMhz,
+              compensate_epoch = TIMEOPT && fCompensateEpochReset;
+
    if (buf.null()) {
       if (first_scan) printf("%s Something wrong - empty buffer should not appear in the first scan\n", GetName());
       return false;
@@ -1860,33 +2262,46 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
    // if data could be used for TOT calibration
    bool do_tot = (use_for_calibr > 0) && ((buf_kind == 0xD) || gUseAsDTrig) && DoFallingEdge();
 
-   // use temperature compensation only when temperature available
-   bool do_temp_comp = fCalibrUseTemp && (fCurrentTemp > 0) && (fCalibrTemp > 0) && (fabs(fCurrentTemp - fCalibrTemp) < 30.);
+   // compiled calibration table depends from temperature, rebuild it when required
+   CheckCalibrTable();
 
    unsigned cnt = 0, hitcnt = 0;
 
    bool iserr = false, isfirstepoch = false, rawprint = false, missinghit = false, dostore = false;
 
-   if (first_scan && IsTriggeredAnalysis() && IsStoreEnabled() && mgr()->HasTrigEvent()) {
+   // per-channel histograms filled only for sampled events, selected in FirstBufferScan
+   const bool sampled = IsSampledEvent();
+   const double sampled_w = SampledWeight();
+
+   if ((STORE > 0) && first_scan && IsTriggeredAnalysis() && IsStoreEnabled() && mgr()->HasTrigEvent()) {
       dostore = true;
-      switch (GetStoreKind()) {
+      switch (STORE) {
          case 1: {
-            auto subevnt = new hadaq::TdcSubEvent(buf.datalen()/6);
+            auto subevnt = new hadaq::TdcSubEvent;
             mgr()->AddToTrigEvent(GetName(), subevnt);
-            pStoreVect = subevnt->vect_ptr();
+            subevnt->AttachArena(mgr()->GetTrigEventArena(), buf.datalen()/6);
+            pEventVect = subevnt;
             break;
          }
          case 2: {
-            auto subevnt = new hadaq::TdcSubEventFloat(buf.datalen()/6);
+            auto subevnt = new hadaq::TdcSubEventFloat;
             mgr()->AddToTrigEvent(GetName(), subevnt);
+            subevnt->AttachArena(mgr()->GetTrigEventArena(), buf.datalen()/6);
             pEventFloat = subevnt;
-            pStoreFloat = subevnt->vect_ptr();
             break;
          }
          case 3: {
-            auto subevnt = new hadaq::TdcSubEventDouble(buf.datalen()/6);
+            auto subevnt = new hadaq::TdcSubEventDouble;
+            mgr()->AddToTrigEvent(GetName(), subevnt);
+            subevnt->AttachArena(mgr()->GetTrigEventArena(), buf.datalen()/6);
+            pEventDouble = subevnt;
+            break;
+         }
+         case 4: {
+            auto subevnt = new hadaq::TdcSubEventInt;
             mgr()->AddToTrigEvent(GetName(), subevnt);
-            pStoreDouble = subevnt->vect_ptr();
+            subevnt->AttachArena(mgr()->GetTrigEventArena(), buf.datalen()/6);
+            pEventInt = subevnt;
             break;
          }
 
@@ -1899,38 +2314,51 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
    uint32_t first_epoch = 0;
 
    unsigned epoch_shift = 0;
-   if (fCompensateEpochReset) {
+   if (compensate_epoch) {
       if (first_scan) buf().user_tag = fCompensateEpochCounter;
       epoch_shift = buf().user_tag;
    }
 
-   double localtm = 0., minimtm = 0., ch0time = 0.;
+   double localtm = 0., minimtm = 0., maximtm = 0., ch0time = 0.;
    bool ch0_is_ref = !IsRegularChannel0(); // is channel0 contain reference (trigger) time
 
 
    TdcIterator& iter = first_scan ? fIter1 : fIter2;
 
-   if (buf().format == 0)
-      iter.assign((uint32_t*) buf.ptr(4), buf.datalen()/4-1, false);
-   else if (buf().format == 3) {
+   uint32_t *rawptr = (uint32_t *) buf.ptr(0);
+   unsigned rawlen = buf.datalen()/4;
+   bool rawswapped = false;
+
+   if (buf().format == 0) {
+      rawptr = (uint32_t*) buf.ptr(4);
+      rawlen = rawlen > 0 ? rawlen - 1 : 0;
+   } else if (buf().format == 3) {
       ch0_is_ref = false;
       uint32_t epoch0 = 0, coarse0 = 0;
       memcpy(&epoch0, buf.ptr(0), 4);
       memcpy(&coarse0, buf.ptr(4), 4);
-      iter.assign((uint32_t*) buf.ptr(8), buf.datalen()/4 - 2, false);
+      rawptr = (uint32_t*) buf.ptr(8);
+      rawlen = rawlen > 1 ? rawlen - 2 : 0;
 
       // do not set current epoch - must be presented in the data
       // iter.setCurEpoch(epoch0);
 
-      if (fIsCustomMhz) {
+      if (custom_mhz) {
          ch0time = ((((uint64_t) epoch0) << 12) | (coarse0 << 1)) * 1000. / fCustomMhz * 1e-9;
       } else {
          ch0time = iter.convertTime(epoch0, coarse0);
       }
       if (pEventFloat)
          pEventFloat->SetTriggerTime(ch0time);
+      if (pEventInt)
+         pEventInt->SetTriggerTime(ch0time);
    } else
-      iter.assign((uint32_t*) buf.ptr(0), buf.datalen()/4, buf().format == 2);
+      rawswapped = (buf().format == 2);
+
+   iter.assign(rawptr, rawlen, rawswapped);
+
+   // decode all messages at once, for every message index of last epoch message is resolved
+   unsigned nmsgs = fDecoder.Decode(rawptr, rawlen, rawswapped);
 
    unsigned help_index = 0;
 
@@ -1938,22 +2366,24 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
    hadaq::TdcMessage calibr;
    unsigned ncalibr = 20, temp = 0, lowid = 0, highid = 0; // clear indicate that no calibration data present
 
-   if (fSkipTdcMessages > 0) {
-      unsigned skipcnt = fSkipTdcMessages;
-      while (skipcnt-- > 0)
-         if (!iter.next()) break;
-   }
+   // first processed message expected to be header, epochs after it are compensated for reset
+   unsigned first_indx = fSkipTdcMessages < nmsgs ? fSkipTdcMessages : nmsgs;
+
+   // with IsEveryEpoch() each epoch message can be used only by single hit
+   int used_epoch = -1;
 
    // printf("%s start processing buf %u\n", GetName(), buf.datalen());
 
-   while (iter.next()) {
+   for (unsigned indx = first_indx; indx < nmsgs; ++indx) {
+
+      msg.assign(fDecoder.word(indx));
 
       // if (!first_scan) msg.print();
 
       cnt++;
 
       if (first_scan)
-         FastFillH1(fMsgsKind, msg.getKind() >> 29);
+         FastFillH1(fMsgsKind, fDecoder.kind(indx));
 
       if (cnt == 1) {
          if (!msg.isHeaderMsg()) {
@@ -1974,14 +2404,12 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
          continue;
       }
 
-      if (msg.isEpochMsg()) {
+      if (fDecoder.kind(indx) == TdcDecoder::kEpoch) {
 
-         uint32_t ep = iter.getCurEpoch();
+         uint32_t ep = msg.getEpochValue();
 
-         if (fCompensateEpochReset) {
+         if (compensate_epoch)
             ep += epoch_shift;
-            iter.setCurEpoch(ep);
-         }
 
          // second message always should be epoch of channel 0
          if (cnt == 2) {
@@ -1994,7 +2422,7 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
          continue;
       }
 
-      if (msg.isCalibrMsg()) {
+      if (fDecoder.kind(indx) == TdcDecoder::kCalibr) {
          if ((use_for_calibr == 0) && !gIgnoreCalibrMsgs) {
             // take into account calibration messages only when data not used for calibration
             // or when one wants to repair message modified by HADES DAQ
@@ -2004,13 +2432,23 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
          continue;
       }
 
-      if (msg.isHitMsg()) {
-         unsigned chid = msg.getHitChannel();
-         unsigned fine = msg.getHitTmFine();
-         unsigned coarse = msg.getHitTmCoarse();
-         bool isrising = msg.isHitRisingEdge();
+      if (fDecoder.isHit(indx)) {
+         unsigned chid = fDecoder.channel(indx);
+         unsigned fine = fDecoder.fine(indx);
+         unsigned coarse = fDecoder.coarse(indx);
+         bool isrising = fDecoder.isRising(indx);
          unsigned bad_fine = 0x3FF;
 
+         int epindx = fDecoder.epochIndex(indx);
+         bool has_epoch = (epindx >= 0) && (epindx != used_epoch);
+         uint32_t epoch = 0;
+         if (has_epoch) {
+            epoch = fDecoder.epochValue(epindx);
+            // epoch messages which are processed in the loop are compensated
+            if (compensate_epoch && (epindx > (int) first_indx))
+               epoch += epoch_shift;
+         }
+
          if (fPairedChannels) {
             if ((chid > 0) && (chid % 2 == 0)) {
                chid--; // previous channel
@@ -2018,15 +2456,14 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
             }
          }
 
-         if (fIsCustomMhz) {
+         if (custom_mhz) {
             unsigned coarse25 = (coarse << 1) | ((fine & 0x200) ? 1 : 0);
             fine = fine & 0x1FF;
             bad_fine = 0x1ff;
-            unsigned epoch = iter.isCurEpoch() ? iter.getCurEpoch() : 0;
 
             localtm = ((epoch << 12) | coarse25) * 1000. / fCustomMhz * 1e-9;
          } else {
-            localtm = iter.getMsgTimeCoarse();
+            localtm = iter.convertTime(epoch, coarse);
          }
 
          if (chid >= NumChannels()) {
@@ -2035,7 +2472,7 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
             continue;
          }
 
-         if (!iter.isCurEpoch()) {
+         if (!has_epoch) {
             // one expects epoch before each hit message, if not data are corrupted and we can ignore it
             ADDERROR(errEpoch, "Missing epoch for hit from channel %u", chid);
             FastFillH1(fMsgsKind, 6); // artificial message kind
@@ -2045,7 +2482,7 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
          }
 
          if (IsEveryEpoch())
-            iter.clearCurEpoch();
+            used_epoch = epindx;
 
          if (fine == bad_fine) {
             if (first_scan) {
@@ -2101,13 +2538,8 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
                if (isrising && fhRaisingFineCalibr) DefFillH2(fhRaisingFineCalibr, chid, calibr_fine, 1.);
                if (!isrising) corr *= 10.; // range for falling edge is 50 ns.
             } else {
-               corr = ExtractCalibr(isrising ? rec.rising_calibr : rec.falling_calibr, fine);
-
-               // apply TOT shift for falling edge (should it be also temp dependent)?
-               if (!isrising) corr += rec.tot_shift*1e-9;
-
-               // negative while value should be add to the stamp
-               if (do_temp_comp) corr -= (fCurrentTemp + fTempCorrection - fCalibrTemp) * rec.time_shift_per_grad * 1e-9;
+               // compiled table already includes TOT shift and temperature compensation
+               corr = GetTableCalibr(chid, isrising, fine);
             }
          }
 
@@ -2120,6 +2552,8 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
             ch0time = (gTimeRefKind == 3) ? localtm + corr : localtm;
             if (pEventFloat)
                pEventFloat->SetTriggerTime(ch0time);
+            if (pEventInt)
+               pEventInt->SetTriggerTime(ch0time);
          }
 
          switch(gTimeRefKind) {
@@ -2151,7 +2585,7 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
             if ((chid == 0) || (!ch0_is_ref && (cnt < 3)))  {
                if (fLastRateTm < 0) fLastRateTm = ch0time;
                if (ch0time - fLastRateTm > 1) {
-                  FillH1(fHitsRate, fRateCnt / (ch0time - fLastRateTm));
+                  if (HISTS) FillH1(fHitsRate, fRateCnt / (ch0time - fLastRateTm));
                   fLastRateTm = ch0time;
                   fRateCnt = 0;
                }
@@ -2160,22 +2594,24 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
             }
 
             // ensure that histograms are created
-            if ((HistFillLevel() > 2) && !rec.fRisingFine)
+            if (HISTS && (HistFillLevel() > 2) && !rec.fRisingFine)
                CreateChannelHistograms(chid);
 
             bool use_fine_for_stat = true;
-            if (!fIsCustomMhz && !msg.isHit0Msg())
+            if (!custom_mhz && !msg.isHit0Msg())
                use_fine_for_stat = false;
             else if (use_for_calibr == 3)
                use_fine_for_stat = (gTrigDWindowLow <= localtm*1e9) && (localtm*1e9 <= gTrigDWindowHigh);
 
-            FastFillH1(fChannels, chid);
-            DefFillH1(fHits, (chid + (isrising ? 0.25 : 0.75)), 1.);
-            if (raw_hit) DefFillH2(fAllFine, chid, fine, 1.);
-            DefFillH2(fAllCoarse, chid, coarse, 1.);
-            if (fChHitsPerHld) DefFillH2(*fChHitsPerHld, fHldId, chid, 1);
+            if (HISTS) {
+               FastFillH1(fChannels, chid);
+               DefFillH1(fHits, (chid + (isrising ? 0.25 : 0.75)), 1.);
+               if (raw_hit) DefFillH2(fAllFine, chid, fine, 1.);
+               DefFillH2(fAllCoarse, chid, coarse, 1.);
+               if (fChHitsPerHld) DefFillH2(*fChHitsPerHld, fHldId, chid, 1);
+            }
 
-            if (msg.isHit1Msg()) {
+            if (HISTS && msg.isHit1Msg()) {
                DefFillH1(fCorrHits, chid, 1);
                if (fChCorrPerHld) DefFillH2(*fChCorrPerHld, fHldId, chid, 1);
             }
@@ -2188,7 +2624,7 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
                      case 3:
                         rec.rising_stat[fine]++;
                         rec.all_rising_stat++;
-                        if (fCalHitsPerBrd) DefFillH2(*fCalHitsPerBrd, fSeqeunceId, chid, 1.); // accumulate only rising edges
+                        if (HISTS && fCalHitsPerBrd) DefFillH2(*fCalHitsPerBrd, fSeqeunceId, chid, 1.); // accumulate only rising edges
                         break;
                      case 2:
                         rec.last_rising_fine = fine;
@@ -2196,14 +2632,14 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
                   }
                }
 
-               if (raw_hit) FastFillH1(rec.fRisingFine, fine);
+               if (HISTS && raw_hit && sampled) FastFillH1(rec.fRisingFine, fine, sampled_w);
 
                rec.rising_cnt++;
 
                bool print_cond = false;
 
                // JAM 7-12-21: better plot dt against ref channel?
-               if(((chid > 0) || !ch0_is_ref) && ch0time && fhRisingPrevDiffVsChannel) {
+               if (HISTS && ((chid > 0) || !ch0_is_ref) && ch0time && fhRisingPrevDiffVsChannel) {
                   double refdiff = (localtm - ch0time) * 1e9;
                   if(refdiff > -1000 && refdiff < 1000) {
                      DefFillH2(fhRisingPrevDiffVsChannel, chid, refdiff, 1.);
@@ -2238,7 +2674,7 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
                if ((chid != 0) && (rec.refch == 0) && (rec.reftdc == GetID()) && use_for_ref && ch0_is_ref && !IsRegularChannel0()) {
                   rec.rising_ref_tm = localtm;
 
-                  DefFillH1(rec.fRisingRef, (localtm*1e9), 1.);
+                  if (HISTS && sampled) DefFillH1(rec.fRisingRef, (localtm*1e9), sampled_w);
 
                   if (IsPrintRawData() || print_cond)
                   printf("Difference rising %04x:%02u\t %04x:%02u\t %12.3f\t %12.3f\t %7.3f  coarse %03x - %03x = %4d  fine %03x %03x \n",
@@ -2263,60 +2699,66 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
                   }
                }
 
-               if (raw_hit) FastFillH1(rec.fFallingFine, fine);
+               if (HISTS && raw_hit && sampled) FastFillH1(rec.fFallingFine, fine, sampled_w);
 
                rec.falling_cnt++;
 
                if (rec.rising_new_value && (rec.rising_last_tm != 0) && use_fine_for_stat) {
 
                   double tot = (localtm - rec.rising_last_tm)*1e9;
-                  // TODO chid
-                  DefFillH2(fhTotVsChannel, chid, tot, 1.);
 
-                  if (fhTotMinusCounter && (tot < 0. )) {
-                      DefFillH1(fhTotMinusCounter, chid, 1.);
-                  }
-                  if (fhTotMoreCounter && (tot > fTotUpperLimit)) {
-                      DefFillH1(fhTotMoreCounter, chid, 1.);
-                  }
-                  DefFillH1(rec.fTot, tot, 1.);
                   rec.rising_new_value = false;
-                  // JAM 11-2021: add ToT sigma histogram here:
-                  double totvar = (tot - fToTvalue) * (tot - fToTvalue);
-                  double totsigma = sqrt(totvar);
-
-                  DefFillH2(fhSigmaTotVsChannel, chid, totsigma, 1.);
-
-                  // here put something new for global histograms JAM2021:
-                  if (fToTPerTDCChannel) {
-
-                     // we first always show most recent value, no averaging here;
-                     if((tot > 0) && (tot < 1000)) // JAM 7-12-21 suppress noise fakes
-                        SetH2Content(*fToTPerTDCChannel, fHldId, chid, tot);
-
-                     // TODO: later get previous statistics for this channel and weight new entry correctly for averaging: (performance?!)
-//                        int nBins1, nBins2;
-//                        GetH2NBins(fhTotVsChannel, nBins1, nBins2);
-//                        double nEntries = 0.;
-//                        for (int i = 0; i < nBins2; i++){
-//                           nEntries += GetH2Content(fhTotVsChannel, chid, i);
-//                        }
-//                        double oldtot= GetH2Content(*fToTPerTDCChannel, fHldId, chid);
-//                        double averagetot=tot;
-//                        if (nEntries) averagetot= (oldtot * (nEntries-1) + tot) / nEntries;
-//                        SetH2Content(*fToTPerTDCChannel, fHldId, chid, averagetot);
-                  }
 
-                  // JAM 11-12-2023: just a scaler how many ToTs we've got for each channel:
-                  if (fToTCountPerTDCChannel) {
-                      DefFastFillH2(*fToTCountPerTDCChannel, fHldId, chid);
+                  if (HISTS) {
+                     // TODO chid
+                     DefFillH2(fhTotVsChannel, chid, tot, 1.);
+
+                     if (fhTotMinusCounter && (tot < 0. )) {
+                         DefFillH1(fhTotMinusCounter, chid, 1.);
+                     }
+                     if (fhTotMoreCounter && (tot > fTotUpperLimit)) {
+                         DefFillH1(fhTotMoreCounter, chid, 1.);
+                     }
+                     if (sampled) DefFillH1(rec.fTot, tot, sampled_w);
+                     // JAM 11-2021: add ToT sigma histogram here:
+                     double totvar = (tot - fToTvalue) * (tot - fToTvalue);
+                     double totsigma = sqrt(totvar);
+
+                     DefFillH2(fhSigmaTotVsChannel, chid, totsigma, 1.);
+
+                     // here put something new for global histograms JAM2021:
+                     if (fToTPerTDCChannel) {
+
+                        // we first always show most recent value, no averaging here;
+                        if((tot > 0) && (tot < 1000)) // JAM 7-12-21 suppress noise fakes
+                           SetH2Content(*fToTPerTDCChannel, fHldId, chid, tot);
+
+                        // TODO: later get previous statistics for this channel and weight new entry correctly for averaging: (performance?!)
+   //                        int nBins1, nBins2;
+   //                        GetH2NBins(fhTotVsChannel, nBins1, nBins2);
+   //                        double nEntries = 0.;
+   //                        for (int i = 0; i < nBins2; i++){
+   //                           nEntries += GetH2Content(fhTotVsChannel, chid, i);
+   //                        }
+   //                        double oldtot= GetH2Content(*fToTPerTDCChannel, fHldId, chid);
+   //                        double averagetot=tot;
+   //                        if (nEntries) averagetot= (oldtot * (nEntries-1) + tot) / nEntries;
+   //                        SetH2Content(*fToTPerTDCChannel, fHldId, chid, averagetot);
+                     }
+
+                     // JAM 11-12-2023: just a scaler how many ToTs we've got for each channel:
+                     if (fToTCountPerTDCChannel) {
+                         DefFastFillH2(*fToTCountPerTDCChannel, fHldId, chid);
+                     }
+
                   }
 
+                  // counters updated also when histogram is not created, used in ToT calibration
                   if(fDevPerTDCChannel && (tot > 0) && (tot < 1000)) { // JAM 7-12-21 suppress noise fakes
-                     rec.tot_dev += totvar; // JAM misuse  this data field to get overall sigma of file
+                     rec.tot_dev += (tot - fToTvalue) * (tot - fToTvalue); // JAM misuse  this data field to get overall sigma of file
                      rec.tot0d_cnt++; // JAM misuse calibration counter here to evaluate sigma
                      double currentsigma = sqrt(rec.tot_dev/rec.tot0d_cnt);
-                     if(currentsigma<10)
+                     if(HISTS && (currentsigma<10))
                         SetH2Content(*fDevPerTDCChannel, fHldId, chid,  currentsigma);
                   }
 
@@ -2329,20 +2771,28 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
                hitcnt++;
                if ((minimtm == 0.) || (localtm < minimtm))
                   minimtm = localtm;
+               if ((hitcnt == 1) || (localtm > maximtm))
+                  maximtm = localtm;
 
-               if (dostore)
-                  switch(GetStoreKind()) {
+               if ((STORE > 0) && dostore)
+                  switch(STORE) {
                      case 1:
-                        pStoreVect->emplace_back(msg, (chid > 0) || !ch0_is_ref ? localtm : ch0time);
+                        pEventVect->EmplaceMsg(msg, (chid > 0) || !ch0_is_ref ? localtm : ch0time);
                         break;
                      case 2:
                         if ((chid > 0) || !ch0_is_ref)
-                           pStoreFloat->emplace_back(chid, isrising, localtm*1e9);
+                           pEventFloat->EmplaceMsg(chid, isrising, localtm*1e9);
                         if (pEventFloat)
                            pEventFloat->SetTriggerTime(ch0time);
                         break;
                      case 3:
-                        pStoreDouble->emplace_back(chid, isrising, ch0time + localtm);
+                        pEventDouble->EmplaceMsg(chid, isrising, ch0time + localtm);
+                        break;
+                     case 4:
+                        if ((chid > 0) || !ch0_is_ref)
+                           pEventInt->EmplaceMsg(chid, isrising, hadaq::MessageInt::ToStamp(localtm));
+                        if (pEventInt)
+                           pEventInt->SetTriggerTime(ch0time);
                         break;
                      default: break;
                   }
@@ -2375,6 +2825,10 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
                   case 3:
                      AddMessage(indx, (hadaq::TdcSubEventDouble *) fGlobalMarks.item(indx).subev, hadaq::MessageDouble(chid, isrising, globaltm));
                      break;
+                  case 4:
+                     if ((chid > 0) || !ch0_is_ref)
+                        AddIntMessage(indx, chid, isrising, globaltm);
+                     break;
                }
             }
          }
@@ -2422,7 +2876,7 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
    if (isfirstepoch && !iserr) {
       // if we want to compensate epoch reset, use epoch of trigger channel+1
       // +1 to exclude small probability of hits after trigger with epoch+1 value
-      if (fCompensateEpochReset && first_scan)
+      if (compensate_epoch && first_scan)
          fCompensateEpochCounter = first_epoch+1;
 
       iter.setRefEpoch(first_epoch);
@@ -2524,6 +2978,14 @@ bool hadaq::TdcProcessor::DoBufferScan(const base::Buffer& buf, bool first_scan)
 
       buf().local_tm = minimtm;
 
+      // remember hits range, used to skip second scan when no trigger window overlaps with it
+      buf().hits_min_tm = minimtm;
+      buf().hits_max_tm = maximtm;
+      buf().hits_cnt = hitcnt;
+      fNumHits += hitcnt;
+      buf().flush_tm = ch0time;
+      buf().hits_range = true;
+
 //      printf("Proc:%p first scan iserr:%d  minm: %12.9f\n", this, iserr, minimtm*1e-9);
 
       if (fMsgPerBrd) DefFillH1(*fMsgPerBrd, fSeqeunceId, cnt);
@@ -2596,6 +3058,10 @@ bool hadaq::TdcProcessor::DoBuffer5Scan(const base::Buffer& buf, bool first_scan
 
    bool iserr = false, missinghit = false, dostore = false;
 
+   // per-channel histograms filled only for sampled events, selected in FirstBufferScan
+   const bool sampled = IsSampledEvent();
+   const double sampled_w = SampledWeight();
+
    if (first_scan && IsTriggeredAnalysis() && IsStoreEnabled() && mgr()->HasTrigEvent()) {
       dostore = true;
       switch (GetStoreKind()) {
@@ -2604,16 +3070,24 @@ bool hadaq::TdcProcessor::DoBuffer5Scan(const base::Buffer& buf, bool first_scan
             break;
          }
          case 2: {
-            auto subevnt = new hadaq::TdcSubEventFloat(buf.datalen()/3);
+            auto subevnt = new hadaq::TdcSubEventFloat;
             mgr()->AddToTrigEvent(GetName(), subevnt);
+            subevnt->AttachArena(mgr()->GetTrigEventArena(), buf.datalen()/3);
             pEventFloat = subevnt;
-            pStoreFloat = subevnt->vect_ptr();
             break;
          }
          case 3: {
-            auto subevnt = new hadaq::TdcSubEventDouble(buf.datalen()/3);
+            auto subevnt = new hadaq::TdcSubEventDouble;
             mgr()->AddToTrigEvent(GetName(), subevnt);
-            pStoreDouble = subevnt->vect_ptr();
+            subevnt->AttachArena(mgr()->GetTrigEventArena(), buf.datalen()/3);
+            pEventDouble = subevnt;
+            break;
+         }
+         case 4: {
+            auto subevnt = new hadaq::TdcSubEventInt;
+            mgr()->AddToTrigEvent(GetName(), subevnt);
+            subevnt->AttachArena(mgr()->GetTrigEventArena(), buf.datalen()/3);
+            pEventInt = subevnt;
             break;
          }
 
@@ -2621,7 +3095,7 @@ bool hadaq::TdcProcessor::DoBuffer5Scan(const base::Buffer& buf, bool first_scan
       }
    }
 
-   double localtm = 0., minimtm = 0., ch0time = 0.;
+   double localtm = 0., minimtm = 0., maximtm = 0., ch0time = 0.;
 
    auto tu = (dogma::DogmaTu *) buf.ptr();
 
@@ -2638,6 +3112,8 @@ bool hadaq::TdcProcessor::DoBuffer5Scan(const base::Buffer& buf, bool first_scan
 
    if (pEventFloat)
       pEventFloat->SetTriggerTime(ch0time);
+   if (pEventInt)
+      pEventInt->SetTriggerTime(ch0time);
 
    unsigned help_index = 0;
 
@@ -2752,7 +3228,7 @@ bool hadaq::TdcProcessor::DoBuffer5Scan(const base::Buffer& buf, bool first_scan
                }
             }
 
-            if (raw_hit) FastFillH1(rec.fRisingFine, fine);
+            if (raw_hit && sampled) FastFillH1(rec.fRisingFine, fine, sampled_w);
 
             rec.rising_cnt++;
 
@@ -2782,7 +3258,7 @@ bool hadaq::TdcProcessor::DoBuffer5Scan(const base::Buffer& buf, bool first_scan
                }
             }
 
-            if (raw_hit) FastFillH1(rec.fFallingFine, fine);
+            if (raw_hit && sampled) FastFillH1(rec.fFallingFine, fine, sampled_w);
 
             rec.falling_cnt++;
 
@@ -2799,7 +3275,7 @@ bool hadaq::TdcProcessor::DoBuffer5Scan(const base::Buffer& buf, bool first_scan
                if (fhTotMoreCounter && (tot > fTotUpperLimit)) {
                   DefFillH1(fhTotMoreCounter, chid, 1.);
                }
-               DefFillH1(rec.fTot, tot, 1.);
+               if (sampled) DefFillH1(rec.fTot, tot, sampled_w);
                rec.rising_new_value = false;
 
                // JAM 11-2021: add ToT sigma histogram here:
@@ -2837,6 +3313,8 @@ bool hadaq::TdcProcessor::DoBuffer5Scan(const base::Buffer& buf, bool first_scan
             hitcnt++;
             if ((minimtm == 0.) || (localtm < minimtm))
                minimtm = localtm;
+            if ((hitcnt == 1) || (localtm > maximtm))
+               maximtm = localtm;
 
             if (dostore)
                switch(GetStoreKind()) {
@@ -2844,12 +3322,17 @@ bool hadaq::TdcProcessor::DoBuffer5Scan(const base::Buffer& buf, bool first_scan
                      // not supported for TDC5
                      break;
                   case 2:
-                     pStoreFloat->emplace_back(chid, isrising, localtm * 1e9);
+                     pEventFloat->EmplaceMsg(chid, isrising, localtm * 1e9);
                      if (pEventFloat)
                         pEventFloat->SetTriggerTime(ch0time);
                      break;
                   case 3:
-                     pStoreDouble->emplace_back(chid, isrising, ch0time + localtm);
+                     pEventDouble->EmplaceMsg(chid, isrising, ch0time + localtm);
+                     break;
+                  case 4:
+                     pEventInt->EmplaceMsg(chid, isrising, hadaq::MessageInt::ToStamp(localtm));
+                     if (pEventInt)
+                        pEventInt->SetTriggerTime(ch0time);
                      break;
                   default: break;
                }
@@ -2882,6 +3365,9 @@ bool hadaq::TdcProcessor::DoBuffer5Scan(const base::Buffer& buf, bool first_scan
                   case 3:
                      AddMessage(indx, (hadaq::TdcSubEventDouble *) fGlobalMarks.item(indx).subev, hadaq::MessageDouble(chid, isrising, globaltm));
                      break;
+                  case 4:
+                     AddIntMessage(indx, chid, isrising, globaltm);
+                     break;
                }
             }
          }
@@ -2952,6 +3438,14 @@ bool hadaq::TdcProcessor::DoBuffer5Scan(const base::Buffer& buf, bool first_scan
 
       buf().local_tm = minimtm;
 
+      // remember hits range, used to skip second scan when no trigger window overlaps with it
+      buf().hits_min_tm = minimtm;
+      buf().hits_max_tm = maximtm;
+      buf().hits_cnt = hitcnt;
+      fNumHits += hitcnt;
+      buf().flush_tm = ch0time;
+      buf().hits_range = true;
+
 //      printf("Proc:%p first scan iserr:%d  minm: %12.9f\n", this, iserr, minimtm*1e-9);
 
       if (fMsgPerBrd) DefFillH1(*fMsgPerBrd, fSeqeunceId, cnt);
@@ -3018,35 +3512,48 @@ bool hadaq::TdcProcessor::DoBuffer4Scan(const base::Buffer& buf, bool first_scan
 
    // printf("Name %s ToT %d\n", GetName(), (int) do_tot);
 
-   // use temperature compensation only when temperature available
-   bool do_temp_comp = fCalibrUseTemp && (fCurrentTemp > 0) && (fCalibrTemp > 0) && (fabs(fCurrentTemp - fCalibrTemp) < 30.);
+   // compiled calibration table depends from temperature, rebuild it when required
+   CheckCalibrTable();
 
    unsigned cnt = 0, hitcnt = 0;
 
    bool iserr = false, isfirstepoch = false, rawprint = false, missinghit = false, dostore = false;
 
+   // per-channel histograms filled only for sampled events, selected in FirstBufferScan
+   const bool sampled = IsSampledEvent();
+   const double sampled_w = SampledWeight();
+
    double coarse_unit = GetTdcCoarseUnit();
 
    if (first_scan && IsTriggeredAnalysis() && IsStoreEnabled() && mgr()->HasTrigEvent()) {
       dostore = true;
       switch (GetStoreKind()) {
          case 1: {
-            auto subevnt = new hadaq::TdcSubEvent(buf.datalen() / 6);
+            auto subevnt = new hadaq::TdcSubEvent;
             mgr()->AddToTrigEvent(GetName(), subevnt);
-            pStoreVect = subevnt->vect_ptr();
+            subevnt->AttachArena(mgr()->GetTrigEventArena(), buf.datalen() / 6);
+            pEventVect = subevnt;
             break;
          }
          case 2: {
-            auto subevnt = new hadaq::TdcSubEventFloat(buf.datalen() / 6);
+            auto subevnt = new hadaq::TdcSubEventFloat;
             mgr()->AddToTrigEvent(GetName(), subevnt);
+            subevnt->AttachArena(mgr()->GetTrigEventArena(), buf.datalen() / 6);
             pEventFloat = subevnt;
-            pStoreFloat = subevnt->vect_ptr();
             break;
          }
          case 3: {
-            auto subevnt = new hadaq::TdcSubEventDouble(buf.datalen() / 6);
+            auto subevnt = new hadaq::TdcSubEventDouble;
+            mgr()->AddToTrigEvent(GetName(), subevnt);
+            subevnt->AttachArena(mgr()->GetTrigEventArena(), buf.datalen() / 6);
+            pEventDouble = subevnt;
+            break;
+         }
+         case 4: {
+            auto subevnt = new hadaq::TdcSubEventInt;
             mgr()->AddToTrigEvent(GetName(), subevnt);
-            pStoreDouble = subevnt->vect_ptr();
+            subevnt->AttachArena(mgr()->GetTrigEventArena(), buf.datalen() / 6);
+            pEventInt = subevnt;
             break;
          }
          default: break; // not supported
@@ -3073,7 +3580,7 @@ bool hadaq::TdcProcessor::DoBuffer4Scan(const base::Buffer& buf, bool first_scan
 
    unsigned help_index = 0;
 
-   double localtm = 0., minimtm = 0., ch0time = 0.;
+   double localtm = 0., minimtm = 0., maximtm = 0., ch0time = 0.;
 
    hadaq::TdcMessage& msg = iter.msg();
    hadaq::TdcMessage calibr;
@@ -3168,6 +3675,8 @@ bool hadaq::TdcProcessor::DoBuffer4Scan(const base::Buffer& buf, bool first_scan
             ch0time = (gTimeRefKind == 3) ? localtm + corr : localtm;
             if (pEventFloat)
                pEventFloat->SetTriggerTime(ch0time);
+            if (pEventInt)
+               pEventInt->SetTriggerTime(ch0time);
          }
 
          switch(gTimeRefKind) {
@@ -3280,14 +3789,8 @@ bool hadaq::TdcProcessor::DoBuffer4Scan(const base::Buffer& buf, bool first_scan
             if (!isrising) corr *= 10.; // range for falling edge is 50 ns.
          } else {
 
-            // main calibration for fine counter
-            corr = ExtractCalibr(isrising ? rec.rising_calibr : rec.falling_calibr, fine);
-
-            // apply TOT shift for falling edge (should it be also temp dependent)?
-            if (!isrising) corr += rec.tot_shift*1e-9;
-
-            // negative while value should be add to the stamp
-            if (do_temp_comp) corr -= (fCurrentTemp + fTempCorrection - fCalibrTemp) * rec.time_shift_per_grad * 1e-9;
+            // main calibration for fine counter, compiled table already includes TOT shift and temperature compensation
+            corr = GetTableCalibr(chid, isrising, fine);
          }
 
          // apply correction
@@ -3372,7 +3875,7 @@ bool hadaq::TdcProcessor::DoBuffer4Scan(const base::Buffer& buf, bool first_scan
                   }
                }
 
-               if (raw_hit) FastFillH1(rec.fRisingFine, fine);
+               if (raw_hit && sampled) FastFillH1(rec.fRisingFine, fine, sampled_w);
 
                rec.rising_cnt++;
 
@@ -3402,7 +3905,7 @@ bool hadaq::TdcProcessor::DoBuffer4Scan(const base::Buffer& buf, bool first_scan
                if (!is_ref_channel && (rec.refch == NumChannels() - 1) && (rec.reftdc == GetID()) && use_for_ref) {
                   rec.rising_ref_tm = localtm;
 
-                  DefFillH1(rec.fRisingRef, (localtm*1e9), 1.);
+                  if (sampled) DefFillH1(rec.fRisingRef, (localtm*1e9), sampled_w);
 
                   if (IsPrintRawData() || print_cond)
                   printf("Difference rising %04x:%02u\t %04x:%02u\t %12.3f\t %12.3f\t %7.3f  coarse %03x - %03x = %4d  fine %03x %03x \n",
@@ -3430,7 +3933,7 @@ bool hadaq::TdcProcessor::DoBuffer4Scan(const base::Buffer& buf, bool first_scan
                   }
                }
 
-               if (raw_hit) FastFillH1(rec.fFallingFine, fine);
+               if (raw_hit && sampled) FastFillH1(rec.fFallingFine, fine, sampled_w);
 
                rec.falling_cnt++;
 
@@ -3444,7 +3947,7 @@ bool hadaq::TdcProcessor::DoBuffer4Scan(const base::Buffer& buf, bool first_scan
                   if (fhTotMinusCounter && (tot > fTotUpperLimit)) {
                      DefFillH1(fhTotMoreCounter, chid, 1.);
                   }
-                  DefFillH1(rec.fTot, tot, 1.);
+                  if (sampled) DefFillH1(rec.fTot, tot, sampled_w);
                   rec.rising_new_value = false;
 
                   // use only raw hit
@@ -3455,20 +3958,27 @@ bool hadaq::TdcProcessor::DoBuffer4Scan(const base::Buffer& buf, bool first_scan
             if (!iserr) {
                hitcnt++;
                if ((minimtm==0) || (localtm < minimtm)) minimtm = localtm;
+               if ((hitcnt == 1) || (localtm > maximtm)) maximtm = localtm;
 
                if (dostore)
                   switch(GetStoreKind()) {
                      case 1:
-                        pStoreVect->emplace_back(msg, !is_ref_channel ? localtm : ch0time);
+                        pEventVect->EmplaceMsg(msg, !is_ref_channel ? localtm : ch0time);
                         break;
                      case 2:
                         if (!is_ref_channel)
-                           pStoreFloat->emplace_back(chid, isrising, localtm*1e9);
+                           pEventFloat->EmplaceMsg(chid, isrising, localtm*1e9);
                         if (pEventFloat)
                            pEventFloat->SetTriggerTime(ch0time);
                         break;
                      case 3:
-                        pStoreDouble->emplace_back(chid, isrising, ch0time + localtm);
+                        pEventDouble->EmplaceMsg(chid, isrising, ch0time + localtm);
+                        break;
+                     case 4:
+                        if (!is_ref_channel)
+                           pEventInt->EmplaceMsg(chid, isrising, hadaq::MessageInt::ToStamp(localtm));
+                        if (pEventInt)
+                           pEventInt->SetTriggerTime(ch0time);
                         break;
                      default: break;
                   }
@@ -3501,6 +4011,10 @@ bool hadaq::TdcProcessor::DoBuffer4Scan(const base::Buffer& buf, bool first_scan
                   case 3:
                      AddMessage(indx, (hadaq::TdcSubEventDouble *) fGlobalMarks.item(indx).subev, hadaq::MessageDouble(chid, isrising, globaltm));
                      break;
+                  case 4:
+                     if (!is_ref_channel)
+                        AddIntMessage(indx, chid, isrising, globaltm);
+                     break;
                }
             }
          }
@@ -3603,6 +4117,14 @@ bool hadaq::TdcProcessor::DoBuffer4Scan(const base::Buffer& buf, bool first_scan
 
       buf().local_tm = minimtm;
 
+      // remember hits range, used to skip second scan when no trigger window overlaps with it
+      buf().hits_min_tm = minimtm;
+      buf().hits_max_tm = maximtm;
+      buf().hits_cnt = hitcnt;
+      fNumHits += hitcnt;
+      buf().flush_tm = ch0time;
+      buf().hits_range = true;
+
 //      printf("Proc:%p first scan iserr:%d  minm: %12.9f\n", this, iserr, minimtm*1e-9);
 
       if (fMsgPerBrd) DefFillH1(*fMsgPerBrd, fSeqeunceId, cnt);
@@ -3883,6 +4405,8 @@ void hadaq::TdcProcessor::SetLinearCalibration(unsigned nch, unsigned finemin, u
 {
    if (nch < NumChannels())
       fCh[nch].SetLinearCalibr(finemin, finemax);
+
+   fCalibrTableDirty = fTransformTableDirty = true;
 }
 
 
@@ -4432,6 +4956,7 @@ void hadaq::TdcProcessor::ProduceCalibration(bool clear_stat, bool use_linear, b
        }
     }
 
+   fCalibrTableDirty = fTransformTableDirty = true;
 
 }
 
@@ -4814,6 +5339,8 @@ bool hadaq::TdcProcessor::LoadCalibration(const std::string& fprefix)
 
    fclose(f);
 
+   fCalibrTableDirty = fTransformTableDirty = true;
+
    char msg[2000];
    snprintf(msg, sizeof(msg), "%s reading calibration from %s, tcorr:%5.1f uset:%d done", GetName(), fname, fTempCorrection, fCalibrUseTemp);
    mgr()->PrintLog(msg);
@@ -4845,22 +5372,31 @@ void hadaq::TdcProcessor::IncCalibration(unsigned ch, bool rising, unsigned fine
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 /// Create TTree branch
+/// For store kind 4 extra branch with reference time is created, one entry per event
 
 void hadaq::TdcProcessor::CreateBranch(TTree*)
 {
    switch(GetStoreKind()) {
       case 1:
          pStoreVect = &fDummyVect;
-         mgr()->CreateBranch(GetName(), "std::vector<hadaq::TdcMessageExt>", (void**) &pStoreVect);
+         fStoreBranch = mgr()->CreateBranch(GetName(), "std::vector<hadaq::TdcMessageExt>", (void**) &pStoreVect);
          break;
       case 2:
          pEventFloat = nullptr;
          pStoreFloat = &fDummyFloat;
-         mgr()->CreateBranch(GetName(), "std::vector<hadaq::MessageFloat>", (void**) &pStoreFloat);
+         fStoreBranch = mgr()->CreateBranch(GetName(), "std::vector<hadaq::MessageFloat>", (void**) &pStoreFloat);
          break;
       case 3:
          pStoreDouble = &fDummyDouble;
-         mgr()->CreateBranch(GetName(), "std::vector<hadaq::MessageDouble>", (void**) &pStoreDouble);
+         fStoreBranch = mgr()->CreateBranch(GetName(), "std::vector<hadaq::MessageDouble>", (void**) &pStoreDouble);
+         break;
+      case 4:
+         pEventInt = nullptr;
+         pStoreInt = &fDummyInt;
+         fStoreBranch = mgr()->CreateBranch(GetName(), "std::vector<hadaq::MessageInt>", (void**) &pStoreInt);
+         // reference time stored in extra branch, leaf list cannot be used with asynchronous store
+         if (fStoreBranch)
+            mgr()->CreateBranch((std::string(GetName()) + "_ref").c_str(), "std::vector<double>", (void**) &pStoreRef);
          break;
       default:
          break;
@@ -4872,8 +5408,23 @@ void hadaq::TdcProcessor::CreateBranch(TTree*)
 
 void hadaq::TdcProcessor::Store(base::Event* ev)
 {
-   // in case of triggered analysis all pointers already set
-   if (!ev || IsTriggeredAnalysis()) return;
+   if (!ev) return;
+
+   base::ProfilerGuard grd(fProfiler, "store", 3);
+
+   if (IsTriggeredAnalysis()) {
+      // in triggered analysis messages kept in the event arena,
+      // copy them into vectors used by TTree branches or columnar store
+      if (fStoreBranch || (fColumnGroup >= 0)) {
+         if (pEventVect) pStoreVect = pEventVect->store_ptr(fDummyVect);
+         if (pEventFloat) pStoreFloat = pEventFloat->store_ptr(fDummyFloat);
+         if (pEventDouble) pStoreDouble = pEventDouble->store_ptr(fDummyDouble);
+         if (pEventInt) pStoreInt = pEventInt->store_ptr(fDummyInt);
+         if (GetStoreKind() == 4) fStoreRef.assign(1, pEventInt ? pEventInt->GetTriggerTime() : 0.);
+      }
+      StoreColumns();
+      return;
+   }
 
    base::SubEvent* sub0 = ev->GetSubEvent(GetName());
    if (!sub0) return;
@@ -4898,6 +5449,159 @@ void hadaq::TdcProcessor::Store(base::Event* ev)
          pStoreDouble = sub ? sub->vect_ptr() : &fDummyDouble;
          break;
       }
+      case 4: {
+         auto sub = dynamic_cast<hadaq::TdcSubEventInt*> (sub0);
+         // when subevent exists, use directly pointer on messages vector
+         pEventInt = sub;
+         pStoreInt = sub ? sub->vect_ptr() : &fDummyInt;
+         fStoreRef.assign(1, sub ? sub->GetTriggerTime() : 0.);
+         break;
+      }
+   }
+
+   StoreColumns();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Create columns in columnar store
+/// Store kind 1 - raw message and full time stamp, kind 2 - channel/edge and float stamp,
+/// kind 3 - channel/edge and double stamp, kind 4 - channel/edge and int32 stamp in ps,
+/// reference time stored in extra group with one entry per event.
+/// Channel/edge coded as in \ref hadaq::MessageFloat
+
+void hadaq::TdcProcessor::CreateColumns(base::ColumnStoreWriter *store)
+{
+   fColumnGroup = fColumnCh = fColumnStamp = fColumnRef = -1;
+
+   if ((GetStoreKind() < 1) || (GetStoreKind() > 4)) return;
+
+   int group = store->AddGroup(GetName());
+   if (group < 0) return;
+
+   if (GetStoreKind() == 1) {
+      fColumnCh = store->AddColumn(group, "msg", base::ColumnFile::col_UInt32, false);
+      fColumnStamp = store->AddColumn(group, "stamp", base::ColumnFile::col_Double);
+   } else if (GetStoreKind() == 4) {
+      fColumnCh = store->AddColumn(group, "ch", base::ColumnFile::col_UInt8);
+      fColumnStamp = store->AddColumn(group, "stamp", base::ColumnFile::col_Int32);
+      int refgroup = store->AddGroup((std::string(GetName()) + "_ref").c_str());
+      fColumnRef = refgroup < 0 ? -1 : store->AddColumn(refgroup, "time", base::ColumnFile::col_Double);
+      if (fColumnRef < 0) return;
+   } else {
+      fColumnCh = store->AddColumn(group, "ch", base::ColumnFile::col_UInt8);
+      fColumnStamp = store->AddColumn(group, "stamp", GetStoreKind() == 2 ? base::ColumnFile::col_Float : base::ColumnFile::col_Double);
+   }
+
+   if ((fColumnCh >= 0) && (fColumnStamp >= 0))
+      fColumnGroup = group;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Copy messages of current event into columnar store
+
+void hadaq::TdcProcessor::StoreColumns()
+{
+   if (fColumnGroup < 0) return;
+
+   auto store = mgr()->GetColumnStore();
+   if (!store) {
+      fColumnGroup = -1;
+      return;
+   }
+
+   switch (GetStoreKind()) {
+      case 1: {
+         unsigned sz = pStoreVect ? pStoreVect->size() : 0;
+         auto msg = store->ExtendT<uint32_t>(fColumnCh, sz);
+         auto stamp = store->ExtendT<double>(fColumnStamp, sz);
+         for (unsigned n = 0; n < sz; ++n) {
+            auto &m = (*pStoreVect)[n];
+            msg[n] = m.msg().getData();
+            stamp[n] = m.GetGlobalTime();
+         }
+         break;
+      }
+      case 2: {
+         unsigned sz = pStoreFloat ? pStoreFloat->size() : 0;
+         auto ch = store->ExtendT<uint8_t>(fColumnCh, sz);
+         auto stamp = store->ExtendT<float>(fColumnStamp, sz);
+         for (unsigned n = 0; n < sz; ++n) {
+            ch[n] = (*pStoreFloat)[n].ch;
+            stamp[n] = (*pStoreFloat)[n].stamp;
+         }
+         break;
+      }
+      case 3: {
+         unsigned sz = pStoreDouble ? pStoreDouble->size() : 0;
+         auto ch = store->ExtendT<uint8_t>(fColumnCh, sz);
+         auto stamp = store->ExtendT<double>(fColumnStamp, sz);
+         for (unsigned n = 0; n < sz; ++n) {
+            ch[n] = (*pStoreDouble)[n].ch;
+            stamp[n] = (*pStoreDouble)[n].stamp;
+         }
+         break;
+      }
+      case 4: {
+         unsigned sz = pStoreInt ? pStoreInt->size() : 0;
+         auto ch = store->ExtendT<uint8_t>(fColumnCh, sz);
+         auto stamp = store->ExtendT<int32_t>(fColumnStamp, sz);
+         for (unsigned n = 0; n < sz; ++n) {
+            ch[n] = (*pStoreInt)[n].ch;
+            stamp[n] = (*pStoreInt)[n].stamp;
+         }
+         *store->ExtendT<double>(fColumnRef, 1) = pEventInt ? pEventInt->GetTriggerTime() : 0.;
+         break;
+      }
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Add hits of subevent to the timeslice
+/// Only store kinds 1, 3 and 4 are used in timeslice mode, see \ref CheckTimesliceMode
+
+void hadaq::TdcProcessor::FillTimeslice(base::Timeslice& ts, base::SubEvent* sub0, unsigned source)
+{
+   switch (GetStoreKind()) {
+      case 1: {
+         auto sub = dynamic_cast<hadaq::TdcSubEvent*> (sub0);
+         if (sub)
+            for (auto &msg : sub->view())
+               ts.AddHit(msg.GetGlobalTime(), source, msg.msg().getHitChannel(), msg.msg().isHitRisingEdge() ? 0 : base::Timeslice::kFalling);
+         break;
+      }
+      case 3: {
+         auto sub = dynamic_cast<hadaq::TdcSubEventDouble*> (sub0);
+         if (sub)
+            for (auto &msg : sub->view())
+               ts.AddHit(msg.getStamp(), source, msg.getCh(), msg.isRising() ? 0 : base::Timeslice::kFalling);
+         break;
+      }
+      case 4: {
+         auto sub = dynamic_cast<hadaq::TdcSubEventInt*> (sub0);
+         if (sub)
+            for (auto &msg : sub->view())
+               ts.AddHit(sub->GetTime(msg), source, msg.getCh(), msg.isRising() ? 0 : base::Timeslice::kFalling);
+         break;
+      }
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+/// Check store kind for timeslice mode
+/// Hits are collected only when store is enabled, without store TDC does not provide hits for timeslices.
+/// Store kind 2 keeps stamps relative to channel 0 time of every buffer,
+/// which is not preserved for timeslice, therefore kind 3 is used instead
+
+void hadaq::TdcProcessor::CheckTimesliceMode()
+{
+   switch (GetStoreKind()) {
+      case 0:
+         printf("%s: store not enabled, hits are not added to timeslices\n", GetName());
+         break;
+      case 2:
+         printf("%s: store kind 2 cannot be used in timeslice mode, switch to store kind 3\n", GetName());
+         SetStoreKind(3);
+         break;
    }
 }
 
@@ -4906,10 +5610,19 @@ void hadaq::TdcProcessor::Store(base::Event* ev)
 
 void hadaq::TdcProcessor::ResetStore()
 {
+   fDummyVect.clear();
+   fDummyFloat.clear();
+   fDummyDouble.clear();
    pStoreVect = &fDummyVect;
+   pEventVect = nullptr;
    pStoreFloat = &fDummyFloat;
    pEventFloat = nullptr;
    pStoreDouble = &fDummyDouble;
+   pEventDouble = nullptr;
+   fDummyInt.clear();
+   pStoreInt = &fDummyInt;
+   pEventInt = nullptr;
+   fStoreRef.clear();
 }
 
 
@@ -2,6 +2,10 @@
 
 #include <cstring>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "base/defines.h"
 #include "base/ProcMgr.h"
@@ -86,7 +90,6 @@ hadaq::TrbProcessor::TrbProcessor(unsigned brdid, HldProcessor* hldproc, int hfi
 
    // printf("Create TrbProcessor %s\n", GetName());
 
-   fMinTdc = fMaxTdc = 0;
    fCurrentRunId = 0;
    fCurrentEventId = 0;
 
@@ -131,8 +134,6 @@ hadaq::TrbProcessor::TrbProcessor(unsigned brdid, HldProcessor* hldproc, int hfi
 
    // only raw scan, data can be immediately removed
    SetRawScanOnly();
-
-//   fProfiler.Reserve(50);
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -140,6 +141,7 @@ hadaq::TrbProcessor::TrbProcessor(unsigned brdid, HldProcessor* hldproc, int hfi
 
 hadaq::TrbProcessor::~TrbProcessor()
 {
+   SetTransformThreads(0);
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -208,7 +210,7 @@ void hadaq::TrbProcessor::UserPreLoop()
    if (fMap.size() > 0)
       CreatePerTDCHistos();
 
-   // fProfiler.MakeStatistic();
+   BuildDispatchTable();
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -216,8 +218,6 @@ void hadaq::TrbProcessor::UserPreLoop()
 
 void hadaq::TrbProcessor::UserPostLoop()
 {
-   // fProfiler.MakeStatistic();
-   // printf("TRB PROFILER: %s\n", fProfiler.Format().c_str());
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -417,6 +417,7 @@ void hadaq::TrbProcessor::SetCalibrTriggerMask(unsigned trigmask)
 void hadaq::TrbProcessor::AddSub(SubProcessor* sub, unsigned id)
 {
    fMap[id] = sub;
+   fDispatchDirty = true;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -598,8 +599,7 @@ bool hadaq::TrbProcessor::DogmaBufferScan(const base::Buffer &buf)
                buf().boardid = dataid;
                buf().format = 5; // use 5 for TDC5
 
-               tdcproc->AddNextBuffer(buf);
-               tdcproc->SetNewDataFlag(true);
+               PassSubBuffer(tdcproc, std::move(buf));
 
             } else {
                if (tdcproc->IsVersion5()) {
@@ -623,8 +623,7 @@ bool hadaq::TrbProcessor::DogmaBufferScan(const base::Buffer &buf)
                buf().boardid = dataid;
                buf().format = 3; // format with epoch0/corse0 and without ref channel
 
-               tdcproc->AddNextBuffer(buf);
-               tdcproc->SetNewDataFlag(true);
+               PassSubBuffer(tdcproc, std::move(buf));
             }
          } /*
          else if (fAutoCreate && (dataid >= gTDCMin) && (dataid <= gTDCMax) &&
@@ -672,6 +671,8 @@ void hadaq::TrbProcessor::BeforeEventScan()
 
 void hadaq::TrbProcessor::AfterEventScan()
 {
+   base::ProfilerGuard grd(fProfiler, "scan", 1);
+
    // scan all new data
    for (auto &entry : fMap)
       entry.second->ScanNewBuffers();
@@ -684,6 +685,7 @@ void hadaq::TrbProcessor::AfterEventFill()
 {
    // after scan data, fill extra histograms
    if (IsCrossProcess()) {
+      base::ProfilerGuard grd(fProfiler, "fill", 2);
       for (auto &entry : fMap)
          entry.second->AfterFill(&fMap);
    }
@@ -721,15 +723,16 @@ void hadaq::TrbProcessor::CreateBranch(TTree*)
 
 //////////////////////////////////////////////////////////////////////////////
 /// Provide buffer to sub-processor
+/// Returns false when buffer rejected by sub-processor
 
-void hadaq::TrbProcessor::AddBufferToTDC(hadaqs::RawSubevent* sub,
+bool hadaq::TrbProcessor::AddBufferToTDC(hadaqs::RawSubevent* sub,
                                          hadaq::SubProcessor* tdcproc,
                                          unsigned ix, unsigned datalen)
 {
    if (datalen == 0) {
       //if (CheckPrintError())
       //   printf("Try to add empty buffer to %s\n", tdcproc->GetName());
-      return;
+      return true;
    }
 
    base::Buffer buf;
@@ -750,8 +753,27 @@ void hadaq::TrbProcessor::AddBufferToTDC(hadaqs::RawSubevent* sub,
       buf().format = 0;
    }
 
-   tdcproc->AddNextBuffer(buf);
-   tdcproc->SetNewDataFlag(true);
+   return PassSubBuffer(tdcproc, std::move(buf));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/// Move buffer into sub-processor queue
+/// If queue reached its limit, buffer is rejected and counted,
+/// data of current event will be incomplete. Returns false in such case
+
+bool hadaq::TrbProcessor::PassSubBuffer(SubProcessor *subproc, base::Buffer &&buf)
+{
+   if (!subproc->AddNextBuffer(std::move(buf))) {
+      if (fNumRejectedSubBufs++ % 1000 == 0) {
+         char sbuf[200];
+         snprintf(sbuf, sizeof(sbuf), "%s queue is full, %lu buffers rejected", subproc->GetName(), fNumRejectedSubBufs);
+         EventError(sbuf);
+      }
+      return false;
+   }
+
+   subproc->SetNewDataFlag(true);
+   return true;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -783,6 +805,8 @@ void hadaq::TrbProcessor::EventLog(const char *msg)
 
 void hadaq::TrbProcessor::ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3runid, unsigned trb3seqid)
 {
+   base::ProfilerGuard grd(fProfiler, "split", 0);
+
    memcpy((void *) &fLastSubevHdr, sub, sizeof(fLastSubevHdr));
    fCurrentRunId = trb3runid;
    fCurrentEventId = sub->GetTrigNr();
@@ -804,12 +828,6 @@ void hadaq::TrbProcessor::ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3ru
 
    bool did_create_tdc = false;
 
-   if ((fMinTdc == 0) && (fMaxTdc == 0) && (fTdcsVect.size() == 0) && (fMap.size() > 0)) {
-      BuildFastTDCVector();
-   }
-
-   bool get_fast = fMaxTdc > fMinTdc;
-
    unsigned maxhublen = 0, lasthubid = 0; // if saw HUB subsubevents, control size of data inside
 
 //   RAWPRINT("Scan TRB3 raw event 4-bytes size %u\n", trbSubEvSize);
@@ -832,6 +850,13 @@ void hadaq::TrbProcessor::ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3ru
          dataid = data & 0xFFFF;
       }
 
+      // table changed only when new processors are created
+      if (fDispatchDirty)
+         BuildDispatchTable();
+
+      uint16_t disp = GetDispatch(dataid);
+      unsigned kind = DispatchKind(disp);
+
 //      RAWPRINT("Subevent id 0x%04x len %u\n", (data & 0xFFFF), datalen);
 
       // ===========  this is header for TDC, build inside the TRB3 =================
@@ -843,7 +868,7 @@ void hadaq::TrbProcessor::ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3ru
 //         continue;
 //      }
 
-      if (std::find(fHadaqHUBId.begin(), fHadaqHUBId.end(), dataid) != fHadaqHUBId.end()) {
+      if (kind == kDispHub) {
          RAWPRINT ("   HUB header: 0x%08x, hub=0x%04x, size=%u (ignore)\n", (unsigned) data, (unsigned) dataid, datalen);
 
          if (maxhublen == 0) {
@@ -869,7 +894,7 @@ void hadaq::TrbProcessor::ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3ru
       }
 
       ///<! ==================== CTS header and inside ================
-      if (dataid == fHadaqCTSId) {
+      if (kind == kDispCTS) {
          RAWPRINT("   CTS header: 0x%x, size=%d\n", (unsigned) data, datalen);
          //hTrbTriggerCount->Fill(5);          ///<! TRB - CTS
          //hTrbTriggerCount->Fill(0);          ///<! TRB TOTAL
@@ -962,11 +987,7 @@ void hadaq::TrbProcessor::ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3ru
          }
 
          if ((datalen > 4) && ((sub->Data(ix) == 0x4c55504f) || (sub->Data(ix) == 0x6c75706f))) {
-            ScalerProcessor *scaler = nullptr;
-
-            auto iter = fMap.find(fHadaqCTSId);
-            if (iter != fMap.end())
-               scaler = dynamic_cast<ScalerProcessor *> (iter->second);
+            ScalerProcessor *scaler = dynamic_cast<ScalerProcessor *> (GetDispatchProcs(disp).sub);
             if (scaler) {
                scaler->AddCTSData(sub, ix, datalen);
             } else if (fAutoCreate) {
@@ -987,7 +1008,7 @@ void hadaq::TrbProcessor::ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3ru
             // if not, there is no TDC present
 
 
-            TdcProcessor* tdcproc = GetTDC(fHadaqCTSId, true);
+            TdcProcessor* tdcproc = GetDispatchProcs(disp).tdc;
             if (tdcproc) {
                // if TDC processor found, process such data as normal TDC data
                AddBufferToTDC(sub, tdcproc, ix, datalen);
@@ -1017,15 +1038,10 @@ void hadaq::TrbProcessor::ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3ru
          continue;
       }
 
-      TdcProcessor *tdcproc = nullptr;
-      if (get_fast) {
-         if ((dataid >= fMinTdc) && (dataid < fMaxTdc)) tdcproc = fTdcsVect[dataid-fMinTdc];
-      } else {
-         tdcproc = GetTDC(dataid, true);
-      }
-
       ///<! ================= FPGA TDC header ========================
-      if (tdcproc) {
+      if (kind == kDispTdc) {
+         TdcProcessor *tdcproc = GetDispatchProcs(disp).tdc;
+
          RAWPRINT("   FPGA-TDC header: 0x%08x, tdcid=0x%04x, size=%u\n", (unsigned) data, dataid, datalen);
 
          if (IsPrintRawData()) {
@@ -1043,7 +1059,7 @@ void hadaq::TrbProcessor::ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3ru
 
 
       ///<! ==================  Dummy header and inside ==========================
-      if (dataid == 0x5555) {
+      if (kind == kDispDummy) {
          RAWPRINT("   Dummy header: 0x%x, size=%d\n", (unsigned) data, datalen);
          //hTrbTriggerCount->Fill(4);          ///<! TRB - DUMMY
          //hTrbTriggerCount->Fill(0);          ///<! TRB TOTAL
@@ -1067,11 +1083,10 @@ void hadaq::TrbProcessor::ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3ru
          continue;
       }
 
-      auto iter = fMap.find(dataid);
-      SubProcessor* subproc = iter != fMap.end() ? iter->second : nullptr;
-
       ///<! ================= any other header ========================
-      if (subproc) {
+      if (kind == kDispSub) {
+         SubProcessor *subproc = GetDispatchProcs(disp).sub;
+
          RAWPRINT ("   SUB header: 0x%08x, id=0x%04x, size=%u\n", (unsigned) data, dataid, datalen);
 
          if(datalen == 0) {
@@ -1083,8 +1098,8 @@ void hadaq::TrbProcessor::ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3ru
 
          // check if this processor has some attached TDC
          unsigned  offset = 0;
-         auto iter_tdc = fMap.find(dataid | 0xff0000);
-         if(iter_tdc != fMap.end()) {
+         SubProcessor *attached = GetDispatchProcs(disp).attached;
+         if (attached) {
             // pre-scan for begin marker of non-TDC data
             for(unsigned i=0;i<datalen;i++) {
                unsigned data_ = sub->Data(ix+i);
@@ -1094,7 +1109,7 @@ void hadaq::TrbProcessor::ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3ru
                }
             }
             if(offset>0)
-               AddBufferToTDC(sub, iter_tdc->second, ix, offset);
+               AddBufferToTDC(sub, attached, ix, offset);
          }
 
          datalen -= offset;
@@ -1108,8 +1123,7 @@ void hadaq::TrbProcessor::ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3ru
          buf().boardid = dataid;
          buf().format = 0;
 
-         subproc->AddNextBuffer(buf);
-         subproc->SetNewDataFlag(true);
+         PassSubBuffer(subproc, std::move(buf));
 
          ix += datalen;
          if (standalone_subevnt) break;
@@ -1243,40 +1257,75 @@ bool hadaq::TrbProcessor::CollectMissingTDCs(hadaqs::RawSubevent *sub, std::vect
 }
 
 //////////////////////////////////////////////////////////////////////////////
-/// Build vector of TDCs processor for fast access
+/// Build dispatch table for sub-sub-event ids
+/// For every 16-bit id kind of handler and processors are stored,
+/// therefore scan of sub-sub-event header requires single indexed load.
+/// Priority of handlers is the same as in ScanSubEvent: HUB, CTS, TDC, dummy and other sub-processor
 
-void hadaq::TrbProcessor::BuildFastTDCVector()
+void hadaq::TrbProcessor::BuildDispatchTable()
 {
-   bool isany = false;
-   fMinTdc = 0xffffff;
-   fMaxTdc = 0;
+   fDispatch.assign(0x10000, 0);
+   fDispatchProcs.clear();
+   fDispatchProcs.emplace_back(); // entry for ids without processors
 
-   for (auto &entry : fMap) {
-      if (entry.second->IsTDC()) {
-         isany = true;
-         if (entry.first > fMaxTdc) fMaxTdc = entry.first;
-         if (entry.first < fMinTdc) fMinTdc = entry.first;
+   std::vector<unsigned> ids = fHadaqHUBId;
+   ids.emplace_back(fHadaqCTSId);
+   ids.emplace_back(0x5555);
+   for (auto &entry : fMap)
+      ids.emplace_back(entry.first);
+
+   for (auto id : ids) {
+      if ((id > 0xffff) || fDispatch[id]) continue;
+
+      DispatchProcs procs;
+
+      auto iter = fMap.find(id);
+      if (iter != fMap.end()) {
+         procs.sub = iter->second;
+         if (procs.sub->IsTDC())
+            procs.tdc = static_cast<hadaq::TdcProcessor *>(procs.sub);
       }
-   }
 
-   if (!isany || (fMaxTdc-fMinTdc > 0xffff)) {
-      fMinTdc = fMaxTdc = 1;
-   } else {
-      fMaxTdc++;
-      fTdcsVect.resize(fMaxTdc - fMinTdc, nullptr);
-      for (auto &entry : fMap)
-         if (entry.second->IsTDC())
-            fTdcsVect[entry.first - fMinTdc] = static_cast<hadaq::TdcProcessor *>(entry.second);
+      iter = fMap.find(id | 0xff0000);
+      if (iter != fMap.end())
+         procs.attached = iter->second;
+
+      unsigned kind = kDispUnknown;
+      if (std::find(fHadaqHUBId.begin(), fHadaqHUBId.end(), id) != fHadaqHUBId.end())
+         kind = kDispHub;
+      else if (id == fHadaqCTSId)
+         kind = kDispCTS;
+      else if (procs.tdc)
+         kind = kDispTdc;
+      else if (id == 0x5555)
+         kind = kDispDummy;
+      else if (procs.sub)
+         kind = kDispSub;
+
+      unsigned indx = 0;
+      if (procs.sub || procs.attached) {
+         indx = fDispatchProcs.size();
+         if (indx > 0x1fff) {
+            printf("%s: too many sub-processors for dispatch table\n", GetName());
+            break;
+         }
+         fDispatchProcs.emplace_back(procs);
+      }
+
+      // kind is never 0 for ids in the list, therefore entry marks id as processed
+      fDispatch[id] = (kind << 13) | indx;
    }
+
+   fDispatchDirty = false;
 }
 
 //////////////////////////////////////////////////////////////////////////////
-/// Clear helper vector of TDCs processor for fast access
+/// Invalidate dispatch table, it will be rebuild with next event
+/// Kept for compatibility, table also invalidated automatically when new processors are registered
 
 void hadaq::TrbProcessor::ClearFastTDCVector()
 {
-   fTdcsVect.clear();
-   fMinTdc = fMaxTdc = 0;
+   fDispatchDirty = true;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1285,7 +1334,7 @@ void hadaq::TrbProcessor::ClearFastTDCVector()
 
 unsigned hadaq::TrbProcessor::TransformSubEvent(hadaqs::RawSubevent *sub, void *tgtbuf, unsigned tgtlen, bool only_hist, std::vector<unsigned> *newids)
 {
-//   base::ProfilerGuard grd(fProfiler, "enter");
+   base::ProfilerGuard grd(fProfiler, "transform", 3);
 
    unsigned trig_type = sub->GetTrigTypeTrb3(), sz = sub->GetSize();
 
@@ -1312,10 +1361,8 @@ unsigned hadaq::TrbProcessor::TransformSubEvent(hadaqs::RawSubevent *sub, void *
    // only fill histograms
    if (only_hist) return 0;
 
-   if ((fMinTdc == 0) && (fMaxTdc == 0) && (fTdcsVect.size()==0) && (fMap.size() > 0))
-      BuildFastTDCVector();
-
-   bool get_fast = fMaxTdc > fMinTdc;
+   if (fDispatchDirty)
+      BuildDispatchTable();
 
    // !!! DEBUG ONLY - just copy data
    // if (tgtbuf && tgtlen) {
@@ -1345,6 +1392,9 @@ unsigned hadaq::TrbProcessor::TransformSubEvent(hadaqs::RawSubevent *sub, void *
 
    bool standalone_subevnt = (sub->GetDecoding() & hadaqs::EvtDecoding_AloneSubevt) != 0;
 
+   if ((fTransformThreads > 0) && !standalone_subevnt && (trbSubEvSize >= fTransformMinWords))
+      return TransformSubEventParallel(sub, tgt, tgtlen, newids);
+
    while (ix < trbSubEvSize) {
 
 //      grd.Next("sub", 5);
@@ -1365,27 +1415,23 @@ unsigned hadaq::TrbProcessor::TransformSubEvent(hadaqs::RawSubevent *sub, void *
          return 0;
       }
 
-      if (fHadaqHUBId.size() > 0)
-         if (std::find(fHadaqHUBId.begin(), fHadaqHUBId.end(), id) != fHadaqHUBId.end()) {
-            // ix+=datalen;  // WORKAROUND !!!
+      uint16_t disp = GetDispatch(id);
 
-            // copy hub header to the target
-            if (tgt && !standalone_subevnt) tgt->SetData(tgtix++, data);
+      if (DispatchKind(disp) == kDispHub) {
+         // ix+=datalen;  // WORKAROUND !!!
 
-            // TODO: formally we should analyze HUB subevent as real subevent but
-            // we just skip header and continue to analyze data
-            continue;
-         }
+         // copy hub header to the target
+         if (tgt && !standalone_subevnt) tgt->SetData(tgtix++, data);
+
+         // TODO: formally we should analyze HUB subevent as real subevent but
+         // we just skip header and continue to analyze data
+         continue;
+      }
 
 //      grd.Next("get");
 
       ///<! ================= FPGA TDC header ========================
-      TdcProcessor *subproc = nullptr;
-      if (get_fast) {
-         if ((id >= fMinTdc) && (id < fMaxTdc)) subproc = fTdcsVect[id-fMinTdc];
-      } else {
-         subproc = GetTDC(id, true);
-      }
+      TdcProcessor *subproc = GetDispatchProcs(disp).tdc;
 
       if (subproc) {
 //         grd.Next("trans");
@@ -1433,6 +1479,250 @@ unsigned hadaq::TrbProcessor::TransformSubEvent(hadaqs::RawSubevent *sub, void *
    return 0;
 }
 
+namespace hadaq {
+
+   /** task for parallel transform of single sub-sub-event */
+   struct TransformTask {
+      TdcProcessor *tdc{nullptr};   ///< TDC processor, nullptr for block copied as is
+      uint32_t header{0};           ///< sub-sub-event header
+      unsigned ix{0};               ///< data index in source subevent
+      unsigned datalen{0};          ///< data length in source subevent
+      unsigned newlen{0};           ///< length of transformed data
+      std::vector<uint32_t> buf;    ///< output buffer, used when target is provided
+   };
+
+   /** \brief Workers for parallel transform of TDC data
+     *
+     * Threads are waiting for new generation of tasks, calling thread also takes part in processing.
+     * Tasks distributed via atomic counter, buffers of tasks are reused for next subevents */
+
+   class TransformWorkers {
+   public:
+      std::vector<std::thread> thrds;     ///< threads
+      std::mutex m;                       ///< mutex
+      std::condition_variable cv;         ///< signal new tasks
+      std::condition_variable cv_done;    ///< signal tasks completion
+      std::vector<TransformTask> tasks;   ///< tasks, only first numtasks are used
+      unsigned numtasks{0};               ///< number of tasks in current subevent
+      std::atomic<unsigned> next{0};      ///< next task to process
+      unsigned generation{0};             ///< incremented with every new set of tasks
+      unsigned running{0};                ///< number of threads still processing tasks
+      bool canceled{false};               ///< when set, threads are stopped
+      hadaqs::RawSubevent *sub{nullptr};  ///< source subevent
+      bool with_tgt{false};               ///< if target buffer is used
+
+      /** constructor, starts threads */
+      TransformWorkers(unsigned nthreads)
+      {
+         for (unsigned n = 0; n < nthreads; ++n)
+            thrds.emplace_back([this] { ThreadLoop(); });
+      }
+
+      /** destructor, stops threads */
+      ~TransformWorkers()
+      {
+         {
+            std::unique_lock<std::mutex> lk(m);
+            canceled = true;
+         }
+         cv.notify_all();
+         for (auto &thrd : thrds)
+            thrd.join();
+      }
+
+      /** add new task */
+      TransformTask &AddTask(TdcProcessor *tdc, uint32_t header, unsigned ix, unsigned datalen)
+      {
+         if (numtasks >= tasks.size())
+            tasks.resize(numtasks + 1);
+         auto &task = tasks[numtasks++];
+         task.tdc = tdc;
+         task.header = header;
+         task.ix = ix;
+         task.datalen = datalen;
+         task.newlen = 0;
+         return task;
+      }
+
+      /** transform data of single TDC */
+      void ProcessTask(TransformTask &task)
+      {
+         if (!task.tdc) return;
+
+         hadaqs::RawSubevent *tgt = nullptr;
+         if (with_tgt) {
+            // output can grow by one calibration message for two hits, first word reserved as in real subevent
+            unsigned need = sizeof(hadaqs::RawSubevent)/4 + 1 + task.datalen + task.datalen/2 + 1;
+            if (task.buf.size() < need) task.buf.resize(need);
+            tgt = (hadaqs::RawSubevent *) task.buf.data();
+         }
+
+         task.newlen = task.tdc->TransformTdcData(sub, (uint32_t *) sub->RawData(), task.ix, task.datalen, tgt, 1);
+      }
+
+      /** process tasks until all are taken */
+      void ProcessTasks()
+      {
+         unsigned n;
+         while ((n = next++) < numtasks)
+            ProcessTask(tasks[n]);
+      }
+
+      /** loop of worker thread */
+      void ThreadLoop()
+      {
+         unsigned seen = 0;
+         std::unique_lock<std::mutex> lk(m);
+         while (true) {
+            cv.wait(lk, [this, seen] { return canceled || (generation != seen); });
+            if (canceled) break;
+            seen = generation;
+            lk.unlock();
+            ProcessTasks();
+            lk.lock();
+            if (--running == 0)
+               cv_done.notify_one();
+         }
+      }
+
+      /** process all tasks with all threads, returns when all tasks are done */
+      void Run(bool use_threads)
+      {
+         next = 0;
+         if (!use_threads || thrds.empty()) {
+            ProcessTasks();
+            return;
+         }
+
+         {
+            std::unique_lock<std::mutex> lk(m);
+            running = thrds.size();
+            generation++;
+         }
+         cv.notify_all();
+
+         ProcessTasks();
+
+         std::unique_lock<std::mutex> lk(m);
+         cv_done.wait(lk, [this] { return running == 0; });
+      }
+   };
+
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/// Configure parallel transform of TDC data
+/// If nthreads > 0, TDCs of subevents with at least minwords data words are transformed in parallel.
+/// Calling thread also processes data, therefore nthreads is number of extra threads.
+/// Parallel processing only used when TDCs do not create histograms during transform.
+/// Calibration checks and logging of TDCs performed after all TDCs are transformed
+
+void hadaq::TrbProcessor::SetTransformThreads(unsigned nthreads, unsigned minwords)
+{
+   if (fTransformWorkers) {
+      delete fTransformWorkers;
+      fTransformWorkers = nullptr;
+   }
+
+   fTransformThreads = nthreads;
+   fTransformMinWords = minwords;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/// Transform subevent processing TDCs in parallel
+/// At first subevent is split on sub-sub-events, then all TDCs are transformed
+/// and at the end output is assembled in original order
+
+unsigned hadaq::TrbProcessor::TransformSubEventParallel(hadaqs::RawSubevent *sub, hadaqs::RawSubevent *tgt, unsigned tgtlen, std::vector<unsigned> *newids)
+{
+   if (!fTransformWorkers)
+      fTransformWorkers = new TransformWorkers(fTransformThreads);
+
+   auto workers = fTransformWorkers;
+   workers->numtasks = 0;
+   workers->sub = sub;
+   workers->with_tgt = tgt != nullptr;
+
+   bool use_threads = true;
+
+   unsigned ix = 0, trbSubEvSize = (sub->GetSize() - sizeof(hadaqs::RawSubevent)) / 4;
+
+   uint32_t *rawdata = (uint32_t *) sub->RawData();
+
+   while (ix < trbSubEvSize) {
+      uint32_t data = rawdata[ix++];
+      data = HADAQ_SWAP4(data);
+      unsigned datalen = (data >> 16) & 0xFFFF, id = data & 0xFFFF;
+
+      uint16_t disp = GetDispatch(id);
+
+      if (DispatchKind(disp) == kDispHub) {
+         // only hub header copied, data analyzed further
+         workers->AddTask(nullptr, data, ix, 0);
+         continue;
+      }
+
+      TdcProcessor *subproc = GetDispatchProcs(disp).tdc;
+
+      if (subproc) {
+         // histograms creation is not thread-safe, same TDC cannot be processed twice in parallel
+         if ((subproc->HistFillLevel() > 1) || (!mgr()->InternalHistFormat() && (subproc->HistFillLevel() > 0)))
+            use_threads = false;
+         for (unsigned n = 0; use_threads && (n < workers->numtasks); ++n)
+            if (workers->tasks[n].tdc == subproc)
+               use_threads = false;
+      } else if (newids && (id != 0x5555)) {
+         newids->emplace_back(id);
+      }
+
+      workers->AddTask(subproc, data, ix, datalen);
+
+      ix += datalen;
+   }
+
+   // calibration checks and logging use manager and shared histograms, performed after transform in this thread
+   if (use_threads)
+      for (unsigned n = 0; n < workers->numtasks; ++n)
+         if (workers->tasks[n].tdc)
+            workers->tasks[n].tdc->SetDelayedCalibr(true);
+
+   workers->Run(use_threads);
+
+   if (use_threads)
+      for (unsigned n = 0; n < workers->numtasks; ++n)
+         if (workers->tasks[n].tdc) {
+            workers->tasks[n].tdc->SetDelayedCalibr(false);
+            workers->tasks[n].tdc->ProcessDelayedCalibr();
+         }
+
+   if (!tgt) return 0;
+
+   unsigned tgtix = 0, hdrlen = sizeof(hadaqs::RawSubevent)/4 + 1;
+
+   for (unsigned n = 0; n < workers->numtasks; ++n) {
+      auto &task = workers->tasks[n];
+
+      unsigned len = task.tdc ? task.newlen : task.datalen;
+
+      if (tgtix + 1 + len > tgtlen) {
+         fprintf(stderr,"TrbProcessor::TransformSubEvent not enough space in output buffer\n");
+         return 0;
+      }
+
+      if (task.tdc) {
+         tgt->SetData(tgtix++, (task.header & 0xFFFF) | ((len & 0xffff) << 16)); // set sub-sub header
+         memcpy(tgt->RawData(tgtix), task.buf.data() + hdrlen, len*4);
+      } else {
+         tgt->SetData(tgtix++, task.header);
+         if (len) memcpy(tgt->RawData(tgtix), sub->RawData(task.ix), len*4);
+      }
+      tgtix += len;
+   }
+
+   tgt->SetSize(sizeof(hadaqs::RawSubevent) + tgtix*4);
+   return tgt->GetPaddedSize();
+}
+
 //////////////////////////////////////////////////////////////////////////////
 /// Emulate transform (calibrate) raw data - only for debugging
 
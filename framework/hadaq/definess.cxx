@@ -3,6 +3,65 @@
 #include <cstdio>
 #include <ctime>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HADAQ_SWAP_X86
+#include <immintrin.h>
+
+namespace {
+
+   /** AVX2 swap of 8 words at once, returns number of processed words */
+   __attribute__((target("avx2")))
+   unsigned SwapCopyAVX2(uint32_t *tgt, const uint32_t *src, unsigned len)
+   {
+      const __m256i mask = _mm256_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3,
+                                           12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3);
+      unsigned n = 0;
+      for (; n + 8 <= len; n += 8)
+         _mm256_storeu_si256((__m256i *) (tgt + n), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) (src + n)), mask));
+      return n;
+   }
+
+   /** SSSE3 swap of 4 words at once, returns number of processed words */
+   __attribute__((target("ssse3")))
+   unsigned SwapCopySSSE3(uint32_t *tgt, const uint32_t *src, unsigned len)
+   {
+      const __m128i mask = _mm_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3);
+      unsigned n = 0;
+      for (; n + 4 <= len; n += 4)
+         _mm_storeu_si128((__m128i *) (tgt + n), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + n)), mask));
+      return n;
+   }
+
+   /** instructions set used for swapping: 0 - scalar, 1 - SSSE3, 2 - AVX2
+     * detected only once, function-local static is safe when called from several threads */
+   int SwapLevel()
+   {
+      static const int level = __builtin_cpu_supports("avx2") ? 2 : (__builtin_cpu_supports("ssse3") ? 1 : 0);
+      return level;
+   }
+}
+#endif
+
+////////////////////////////////////////////////////////////////
+/// copy words with bytes swapping
+
+void hadaqs::SwapCopy4(uint32_t *tgt, const uint32_t *src, unsigned len)
+{
+   unsigned n = 0;
+
+#ifdef HADAQ_SWAP_X86
+   int level = SwapLevel();
+
+   if (level == 2)
+      n = SwapCopyAVX2(tgt, src, len);
+   else if (level == 1)
+      n = SwapCopySSSE3(tgt, src, len);
+#endif
+
+   for (; n < len; ++n)
+      tgt[n] = HADAQ_SWAP4(src[n]);
+}
+
 ////////////////////////////////////////////////////////////////
 /// dump raw event
 
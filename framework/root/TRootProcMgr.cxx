@@ -1,8 +1,12 @@
 #include "root/TRootProcMgr.h"
 
+#include "base/ColumnStore.h"
+
 #include "TTree.h"
 #include "TFile.h"
 #include "TROOT.h"
+#include "TClass.h"
+#include "TBufferFile.h"
 #include "TUrl.h"
 #include "TInterpreter.h"
 
@@ -22,23 +26,171 @@ TRootProcMgr::~TRootProcMgr()
    CloseStore();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/// Configure asynchronous store, must be called before store is created
+/// Event data is serialized into one of queuesize buffers and TTree::Fill
+/// performed in separate writer thread. When all buffers are in use,
+/// analysis waits for the writer. Only object branches are supported
+
+void TRootProcMgr::SetAsyncStore(unsigned queuesize)
+{
+   if (fTree) {
+      printf("Asynchronous store should be configured before store is created\n");
+      return;
+   }
+
+   fAsyncQueue = queuesize;
+
+   if (fAsyncQueue > 0)
+      ROOT::EnableThreadSafety();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Writer thread - fill tree with events from the queue
+
+void TRootProcMgr::WriterLoop()
+{
+   while (true) {
+      TBufferFile *buf = nullptr;
+
+      {
+         std::unique_lock<std::mutex> lock(fQueueMutex);
+         fQueueCond.wait(lock, [this] { return fWriterStop || !fReadySlots.empty(); });
+         if (fReadySlots.empty())
+            break;
+         buf = fReadySlots.front();
+         fReadySlots.pop_front();
+         fWriterBusy = true;
+      }
+
+      {
+         // only restore of writer objects is serialized with StoreEvent
+         std::lock_guard<std::mutex> lock(fStreamMutex);
+         buf->SetReadMode();
+         buf->SetBufferOffset(0);
+         for (auto br : fBranches)
+            br->fClass->Streamer(br->fWriterObj, *buf);
+         buf->SetWriteMode();
+         buf->Reset();
+      }
+
+      // compression and writing of baskets performed without lock,
+      // tree and writer objects used only by this thread, streamer state guarded by ROOT::EnableThreadSafety()
+      fTree->Fill();
+
+      {
+         std::lock_guard<std::mutex> lock(fQueueMutex);
+         fFreeSlots.emplace_back(buf);
+         fWriterBusy = false;
+      }
+      fQueueCond.notify_all();
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Start writer thread, buffers for the queue are allocated
+
+void TRootProcMgr::StartWriter()
+{
+   if (fWriterRunning) return;
+
+   for (unsigned n = 0; n < fAsyncQueue; n++)
+      fFreeSlots.emplace_back(new TBufferFile(TBuffer::kWrite, 0x10000));
+
+   fWriterStop = false;
+   fWriterBusy = false;
+   fWriter = std::thread(&TRootProcMgr::WriterLoop, this);
+   fWriterRunning = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Stop writer thread after all queued events are written
+
+void TRootProcMgr::StopWriter()
+{
+   if (!fWriterRunning) return;
+
+   {
+      std::lock_guard<std::mutex> lock(fQueueMutex);
+      fWriterStop = true;
+   }
+   fQueueCond.notify_all();
+
+   fWriter.join();
+   fWriterRunning = false;
+
+   for (auto buf : fFreeSlots)
+      delete buf;
+   fFreeSlots.clear();
+
+   if (fNumQueueFull > 0)
+      printf("Asynchronous store: %lu times queue with %u events was full\n", fNumQueueFull, fAsyncQueue);
+   fNumQueueFull = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Wait until all queued events are written, used before branches are modified
+
+void TRootProcMgr::WaitWriterIdle()
+{
+   if (!fWriterRunning) return;
+
+   std::unique_lock<std::mutex> lock(fQueueMutex);
+   fQueueCond.wait(lock, [this] { return fReadySlots.empty() && !fWriterBusy; });
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// store event
+/// In asynchronous mode objects are only serialized into the queue buffer,
+/// therefore processors can reset store immediately afterwards
 
 bool TRootProcMgr::StoreEvent()
 {
-   if (!fTree) return false;
+   if (!fTree) return base::ProcMgr::StoreEvent();
+
+   if (!fAsyncQueue) {
+      fTree->Fill();
+      return true;
+   }
+
+   StartWriter();
+
+   TBufferFile *buf = nullptr;
 
-   fTree->Fill();
+   {
+      std::unique_lock<std::mutex> lock(fQueueMutex);
+      if (fFreeSlots.empty()) {
+         fNumQueueFull++;
+         fQueueCond.wait(lock, [this] { return !fFreeSlots.empty(); });
+      }
+      buf = fFreeSlots.back();
+      fFreeSlots.pop_back();
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(fStreamMutex);
+      for (auto br : fBranches)
+         br->fClass->Streamer(*br->fObj ? *br->fObj : br->fEmptyObj, *buf);
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(fQueueMutex);
+      fReadySlots.emplace_back(buf);
+   }
+   fQueueCond.notify_all();
 
    return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 /// create store
+/// File with ".strm" extension is columnar store, see base::ColumnStoreWriter
 
 bool TRootProcMgr::CreateStore(const char* fname)
 {
+   if (base::ColumnFile::IsColumnFile(fname))
+      return base::ProcMgr::CreateStore(fname);
+
    if (fTree) return true;
    TUrl url(fname);
 
@@ -60,6 +212,8 @@ bool TRootProcMgr::CreateStore(const char* fname)
 
 bool TRootProcMgr::CloseStore()
 {
+   StopWriter();
+
    if (fTree) {
       TFile* f = fTree->GetCurrentFile();
       f->cd();
@@ -68,6 +222,15 @@ bool TRootProcMgr::CloseStore()
       fTree = 0;
       delete f;
    }
+
+   for (auto br : fBranches) {
+      br->fClass->Destructor(br->fWriterObj);
+      br->fClass->Destructor(br->fEmptyObj);
+      delete br;
+   }
+   fBranches.clear();
+
+   base::ProcMgr::CloseStore();
    return true;
 }
 
@@ -77,7 +240,29 @@ bool TRootProcMgr::CloseStore()
 bool TRootProcMgr::CreateBranch(const char* name, const char* class_name, void** obj)
 {
    if (fTree==0) return false;
-   fTree->Branch(name, class_name, obj);
+
+   if (!fAsyncQueue) {
+      fTree->Branch(name, class_name, obj);
+      return true;
+   }
+
+   TClass *cl = TClass::GetClass(class_name);
+   if (!cl) {
+      printf("Class %s not found, branch %s not created\n", class_name, name);
+      return false;
+   }
+
+   // events in the queue serialized with existing branches
+   WaitWriterIdle();
+
+   auto br = new StoreBranch;
+   br->fClass = cl;
+   br->fObj = obj;
+   br->fWriterObj = cl->New();
+   br->fEmptyObj = cl->New();
+   fBranches.emplace_back(br);
+
+   fTree->Branch(name, class_name, &br->fWriterObj);
    return true;
 }
 
@@ -87,6 +272,10 @@ bool TRootProcMgr::CreateBranch(const char* name, const char* class_name, void**
 bool TRootProcMgr::CreateBranch(const char* name, void* member, const char* kind)
 {
    if (fTree==0) return false;
+   if (fAsyncQueue) {
+      printf("Branch %s with leaf list not supported in asynchronous store\n", name);
+      return false;
+   }
    fTree->Branch(name, member, kind);
    return true;
 }
@@ -144,6 +144,8 @@ TFirstStepProcessor::TFirstStepProcessor(const char* name) :
 TFirstStepProcessor::~TFirstStepProcessor()
 {
    TGo4Log::Info("Input %ld  Output %ld  Total processed size = %ld", fNumInpBufs, fNumOutEvents, fTotalDataSize);
+   if (fNumRejectedBufs > 0)
+      TGo4Log::Error("%ld buffers rejected while processors queues were full", fNumRejectedBufs);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -199,10 +201,23 @@ Bool_t TFirstStepProcessor::BuildEvent(TGo4EventElement *outevnt)
 
    Bool_t filled_event = kFALSE;
 
-   if (!IsKeepInputEvent()) {
+   // input event should be delivered when it is new or was kept while processors queues were full
+   Bool_t deliver = !IsKeepInputEvent() || fInputPending;
+
+   if (deliver && !TRootProcMgr::CanAcceptRawData() && TRootProcMgr::ProduceNextEvent(event)) {
+      // processors queues reached limit - first produce events from already delivered data,
+      // input event will be kept and delivered with one of next calls
+      fInputPending = kTRUE;
+      filled_event = kTRUE;
+      deliver = kFALSE;
+   }
+
+   if (deliver) {
       // if keep input was not specified before,
       // framework has delivered new MBS event, it should be processed
 
+      fInputPending = kFALSE;
+
       // TGo4Log::Info("Accept new event %d", mbsev->GetIntLen()*4);
 
       fTotalDataSize += mbsev->GetIntLen()*4;
@@ -220,7 +235,9 @@ Bool_t TFirstStepProcessor::BuildEvent(TGo4EventElement *outevnt)
          buf().boardid = psubevt->GetSubcrate();
          buf().format = psubevt->GetControl();
 
-         TRootProcMgr::ProvideRawData(buf);
+         // buffer can be rejected only when queues are full and no event can be produced
+         if (!TRootProcMgr::ProvideRawData(buf))
+            fNumRejectedBufs++;
       }
 
       filled_event = TRootProcMgr::AnalyzeNewData(event);
@@ -236,7 +253,8 @@ Bool_t TFirstStepProcessor::BuildEvent(TGo4EventElement *outevnt)
       Bool_t store = TRootProcMgr::ProcessEvent(event);
 
       // only for stream analysis we need possibility to produce as much events as possible
-      if (TRootProcMgr::IsStreamAnalysis())
+      // also input event must be kept when it was not yet delivered to processors
+      if (TRootProcMgr::IsStreamAnalysis() || fInputPending)
          SetKeepInputEvent(kTRUE);
 
       // printf("Store event %s\n", store ? "true" : "false");
@@ -16,6 +16,8 @@ class TFirstStepProcessor : public TGo4EventProcessor,
       long fTotalDataSize;  ///< processed data size
       long fNumInpBufs;     ///< processed number of buffers
       long fNumOutEvents;   ///< created number of output events
+      long fNumRejectedBufs{0};   ///< number of buffers rejected by processors
+      Bool_t fInputPending{kFALSE}; ///< input event kept, but not yet delivered to processors
 
       std::string ReadMacroCode(const std::string &fname);
 
@@ -29,6 +31,9 @@ class TFirstStepProcessor : public TGo4EventProcessor,
 
       bool InternalHistFormat() const override { return false; }
 
+      /** Go4 histograms are used, compact storage not possible */
+      bool CanCompactHist() const override { return false; }
+
       void SetSortedOrder(bool = true) override;
       bool IsSortedOrder() override;
 
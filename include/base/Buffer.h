@@ -3,12 +3,15 @@
 
 #include "base/TimeStamp.h"
 
+#include <atomic>
+
 namespace base {
 
    /** Internal raw data for base::Buffer */
 
    struct RawDataRec {
-      int           refcnt{0};   ///< number of references
+      std::atomic<int> refcnt{0};  ///< number of references
+      bool          atomic_ref{false}; ///< when true, reference counter modified with atomic read-modify-write operations
 
       unsigned      kind{0};       ///< like ROC event, SPADIC or MBS or ..
       unsigned      boardid{0};    ///< board id
@@ -17,34 +20,67 @@ namespace base {
       GlobalTime_t  local_tm{0};    ///< buffer head time in local scale,
       GlobalTime_t  global_tm{0};   ///< buffer head time in global time
 
+      GlobalTime_t  hits_min_tm{0}; ///< minimal hit time in local scale, set by first scan
+      GlobalTime_t  hits_max_tm{0}; ///< maximal hit time in local scale, set by first scan
+      GlobalTime_t  flush_tm{0};    ///< local time used by second scan to close events, 0 - not used
+      unsigned      hits_cnt{0};    ///< number of hits in the time range
+      bool          hits_range{false}; ///< true when first scan recorded hits time range
+
       void*         buf{nullptr};        ///< raw data
       unsigned      datalen{0};    ///< length of raw data
 
       unsigned      user_tag{0};   ///< arbitrary data, can be used for any additional data
 
       /** constructor */
-      RawDataRec() : refcnt(0), kind(0), boardid(0), format(0), local_tm(0), global_tm(0), buf(nullptr), datalen(0), user_tag(0) {}
+      RawDataRec() : refcnt(0), atomic_ref(false), kind(0), boardid(0), format(0), local_tm(0), global_tm(0), hits_min_tm(0), hits_max_tm(0), flush_tm(0), hits_cnt(0), hits_range(false), buf(nullptr), datalen(0), user_tag(0) {}
 
       /** reset */
       void reset()
       {
-         refcnt = 0;
+         refcnt.store(0, std::memory_order_relaxed);
+         atomic_ref = false;
          kind = 0;
          boardid = 0;
          format = 0;
          local_tm = 0;
          global_tm = 0;
+         hits_min_tm = 0;
+         hits_max_tm = 0;
+         flush_tm = 0;
+         hits_cnt = 0;
+         hits_range = false;
          buf = nullptr;
          datalen = 0;
          user_tag = 0;
       }
+
+      /** increment reference counter */
+      void incref()
+      {
+         if (atomic_ref)
+            refcnt.fetch_add(1, std::memory_order_relaxed);
+         else
+            refcnt.store(refcnt.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      }
+
+      /** decrement reference counter, returns true when last reference was released */
+      bool decref()
+      {
+         if (atomic_ref)
+            return refcnt.fetch_sub(1, std::memory_order_acq_rel) == 1;
+         int cnt = refcnt.load(std::memory_order_relaxed) - 1;
+         refcnt.store(cnt, std::memory_order_relaxed);
+         return cnt == 0;
+      }
    };
 
    /** Memory management class
     *
     * \ingroup stream_core_classes
     *
-    * It allows to keep many references on same raw data and automatically release it  */
+    * It allows to keep many references on same raw data and automatically release it.
+    * By default reference counter is not thread-safe - buffer should be used from single thread.
+    * If buffer should be shared between threads, call setatomic() before first copy is passed to other thread  */
 
    class Buffer {
       protected:
@@ -53,16 +89,31 @@ namespace base {
          /** constructor */
          Buffer() : fRec(nullptr) {}
          /** constructor */
-         Buffer(const Buffer& src) : fRec(src.fRec) { if (fRec) fRec->refcnt++; }
+         Buffer(const Buffer& src) : fRec(src.fRec) { if (fRec) fRec->incref(); }
+         /** move constructor, reference counter not changed */
+         Buffer(Buffer&& src) noexcept : fRec(src.fRec) { src.fRec = nullptr; }
          /** destructor */
          ~Buffer() { reset(); }
 
          /** assign operator */
          Buffer& operator=(const Buffer& src)
          {
-            reset();
-            fRec = src.fRec;
-            if (fRec) fRec->refcnt++;
+            if (fRec != src.fRec) {
+               reset();
+               fRec = src.fRec;
+               if (fRec) fRec->incref();
+            }
+            return *this;
+         }
+
+         /** move assign operator, reference counter not changed */
+         Buffer& operator=(Buffer&& src) noexcept
+         {
+            if (this != &src) {
+               reset();
+               fRec = src.fRec;
+               src.fRec = nullptr;
+            }
             return *this;
          }
 
@@ -71,6 +122,13 @@ namespace base {
 
          void reset();
 
+         /** Switch buffer to atomic reference counting.
+          * Should be called before buffer copies are distributed to other threads */
+         void setatomic(bool on = true) { if (fRec) fRec->atomic_ref = on; }
+
+         /** returns true if reference counter of the buffer is thread-safe */
+         bool isatomic() const { return fRec ? fRec->atomic_ref : false; }
+
          /** access operator */
          RawDataRec& operator()(void) const { return *fRec; }
 
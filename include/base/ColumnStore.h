@@ -0,0 +1,258 @@
+#ifndef BASE_COLUMNSTORE_H
+#define BASE_COLUMNSTORE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace base {
+
+   /** \brief Layout of columnar store file
+    *
+    * \ingroup stream_core_classes
+    *
+    * File starts with header, followed by group and column descriptors and sequence of chunks.
+    * Group corresponds to data of one processor, all columns of the group have same number of entries per event.
+    * Chunk contains several events: for every group block with numevents+1 event offsets,
+    * followed by block for every column. Block data is padded to 8 bytes, therefore uncompressed
+    * data can be used directly from mapped memory. All values stored in native (little-endian) byte order */
+
+   struct ColumnFile {
+
+      enum { Version = 2, NameLength = 64, ChunkMagic = 0x4b4e4843 };
+
+      /** type of values in column */
+      enum ColumnType { col_UInt8 = 1, col_UInt16, col_UInt32, col_UInt64, col_Int32, col_Float, col_Double };
+
+      /** compression of block data */
+      enum Codec {
+         codec_None = 0,   ///< values stored as is
+         codec_Delta = 1   ///< difference to previous value as zigzag varint, for float and double bit pattern used as integer
+      };
+
+      /** file header */
+      struct Header {
+         char magic[8];               ///< "STRMCOLS"
+         uint32_t version;            ///< format version, see Version
+         uint32_t numgroups;          ///< number of groups
+         uint32_t numcolumns;         ///< number of columns
+         uint32_t reserved;           ///< reserved, 0
+      };
+
+      /** group descriptor */
+      struct Group {
+         char name[NameLength];       ///< group name, normally processor name
+      };
+
+      /** column descriptor */
+      struct Column {
+         char name[NameLength];       ///< column name
+         uint32_t group;              ///< group index
+         uint32_t type;               ///< values type, see ColumnType
+      };
+
+      /** chunk header */
+      struct Chunk {
+         uint32_t magic;              ///< ChunkMagic
+         uint32_t numevents;          ///< number of events in chunk
+         uint64_t size;               ///< full chunk size in bytes including header
+      };
+
+      /** block header, data follows */
+      struct Block {
+         uint16_t codec;              ///< compression, see Codec
+         uint16_t type;               ///< values type, see ColumnType
+         uint32_t count;              ///< number of values
+         uint64_t nbytes;             ///< stored data size, without padding
+      };
+
+      /** Size of single value */
+      static unsigned TypeSize(unsigned type)
+      {
+         switch (type) {
+            case col_UInt8: return 1;
+            case col_UInt16: return 2;
+            case col_UInt32: case col_Int32: case col_Float: return 4;
+            case col_UInt64: case col_Double: return 8;
+         }
+         return 0;
+      }
+
+      static bool IsColumnFile(const char *fname);
+   };
+
+   /** \brief Streaming writer of columnar store
+    *
+    * \ingroup stream_core_classes
+    *
+    * Groups and columns should be created before first event is filled.
+    * For every event processor appends values to its columns, \ref FillEvent closes event.
+    * Events are collected in memory and written as chunk when chunk limits are exceeded */
+
+   class ColumnStoreWriter {
+      protected:
+
+         /** column data collected for current chunk */
+         struct ColumnRec {
+            std::string name;                ///< column name
+            unsigned group{0};               ///< group index
+            unsigned type{0};                ///< values type
+            unsigned size{0};                ///< size of single value
+            bool compress{false};            ///< try to compress values
+            std::vector<uint8_t> data;       ///< collected values
+            unsigned count{0};               ///< number of collected values
+         };
+
+         /** group data collected for current chunk */
+         struct GroupRec {
+            std::string name;                ///< group name
+            int firstcol{-1};                ///< first column, defines number of entries per event
+            std::vector<uint32_t> offsets;   ///< events offsets in the chunk
+         };
+
+         FILE *fFile{nullptr};               ///< output file
+         std::string fFileName;              ///< file name
+         std::vector<GroupRec> fGroups;      ///< groups
+         std::vector<ColumnRec> fColumns;    ///< columns
+         bool fHeaderWritten{false};         ///< true when file header written, no new columns can be added
+         unsigned fChunkEvents{0};           ///< number of events in current chunk
+         unsigned fMaxChunkEvents{100000};   ///< maximal number of events in chunk
+         uint64_t fChunkBytes{0};            ///< collected data size in current chunk
+         uint64_t fMaxChunkBytes{0x800000};  ///< maximal data size of chunk
+         uint64_t fNumEvents{0};             ///< total number of stored events
+         uint64_t fNumChunks{0};             ///< total number of written chunks
+         std::vector<uint8_t> fEncoded;      ///< buffer for encoded chunk
+
+         bool WriteHeader();
+         void EncodeBlock(const uint8_t *data, unsigned count, unsigned type, bool compress);
+         bool WriteChunk();
+
+      public:
+         ColumnStoreWriter() = default;
+         virtual ~ColumnStoreWriter();
+
+         ColumnStoreWriter(const ColumnStoreWriter &) = delete;
+         ColumnStoreWriter &operator=(const ColumnStoreWriter &) = delete;
+
+         bool Open(const char *fname);
+         bool Close();
+
+         /** Returns true if file is opened */
+         bool IsOpen() const { return fFile != nullptr; }
+
+         /** Configure chunk limits - maximal number of events and size of collected data */
+         void SetChunkLimits(unsigned maxevents, uint64_t maxbytes)
+         {
+            fMaxChunkEvents = maxevents ? maxevents : 1;
+            fMaxChunkBytes = maxbytes;
+         }
+
+         int AddGroup(const char *name);
+
+         int AddColumn(int group, const char *name, ColumnFile::ColumnType type, bool compress = true);
+
+         /** Append count values to column, returns pointer where values should be written */
+         void *Extend(int col, unsigned count)
+         {
+            auto &rec = fColumns[col];
+            size_t pos = rec.data.size();
+            rec.data.resize(pos + (size_t) count * rec.size);
+            rec.count += count;
+            fChunkBytes += (uint64_t) count * rec.size;
+            return rec.data.data() + pos;
+         }
+
+         /** Append count values to column, returns pointer where values should be written */
+         template<typename T>
+         T *ExtendT(int col, unsigned count) { return (T *) Extend(col, count); }
+
+         bool FillEvent();
+
+         /** Total number of stored events */
+         uint64_t GetNumEvents() const { return fNumEvents; }
+   };
+
+   /** \brief Reader of columnar store
+    *
+    * \ingroup stream_core_classes
+    *
+    * File is mapped into memory, chunks are selected one after another.
+    * Uncompressed columns returned as pointers into mapped memory without copying,
+    * compressed columns are decoded into internal buffers */
+
+   class ColumnStoreReader {
+      protected:
+
+         /** block in selected chunk */
+         struct BlockRec {
+            const ColumnFile::Block *hdr{nullptr};  ///< block header
+            std::vector<uint8_t> decoded;           ///< decoded data
+            bool isdecoded{false};                  ///< true when data decoded
+         };
+
+         const char *fData{nullptr};                ///< file content
+         uint64_t fSize{0};                         ///< file size
+         std::vector<char> fBuffer;                 ///< file content when mapping not possible
+         const ColumnFile::Header *fHeader{nullptr}; ///< file header
+         const ColumnFile::Group *fGroups{nullptr};  ///< group descriptors
+         const ColumnFile::Column *fColumns{nullptr}; ///< column descriptors
+         std::vector<uint64_t> fChunks;             ///< offsets of complete chunks
+         uint64_t fNumEvents{0};                    ///< total number of events
+         int fChunk{-1};                            ///< selected chunk
+         unsigned fChunkEvents{0};                  ///< number of events in selected chunk
+         std::vector<BlockRec> fBlocks;             ///< blocks of selected chunk, first groups offsets then columns
+
+         const void *GetBlock(unsigned indx, unsigned type, unsigned &count);
+
+      public:
+         ColumnStoreReader() = default;
+         virtual ~ColumnStoreReader();
+
+         ColumnStoreReader(const ColumnStoreReader &) = delete;
+         ColumnStoreReader &operator=(const ColumnStoreReader &) = delete;
+
+         bool Open(const char *fname);
+         void Close();
+
+         /** Returns true if file is opened */
+         bool IsOpen() const { return fHeader != nullptr; }
+
+         /** Number of groups */
+         unsigned NumGroups() const { return fHeader ? fHeader->numgroups : 0; }
+         /** Group name */
+         const char *GetGroupName(unsigned n) const { return fGroups[n].name; }
+         int FindGroup(const char *name) const;
+
+         /** Number of columns */
+         unsigned NumColumns() const { return fHeader ? fHeader->numcolumns : 0; }
+         /** Column name */
+         const char *GetColumnName(unsigned n) const { return fColumns[n].name; }
+         /** Column group */
+         unsigned GetColumnGroup(unsigned n) const { return fColumns[n].group; }
+         /** Column type, see \ref base::ColumnFile::ColumnType */
+         unsigned GetColumnType(unsigned n) const { return fColumns[n].type; }
+         int FindColumn(int group, const char *name) const;
+
+         /** Number of complete chunks */
+         unsigned NumChunks() const { return fChunks.size(); }
+         /** Total number of events */
+         uint64_t NumEvents() const { return fNumEvents; }
+
+         bool SelectChunk(unsigned n);
+
+         /** Number of events in selected chunk */
+         unsigned ChunkEvents() const { return fChunkEvents; }
+
+         const uint32_t *GetOffsets(unsigned group);
+
+         const void *GetColumn(unsigned col, unsigned *count = nullptr);
+
+         /** Get column values of selected chunk, type should match column type */
+         template<typename T>
+         const T *GetColumnT(unsigned col, unsigned *count = nullptr) { return (const T *) GetColumn(col, count); }
+   };
+
+}
+
+#endif
@@ -5,6 +5,8 @@
 
 #include "base/TimeStamp.h"
 
+#include "base/EventArena.h"
+
 #include <map>
 #include <string>
 
@@ -20,6 +22,8 @@ namespace base {
 
          GlobalTime_t  fTriggerTm;  ///< trigger time
 
+         EventArena    fArena;      ///<! memory for subevents data, released together with subevents
+
       public:
          /** constructor */
          Event() : fMap(), fTriggerTm(0.) {}
@@ -42,6 +46,7 @@ namespace base {
             for (auto &elem : fMap)
                delete elem.second;
             fMap.clear();
+            fArena.Reset();
          }
 
          /** reset events */
@@ -52,6 +57,7 @@ namespace base {
                   elem.second->Clear();
 
             fTriggerTm = 0;
+            fArena.Reset();
          }
 
          /** add subevent */
@@ -79,6 +85,10 @@ namespace base {
           * GetSubEvent("ROC",2) is same as GetSubEvent("ROC2") */
          base::SubEvent* GetSubEvent(const std::string& name, unsigned subindx) const;
 
+         /** Return arena, which can be used to allocate subevents data
+          * Memory is valid until event is reset or subevents are destroyed */
+         EventArena &GetArena() { return fArena; }
+
          /** Return events map */
          EventsMap &GetEventsMap() { return fMap; }
    };
@@ -0,0 +1,107 @@
+#ifndef BASE_EVENTARENA_H
+#define BASE_EVENTARENA_H
+
+#include <cstddef>
+#include <vector>
+
+namespace base {
+
+   /** Span-like view on continuous array of elements
+    * Does not own the memory, valid as long as the source container exists */
+
+   template<class T>
+   class Span {
+      protected:
+         T *fData{nullptr};     ///< first element
+         unsigned fSize{0};     ///< number of elements
+      public:
+         /** default constructor */
+         Span() = default;
+
+         /** constructor */
+         Span(T *data, unsigned size) : fData(data), fSize(size) {}
+
+         /** pointer on first element */
+         T *data() const { return fData; }
+
+         /** number of elements */
+         unsigned size() const { return fSize; }
+
+         /** returns true if view is empty */
+         bool empty() const { return fSize == 0; }
+
+         /** begin iterator */
+         T *begin() const { return fData; }
+
+         /** end iterator */
+         T *end() const { return fData + fSize; }
+
+         /** element access */
+         T &operator[](unsigned indx) const { return fData[indx]; }
+   };
+
+   /** Bump allocator for memory, used during single event
+    *
+    * \ingroup stream_core_classes
+    *
+    * Memory is taken from large chunks by simple pointer increment.
+    * Individual allocations are never released - whole arena is rewind with Reset() call,
+    * chunks are preserved and reused for next event.
+    * Arena is not thread-safe - like the event itself it should be filled from single thread */
+
+   class EventArena {
+      protected:
+
+         /** memory chunk */
+         struct Chunk {
+            char *buf{nullptr};   ///< memory
+            size_t size{0};       ///< chunk size
+         };
+
+         std::vector<Chunk> fChunks;  ///< all allocated chunks
+         unsigned fCurrent{0};        ///< index of currently used chunk
+         size_t fPos{0};              ///< position in current chunk
+         size_t fChunkSize{0};        ///< default size of new chunks
+         size_t fUsed{0};             ///< memory used in previous chunks since last reset
+         size_t fPeak{0};             ///< maximal memory usage between two resets
+
+         void *AllocateSlow(size_t sz, size_t align);
+
+      public:
+         EventArena(size_t chunksize = 0x10000);
+         ~EventArena();
+
+         EventArena(const EventArena &) = delete;
+         EventArena &operator=(const EventArena &) = delete;
+
+         /** Allocate memory with specified size and alignment */
+         void *Allocate(size_t sz, size_t align = alignof(std::max_align_t))
+         {
+            if (fCurrent < fChunks.size()) {
+               size_t pos = (fPos + align - 1) & ~(align - 1);
+               if (pos + sz <= fChunks[fCurrent].size) {
+                  fPos = pos + sz;
+                  return fChunks[fCurrent].buf + pos;
+               }
+            }
+            return AllocateSlow(sz, align);
+         }
+
+         /** Allocate uninitialized array of elements */
+         template<class T>
+         T *AllocateArray(unsigned num) { return (T *) Allocate(num * sizeof(T), alignof(T)); }
+
+         void Reset();
+
+         /** Returns memory used since last reset */
+         size_t GetUsed() const { return fUsed + fPos; }
+
+         /** Returns peak memory usage between two resets */
+         size_t GetPeak() const { return fPeak > GetUsed() ? fPeak : GetUsed(); }
+
+         size_t GetTotalSize() const;
+   };
+
+}
+
+#endif
@@ -60,6 +60,9 @@ namespace base {
       GlobalTime_t globaltm{0};      ///< global time - reference time of marker
       GlobalTime_t lefttm{0};        ///< left range for hit selection
       GlobalTime_t righttm{0};       ///< right range for hit selection
+      GlobalTimePs_t globalps{0};    ///< global time in picoseconds, set with SetInterval()
+      GlobalTimePs_t leftps{0};      ///< left range in picoseconds
+      GlobalTimePs_t rightps{0};     ///< right range in picoseconds
 
       SubEvent*     subev{nullptr};  ///< structure with data, selected for the trigger, ownership
       bool          isflush{false};  ///< indicate that trigger is just for flushing, no real data is important
@@ -70,7 +73,8 @@ namespace base {
 
       /** constructor */
       GlobalMarker(const GlobalMarker& src) :
-         globaltm(src.globaltm), lefttm(src.lefttm), righttm(src.righttm), subev(src.subev), isflush(src.isflush) {}
+         globaltm(src.globaltm), lefttm(src.lefttm), righttm(src.righttm),
+         globalps(src.globalps), leftps(src.leftps), rightps(src.rightps), subev(src.subev), isflush(src.isflush) {}
 
       /** destructor */
       ~GlobalMarker() { /** should we here destroy subevent??? */ }
@@ -86,6 +90,15 @@ namespace base {
       void SetInterval(double left, double right);
 
       int TestHitTime(const GlobalTime_t& hittime, double* dist = nullptr);
+
+      /** test hit time in picoseconds, same as TestHitTime but with integer compare */
+      int TestHitTimePs(GlobalTimePs_t hitps, GlobalTimePs_t *dist) const
+      {
+         if (hitps < leftps) { *dist = hitps - leftps; return -1; }
+         if (hitps >= rightps) { *dist = hitps - rightps; return 1; }
+         *dist = 0;
+         return 0;
+      }
    };
 
    typedef RecordsQueue<GlobalMarker, false> GlobalMarksQueue;
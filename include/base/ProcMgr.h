@@ -3,11 +3,15 @@
 
 #include <vector>
 #include <map>
+#include <cstdint>
+#include <typeinfo>
 
 #include "base/defines.h"
 #include "base/Buffer.h"
 #include "base/Markers.h"
 #include "base/Event.h"
+#include "base/Timeslice.h"
+#include "base/Profiler.h"
 
 class TTree;
 class TObject;
@@ -18,6 +22,250 @@ namespace base {
    class StreamProc;
    class EventProc;
    class EventStore;
+   class ColumnStoreWriter;
+   class TimesliceWorkers;
+
+   /** \brief Dirty bits of internal histograms
+    *
+    * \ingroup stream_core_classes
+    *
+    * Histograms created by base implementation of \ref base::ProcMgr::MakeH1 and \ref base::ProcMgr::MakeH2
+    * have after bins one bit for every block of BlockSize bins, for tiled 2D histogram - one bit for every tile.
+    * Bits set by fill methods and used by \ref base::ProcMgr::UpdateHistDeltas to find changed blocks */
+
+   struct HistDirty {
+
+      enum { BlockBits = 6, BlockSize = 1 << BlockBits };
+
+      /** Returns number of doubles which should be allocated for dirty bits of nblocks blocks */
+      static int AllocSize(int nblocks) { return (nblocks + 63) / 64; }
+
+      /** Returns number of blocks for specified number of bins */
+      static int NumBlocks(int nbins) { return (nbins + BlockSize - 1) / BlockSize; }
+
+      /** Mark block as changed */
+      static inline void Mark(void *bits, int blk) { ((uint64_t *) bits)[blk >> 6] |= 1ULL << (blk & 63); }
+
+      /** Mark block with specified bin as changed, bin index includes underflow bin */
+      static inline void MarkBin(void *bits, int indx) { Mark(bits, indx >> BlockBits); }
+
+      /** Mark all blocks as changed */
+      static inline void MarkAll(void *bits, int nblocks) { for (int blk = 0; blk < nblocks; ++blk) Mark(bits, blk); }
+
+      /** Returns dirty bits of 1D histogram with double storage */
+      static inline void *DoubleH1(void *h1) { return (double *) h1 + 5 + (int) *((double *) h1); }
+
+      /** Returns dirty bits of 2D histogram with double storage */
+      static inline void *DoubleH2(void *h2)
+      {
+         double *hdr = (double *) h2;
+         return hdr + 6 + ((int) hdr[0] + 2) * ((int) hdr[3] + 2);
+      }
+   };
+
+   /** \brief Helper methods for compact internal histograms
+    *
+    * \ingroup stream_core_classes
+    *
+    * Used when storage kind is \ref base::hist_Float.
+    * 1D histogram: double header [nbins, left, right, nbins/(right-left)] followed by nbins+2 bins,
+    * first bin is underflow, last bin is overflow.
+    * 2D histogram: double header [nbins1, left1, right1, nbins2, left2, right2, nbins1/(right1-left1), nbins2/(right2-left2)]
+    * followed by (nbins1+2)*(nbins2+2) bins, same bins order as for double format */
+
+   struct CompactHist {
+
+      enum { H1HeaderSize = 4, H2HeaderSize = 8 };
+
+      /** Returns number of doubles which should be allocated for header and bins */
+      static int AllocSize(int hdrsize, int nbins) { return hdrsize + (nbins * 4 + 7) / 8; }
+
+      /** Returns pointer on bins array */
+      static inline void *Bins(void *h, int hdrsize) { return (double *) h + hdrsize; }
+
+      /** Returns bin content */
+      static inline double Get(void *bins, int indx) { return ((float *) bins)[indx]; }
+
+      /** Set bin content */
+      static inline void Set(void *bins, int indx, double v) { ((float *) bins)[indx] = v; }
+
+      /** Add weight to the bin */
+      static inline void Add(void *bins, int indx, double w) { ((float *) bins)[indx] += w; }
+
+      /** Returns dirty bits of 1D histogram, see \ref base::HistDirty */
+      static inline void *DirtyH1(void *h1) { return (double *) h1 + AllocSize(H1HeaderSize, (int) *((double *) h1) + 2); }
+
+      /** Returns dirty bits of 2D histogram, see \ref base::HistDirty */
+      static inline void *DirtyH2(void *h2)
+      {
+         double *hdr = (double *) h2;
+         return hdr + AllocSize(H2HeaderSize, ((int) hdr[0] + 2) * ((int) hdr[3] + 2));
+      }
+
+      /** Fill 1D histogram */
+      static inline void FillH1(void *h1, double x, double w)
+      {
+         double *hdr = (double *) h1;
+         int nbin = (int) hdr[0];
+         int bin = (int) ((x - hdr[1]) * hdr[3]);
+         if (bin < 0) bin = -1; else if (bin > nbin) bin = nbin;
+         Add(Bins(h1, H1HeaderSize), bin + 1, w);
+         HistDirty::MarkBin(hdr + AllocSize(H1HeaderSize, nbin + 2), bin + 1);
+      }
+
+      /** Fill 1D histogram without range checks */
+      static inline void FastFillH1(void *h1, int bin, double w)
+      {
+         Add(Bins(h1, H1HeaderSize), bin + 1, w);
+         HistDirty::MarkBin(DirtyH1(h1), bin + 1);
+      }
+
+      /** Returns bin index in 2D histogram */
+      static inline int IndexH2(void *h2, int bin1, int bin2)
+      {
+         return (bin1 + 1) + (bin2 + 1) * ((int) *((double *) h2) + 2);
+      }
+
+      /** Fill 2D histogram */
+      static inline void FillH2(void *h2, double x, double y, double w)
+      {
+         double *hdr = (double *) h2;
+         int nbin1 = (int) hdr[0];
+         int nbin2 = (int) hdr[3];
+         int bin1 = (int) ((x - hdr[1]) * hdr[6]);
+         int bin2 = (int) ((y - hdr[4]) * hdr[7]);
+         if (bin1 < 0) bin1 = -1; else if (bin1 > nbin1) bin1 = nbin1;
+         if (bin2 < 0) bin2 = -1; else if (bin2 > nbin2) bin2 = nbin2;
+         int indx = (bin1 + 1) + (bin2 + 1) * (nbin1 + 2);
+         Add(Bins(h2, H2HeaderSize), indx, w);
+         HistDirty::MarkBin(hdr + AllocSize(H2HeaderSize, (nbin1 + 2) * (nbin2 + 2)), indx);
+      }
+
+      /** Fill 2D histogram without range checks */
+      static inline void FastFillH2(void *h2, int bin1, int bin2)
+      {
+         int indx = IndexH2(h2, bin1, bin2);
+         Add(Bins(h2, H2HeaderSize), indx, 1.);
+         HistDirty::MarkBin(DirtyH2(h2), indx);
+      }
+   };
+
+   /** \brief Helper methods for tiled 2D internal histograms
+    *
+    * \ingroup stream_core_classes
+    *
+    * Bins of large 2D histogram split on TileSize x TileSize tiles, which allocated on first fill.
+    * Header has same layout as compact 2D histogram, but number of X bins stored with negative sign.
+    * Header followed by table with pointers on tiles, X tile index changes fastest.
+    * Tile bins stored with same storage kind as other internal histograms.
+    * Dense content can be produced with \ref base::ProcMgr::ExportH2 */
+
+   struct TiledHist {
+
+      enum { TileBits = 6, TileSize = 1 << TileBits, HeaderSize = CompactHist::H2HeaderSize };
+
+      /** Returns number of doubles which should be allocated for header and tiles table */
+      static int AllocSize(int nbins1, int nbins2) { return HeaderSize + NumTiles(nbins1) * NumTiles(nbins2); }
+
+      /** Returns dirty bits of tiled histogram, one bit for every tile */
+      static inline void *Dirty(void *h2)
+      {
+         double *hdr = (double *) h2;
+         return hdr + AllocSize((int) -hdr[0], (int) hdr[3]);
+      }
+
+      /** Returns number of tiles for specified number of bins, including underflow and overflow */
+      static int NumTiles(int nbins) { return (nbins + 2 + TileSize - 1) / TileSize; }
+
+      /** Returns true if 2D histogram is tiled */
+      static inline bool IsTiled(void *h2) { return *((double *) h2) < 0; }
+
+      /** Returns tiles table */
+      static inline void **Tiles(void *h2) { return (void **) ((double *) h2 + HeaderSize); }
+
+      /** Returns number of tile in tiles table, bins indexes include underflow bin */
+      static inline int TileNumber(void *h2, int indx1, int indx2)
+      {
+         return (indx2 >> TileBits) * NumTiles((int) -*((double *) h2)) + (indx1 >> TileBits);
+      }
+
+      /** Returns tile for specified bins indexes, nullptr if tile not allocated */
+      static inline void *FindTile(void *h2, int indx1, int indx2) { return Tiles(h2)[TileNumber(h2, indx1, indx2)]; }
+
+      /** Returns bin index inside tile */
+      static inline int TileIndex(int indx1, int indx2) { return ((indx2 & (TileSize - 1)) << TileBits) | (indx1 & (TileSize - 1)); }
+
+      static void *AllocTile(HistStorageKind kind);
+
+      /** Returns tile for specified bins indexes, allocates tile when required.
+        * Tile marked as changed, see \ref base::HistDirty */
+      static inline void *GetTile(HistStorageKind kind, void *h2, int indx1, int indx2)
+      {
+         int tnum = TileNumber(h2, indx1, indx2);
+         void *&tile = Tiles(h2)[tnum];
+         if (!tile) tile = AllocTile(kind);
+         HistDirty::Mark(Dirty(h2), tnum);
+         return tile;
+      }
+
+      /** Add weight to the bin, indexes include underflow bin */
+      static inline void Add(HistStorageKind kind, void *h2, int indx1, int indx2, double w)
+      {
+         void *tile = GetTile(kind, h2, indx1, indx2);
+         if (kind == hist_Double)
+            ((double *) tile)[TileIndex(indx1, indx2)] += w;
+         else
+            CompactHist::Add(tile, TileIndex(indx1, indx2), w);
+      }
+
+      /** Returns bin content, indexes include underflow bin */
+      static inline double Get(HistStorageKind kind, void *h2, int indx1, int indx2)
+      {
+         void *tile = FindTile(h2, indx1, indx2);
+         if (!tile) return 0.;
+         return kind == hist_Double ? ((double *) tile)[TileIndex(indx1, indx2)] : CompactHist::Get(tile, TileIndex(indx1, indx2));
+      }
+
+      /** Fill 2D histogram, bins calculated same way as for not-tiled histogram with same storage kind */
+      static inline void FillH2(HistStorageKind kind, void *h2, double x, double y, double w)
+      {
+         double *hdr = (double *) h2;
+         int nbin1 = (int) -hdr[0];
+         int nbin2 = (int) hdr[3];
+         int bin1, bin2;
+         if (kind == hist_Double) {
+            bin1 = (int) (nbin1 * (x - hdr[1]) / (hdr[2] - hdr[1]));
+            bin2 = (int) (nbin2 * (y - hdr[4]) / (hdr[5] - hdr[4]));
+         } else {
+            bin1 = (int) ((x - hdr[1]) * hdr[6]);
+            bin2 = (int) ((y - hdr[4]) * hdr[7]);
+         }
+         if (bin1 < 0) bin1 = -1; else if (bin1 > nbin1) bin1 = nbin1;
+         if (bin2 < 0) bin2 = -1; else if (bin2 > nbin2) bin2 = nbin2;
+         Add(kind, h2, bin1 + 1, bin2 + 1, w);
+      }
+
+      /** Fill 2D histogram without range checks */
+      static inline void FastFillH2(HistStorageKind kind, void *h2, int bin1, int bin2)
+      {
+         Add(kind, h2, bin1 + 1, bin2 + 1, 1.);
+      }
+   };
+
+   /** \brief Changed bins of internal histogram
+    *
+    * \ingroup stream_core_classes
+    *
+    * Produced by \ref base::ProcMgr::GetHistDeltas. Bins indexes include underflow and overflow bins,
+    * for 2D histogram X bin index changes fastest - same as in internal histogram format.
+    * Several entries can be produced for the same histogram when changes are not contiguous */
+
+   struct HistDelta {
+      unsigned indx{0};                ///< histogram index, see \ref base::ProcMgr::GetDeltaHistName
+      void *hist{nullptr};             ///< histogram handle
+      unsigned first{0};               ///< index of first changed bin
+      std::vector<double> values;      ///< actual content of changed bins
+   };
 
    /** \brief Central data and process manager
     *
@@ -61,16 +309,58 @@ namespace base {
          StreamProcMap            fMap;                ///<! map for fast access
          std::vector<EventProc*>  fEvProc;             ///<! all event processors
          GlobalMarksQueue         fTriggers;           ///<!< list of current triggers
+         unsigned                 fTriggersLimit{100000}; ///<! maximal capacity of triggers queue
          unsigned                 fTimeMasterIndex;    ///<! processor index, which time is used for all other subsystems
          AnalysisKind             fAnalysisKind;       ///<! ignore all events, only single scan, not output events
          TTree                   *fTree{nullptr};      ///<! abstract tree pointer, will be used in ROOT implementation
+         ColumnStoreWriter       *fColumnStore{nullptr}; ///<! columnar store, used when ROOT tree is not available
          int                      fDfltHistLevel{0};   ///<! default histogram fill level for any new created processor
+         unsigned                 fDfltHistSampling{1}; ///<! default sampling factor of expensive histograms
+         double                   fDfltHistSamplingRate{0.}; ///<! default maximal rate of sampled events
          int                      fDfltStoreKind{0};   ///<! default store kind for any new created processor
          base::Event             *fTrigEvent{nullptr}; ///<! current event, filled when performing triggered analysis
          int                      fDebug{0};           ///<! debug level
          bool                     fBlockHistCreation{false}; ///<! if true no new histogram should be created
+         HistStorageKind          fHistStorage{hist_Double}; ///<! storage kind for internal histograms
+         unsigned                 fH2TilingLimit{0};   ///<! 2D histograms with more bins are tiled, 0 - tiling disabled
+         unsigned                 fNumHistCreated{0};  ///<! number of created internal histograms
+         unsigned long            fNumSyncLost{0};     ///<! total number of erased slave sync markers
+         unsigned long            fNumSyncNotEnough{0}; ///<! number of sync analysis calls with too few syncs on some stream
          std::map<std::string,HistBinning> fCustomBinning; ///<! custom binning
 
+         enum { HistDeltaBlock = HistDirty::BlockSize };  ///< number of bins in block, for which changes are tracked
+
+         /** internal histogram, for which changed bins are tracked */
+         struct HistDeltaRec {
+            void *hist{nullptr};              ///< histogram handle
+            std::string name;                 ///< histogram name
+            void *bins{nullptr};              ///< first bin, includes underflow and overflow bins
+            HistStorageKind kind{hist_Double}; ///< bins storage kind
+            bool tiled{false};                ///< tiled 2D histogram, blocks correspond to tiles
+            unsigned nbins{0};                ///< total number of bins
+            void *dirty{nullptr};             ///< dirty bits of blocks, nullptr when content hashes are compared
+            uint64_t version{0};              ///< version when any bin was changed last time
+            std::vector<uint64_t> hashes;     ///< content hash of every bins block, 0 for not allocated tile
+            std::vector<uint64_t> versions;   ///< version when bins block was changed last time
+         };
+
+         std::vector<HistDeltaRec> fDeltaHists; ///<! histograms for delta publishing
+         std::map<void*,unsigned> fDeltaIndex; ///<! index of histogram in fDeltaHists
+         uint64_t                 fHistVersion{0};  ///<! version of histograms content
+         double                   fTimesliceLength{0.}; ///<! timeslice length, 0 - timeslice mode disabled
+         double                   fTimesliceOverlap{0.}; ///<! overlap of consequent timeslices
+         unsigned                 fTimesliceThreads{0}; ///<! number of threads used to build timeslices
+         TimesliceWorkers        *fTimesliceWorkers{nullptr}; ///<! workers for parallel build of timeslices
+         GlobalTime_t             fNextTimesliceTm{0.}; ///<! start time of next timeslice
+         bool                     fTimesliceStarted{false}; ///<! true when timeslices grid is defined
+         base::Timeslice          fTimesliceTail;      ///<! hits of last timeslice, which belong to next timeslice as well
+         std::vector<base::Timeslice*> fTimeslices;    ///<! timeslices ready for delivery
+         unsigned                 fTimeslicesPos{0};   ///<! index of next timeslice for delivery
+         base::Profiler           fProfiler;           ///<! profiler of main processing phases
+         bool                     fDfltProfiling{false}; ///<! enable profiling for any new created processor
+         double                   fProfilingInterval{0.}; ///<! interval in seconds for periodic profiling reports, 0 - only at the end
+         double                   fProfilingLastTm{0.}; ///<! time of last profiling report
+
          static ProcMgr* fInstance;                     ///<! instance
 
          /** range for sync messages */
@@ -83,6 +373,32 @@ namespace base {
 
          void DeleteAllProcessors();
 
+         virtual double *AllocateHist(unsigned size, const char *name, const char *title, const char *options,
+                                      int nbins1, double left1, double right1,
+                                      int nbins2 = 0, double left2 = 0., double right2 = 0.);
+
+         void AddTimesliceMarkers(GlobalTime_t flush_time);
+
+         bool BuildTimeslices();
+
+         void FillTimeslice(base::Timeslice *ts, base::Event *evt);
+
+         bool ProduceNextTimeslice(base::Event* &evt);
+
+         void RegisterDeltaHist(void *hist, const char *name, void *bins, unsigned nbins, bool tiled = false, void *dirty = nullptr);
+
+         void *GetHistDirty(void *hist, bool is2d);
+
+         void ProduceTiledDeltas(unsigned indx, uint64_t since, std::vector<HistDelta> &deltas);
+
+         /** Returns true if tiled 2D histograms can be created, tiles allocated in normal memory */
+         virtual bool CanTileHist() const { return true; }
+
+         /** Returns true if compact storage kinds can be used for internal histograms.
+          * Only histograms created by base implementation of MakeH1/MakeH2 have compact format,
+          * therefore derived managers should explicitly enable it */
+         virtual bool CanCompactHist() const { return typeid(*this) == typeid(ProcMgr); }
+
       public:
          ProcMgr();
          virtual ~ProcMgr();
@@ -118,11 +434,26 @@ namespace base {
 
          void SetHistFilling(int lvl);
 
+         void SetHistSampling(unsigned n, double hz = 0.);
+
+         void SetProfiling(bool on = true, double interval = 0.);
+
+         /** Returns true if profiling is enabled */
+         bool IsProfiling() const { return fProfiler.IsActive(); }
+
+         void PrintProfiling();
+
          /** Set debug level */
          void SetDebug(int lvl = 0) { fDebug = lvl; }
          /** Returns debug level */
          int GetDebug() const { return fDebug; }
 
+         /** Returns total number of slave sync markers erased without matching master sync */
+         unsigned long GetNumSyncLost() const { return fNumSyncLost; }
+
+         /** Returns number of sync analysis calls where some stream did not have enough syncs */
+         unsigned long GetNumSyncNotEnough() const { return fNumSyncNotEnough; }
+
          void SetBlockHistCreation(bool on = true) { fBlockHistCreation = on; }
          bool IsBlockHistCreation() const { return fBlockHistCreation; }
 
@@ -132,6 +463,18 @@ namespace base {
          /** When returns true, indicates that simple histogram format is used */
          virtual bool InternalHistFormat() const { return true; }
 
+         /** Returns bins storage kind for internal histogram format */
+         virtual HistStorageKind InternalHistStorage() const { return fHistStorage; }
+
+         bool SetHistStorage(HistStorageKind kind);
+
+         /** Configure tiled storage for internal 2D histograms with at least minbins bins (including underflow and overflow).
+          * Tiles allocated on first fill, therefore mostly empty histograms use much less memory. 0 disables tiling */
+         void SetH2Tiling(unsigned minbins = 100000) { fH2TilingLimit = minbins; }
+
+         /** Returns minimal number of bins for tiled 2D histograms, 0 when tiling disabled */
+         unsigned GetH2Tiling() const { return fH2TilingLimit; }
+
          /** Add run log */
          virtual void AddRunLog(const char * /* msg */) {}
          /** Add error log */
@@ -163,6 +506,7 @@ namespace base {
          virtual double GetH2Content(H2handle h2, int bin1, int bin2);
          virtual void SetH2Content(H2handle h2, int bin1, int bin2, double v = 0.);
          virtual void ClearH2(H2handle h2);
+         bool ExportH2(H2handle h2, std::vector<double> &bins);
          /** Set histogram title */
          virtual void SetH2Title(H2handle, const char*) {}
          /** Tag histogram time */
@@ -176,21 +520,42 @@ namespace base {
          /** Clear all histograms */
          virtual void ClearAllHistograms() {}
 
+         /** Returns true if changed bins of internal histograms marked by fill methods, see \ref base::HistDirty.
+          * Same condition as for compact storage - only histograms created by base implementation have dirty bits */
+         bool HasHistDirtyBits() const { return InternalHistFormat() && CanCompactHist(); }
+
+         void RegisterDeltaH1(H1handle h1, const char *name);
+
+         void RegisterDeltaH2(H2handle h2, const char *name);
+
+         uint64_t UpdateHistDeltas();
+
+         uint64_t GetHistDeltas(uint64_t since, std::vector<HistDelta> &deltas);
+
+         /** Returns current version of histograms content */
+         uint64_t GetHistVersion() const { return fHistVersion; }
+
+         /** Number of histograms tracked for delta publishing */
+         unsigned NumDeltaHists() const { return fDeltaHists.size(); }
+
+         /** Name of histogram, tracked for delta publishing */
+         const char *GetDeltaHistName(unsigned indx) const { return indx < fDeltaHists.size() ? fDeltaHists[indx].name.c_str() : nullptr; }
+
          virtual C1handle MakeC1(const char* name, double left, double right, base::H1handle h1 = nullptr);
          virtual void ChangeC1(C1handle c1, double left, double right);
          virtual int TestC1(C1handle c1, double value, double *dist = nullptr);
          virtual double GetC1Limit(C1handle c1, bool isleft = true);
 
-         /** create data store, for the moment - ROOT tree */
-         virtual bool CreateStore(const char* /* storename */) { return false; }
-         /** Close store */
-         virtual bool CloseStore() { return false; }
+         virtual bool CreateStore(const char* storename);
+         virtual bool CloseStore();
          /** Create branch */
          virtual bool CreateBranch(const char* /* name */, const char* /* class_name */, void** /* obj */) { return false; }
          /** Create branch */
          virtual bool CreateBranch(const char* /* name */, void* /* member */, const char* /* kind */) { return false; }
-         /** Store event */
-         virtual bool StoreEvent() { return false; }
+         virtual bool StoreEvent();
+
+         /** Returns columnar store if it was created */
+         ColumnStoreWriter *GetColumnStore() const { return fColumnStore; }
 
          /** method to register ROOT objects, object should be derived from TObject class
           * if returns true, object is registered and will be owned by framework */
@@ -223,7 +588,25 @@ namespace base {
          /** Specify processor index, which is used as time reference for all others */
          void SetTimeMasterIndex(unsigned indx) { fTimeMasterIndex = indx; }
 
-         void ProvideRawData(const Buffer& buf, bool fast_process = false);
+         bool ProvideRawData(const Buffer& buf, bool fast_process = false);
+
+         bool CanAcceptRawData() const;
+
+         void SetTriggersQueueCapacity(unsigned capacity, unsigned limit = 0);
+
+         /** Returns maximal capacity of triggers queue */
+         unsigned GetTriggersQueueLimit() const { return fTriggersLimit; }
+
+         /** Returns maximal number of triggers in the queue */
+         unsigned GetTriggersQueueHighWater() const { return fTriggers.high_water(); }
+
+         void SetTimesliceMode(double length, double overlap = 0., unsigned nthreads = 0);
+
+         /** Returns true if timeslice mode is configured */
+         bool IsTimesliceMode() const { return fTimesliceLength > 0.; }
+
+         /** Returns timeslice length */
+         double GetTimesliceLength() const { return fTimesliceLength; }
 
          bool AnalyzeSyncMarkers();
 
@@ -231,11 +614,14 @@ namespace base {
 
          bool ScanDataForNewTriggers();
 
-         bool AnalyzeNewData(base::Event* &evt);
+         virtual bool AnalyzeNewData(base::Event* &evt);
 
          /** Returns true if trigger even exists */
          bool HasTrigEvent() const { return fTrigEvent != nullptr; }
 
+         /** Returns arena of current triggered event, used for subevents data */
+         base::EventArena *GetTrigEventArena() const { return fTrigEvent ? &fTrigEvent->GetArena() : nullptr; }
+
          bool AddToTrigEvent(const std::string& name, base::SubEvent* sub);
 
          bool ProduceNextEvent(base::Event* &evt);
@@ -6,12 +6,16 @@
 #include "base/ProcMgr.h"
 
 #define DefFillH1(h1, x, w) {                                            \
-  if (h1 && fIntHistFormat) {                                            \
+  if (h1 && fIntHistFormat && (fIntHistStorage != base::hist_Double)) {  \
+     base::CompactHist::FillH1(h1, x, w);                                \
+  } else if (h1 && fIntHistFormat) {                                     \
      double* __arr = (double*) h1;                                       \
      int __nbin = (int) __arr[0];                                        \
      int __bin = (int) (__nbin * (x - __arr[1]) / (__arr[2] - __arr[1]));\
-     if (__bin < 0) __arr[3]+=w; else                                    \
-     if (__bin>=__nbin) __arr[4+__nbin]+=w; else __arr[4+__bin]+=w;      \
+     if (__bin < 0) __bin = -1; else if (__bin > __nbin) __bin = __nbin; \
+     __arr[4+__bin]+=w;                                                  \
+     if (fIntHistDirty)                                                  \
+        base::HistDirty::MarkBin(__arr + 5 + __nbin, __bin + 1);         \
   } else {                                                               \
      if (h1) mgr()->FillH1(h1, x, w);                                    \
   }                                                                      \
@@ -19,15 +23,23 @@
 
 #define DefFastFillH1(h1,x,weight) {              \
     if (h1) {                                     \
-      if (fIntHistFormat)                         \
+      if (fIntHistFormat && (fIntHistStorage != base::hist_Double)) \
+        base::CompactHist::FastFillH1(h1, x, weight);                \
+      else if (fIntHistFormat) {                  \
         ((double*) h1)[4+(x)] += weight;          \
-     else                                         \
+        if (fIntHistDirty)                        \
+           base::HistDirty::MarkBin(base::HistDirty::DoubleH1(h1), (x)+1); \
+      } else                                      \
         mgr()->FillH1(h1, (x), weight);           \
      }                                            \
 }
 
 #define DefFillH2(h2,x,y,weight) {               \
-  if (h2 && fIntHistFormat) {                    \
+  if (h2 && fIntHistFormat && base::TiledHist::IsTiled(h2)) {            \
+  base::TiledHist::FillH2(fIntHistStorage, h2, x, y, weight);            \
+} else if (h2 && fIntHistFormat && (fIntHistStorage != base::hist_Double)) {  \
+  base::CompactHist::FillH2(h2, x, y, weight);                           \
+} else if (h2 && fIntHistFormat) {               \
   double* __arr = (double*) h2;                  \
   int __nbin1 = (int) __arr[0];                  \
   int __nbin2 = (int) __arr[3];                  \
@@ -35,14 +47,24 @@
   int __bin2 = (int) (__nbin2 * (y - __arr[4]) / (__arr[5] - __arr[4]));  \
   if (__bin1<0) __bin1 = -1; else if (__bin1>__nbin1) __bin1 = __nbin1;   \
   if (__bin2<0) __bin2 = -1; else if (__bin2>__nbin2) __bin2 = __nbin2;   \
-  __arr[6 + (__bin1+1) + (__bin2+1)*(__nbin1+2)]+=weight;                 \
+  int __indx = (__bin1+1) + (__bin2+1)*(__nbin1+2);                       \
+  __arr[6 + __indx]+=weight;                                              \
+  if (fIntHistDirty)                                                      \
+     base::HistDirty::MarkBin(__arr + 6 + (__nbin1+2)*(__nbin2+2), __indx); \
 } else {                                                                  \
   if (h2) mgr()->FillH2(h2, x, y, weight);                                \
 } }
 
 #define DefFastFillH2(h2,x,y) {                                            \
-  if (h2 && fIntHistFormat) {                                              \
-     ((double*) h2)[6 + (x+1) + (y+1) * ((int) *((double*)h2) + 2)] += 1.; \
+  if (h2 && fIntHistFormat && base::TiledHist::IsTiled(h2)) {              \
+     base::TiledHist::FastFillH2(fIntHistStorage, h2, x, y);               \
+  } else if (h2 && fIntHistFormat && (fIntHistStorage != base::hist_Double)) { \
+     base::CompactHist::FastFillH2(h2, x, y);                              \
+  } else if (h2 && fIntHistFormat) {                                       \
+     int __indx = (x+1) + (y+1) * ((int) *((double*)h2) + 2);              \
+     ((double*) h2)[6 + __indx] += 1.;                                     \
+     if (fIntHistDirty)                                                    \
+        base::HistDirty::MarkBin(base::HistDirty::DoubleH2(h2), __indx);   \
    } else {                                                                \
      if (h2) mgr()->FillH2(h2, x, y, 1.);                                  \
    }                                                                       \
@@ -79,8 +101,17 @@ namespace base {
          std::string   fSubPrefixD;               ///< sub-prefix for histogram directory
          std::string   fSubPrefixN;               ///< sub-prefix for histogram names
          int           fHistFilling;              ///< level of histogram filling
+         unsigned      fHistSampling;             ///< expensive histograms filled for 1 of N events
+         double        fHistSamplingTm;           ///< minimal interval in seconds between sampled events, 0 - not used
+         bool          fSampledEvent;             ///< true if expensive histograms filled for current event
+         double        fSampledWeight;            ///< number of events represented by current sampled event
+         unsigned      fSampledSkip;              ///< number of events skipped since last sampled event
+         double        fSampledLastTm;            ///< time of last sampled event
          unsigned      fStoreKind;                ///< if >0, store will be enabled for processor
          bool          fIntHistFormat;            ///< if true, internal histogram format is used
+         HistStorageKind fIntHistStorage;         ///< storage kind of internal histograms
+         bool          fIntHistDirty;             ///< if true, changed blocks of internal histograms marked, see \ref base::HistDirty
+         base::Profiler  fProfiler;               ///< profiler of processing phases, disabled by default
 
          /** Make constructor protected - no way to create base class instance */
          Processor(const char* name = "", unsigned brdid = DummyBrdId);
@@ -97,6 +128,15 @@ namespace base {
          /** Set subprefix for histograms and conditions, index uses 2 symbols */
          void SetSubPrefix2(const char* subname = "", int indx = -1, const char* subname2 = "", int indx2 = -1);
 
+         bool DoSelectSampledEvent();
+
+         /** Decide if expensive histograms should be filled for current event, must be called once per event */
+         inline bool SelectSampledEvent()
+         {
+            if (!IsHistSampling()) return true;
+            return DoSelectSampledEvent();
+         }
+
          H1handle MakeH1(const char* name, const char* title, int nbins, double left, double right, const char* xtitle = nullptr);
 
          /** Fill 1-D histogram */
@@ -203,6 +243,9 @@ namespace base {
          /** Create branch */
          virtual void CreateBranch(TTree*) {}
 
+         /** Create columns in columnar store */
+         virtual void CreateColumns(ColumnStoreWriter*) {}
+
          /** Register object */
          virtual bool RegisterObject(TObject* tobj, const char* subfolder = nullptr)
          {
@@ -228,6 +271,25 @@ namespace base {
          /** Get histogram filling level */
          inline int  HistFillLevel() const { return fHistFilling; }
 
+         /** Enable profiling of processing phases, see \ref base::ProcMgr::SetProfiling */
+         void SetProfiling(bool on = true)
+         {
+            fProfiler.SetActive(on);
+            if (on) fProfiler.MakeStatistic();
+         }
+         /** Is profiling enabled */
+         bool IsProfiling() const { return fProfiler.IsActive(); }
+
+         void SetHistSampling(unsigned n = 1, double hz = 0.);
+         /** Get sampling factor for expensive histograms */
+         unsigned GetHistSampling() const { return fHistSampling; }
+         /** Is sampled filling of expensive histograms enabled */
+         inline bool IsHistSampling() const { return (fHistSampling > 1) || (fHistSamplingTm > 0); }
+         /** Returns true if expensive histograms should be filled for current event */
+         inline bool IsSampledEvent() const { return fSampledEvent; }
+         /** Weight for expensive histograms in current event, 1 when sampling disabled */
+         inline double SampledWeight() const { return fSampledWeight; }
+
          /** Get store kind */
          unsigned GetStoreKind() const { return fStoreKind; }
          /** Is store enabled */
@@ -62,6 +62,9 @@ namespace base {
       /** set active */
       void SetActive(bool on = true) { fActive = on; }
 
+      /** is active */
+      bool IsActive() const { return fActive; }
+
       void MakeStatistic();
 
       std::string Format();
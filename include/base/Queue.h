@@ -4,6 +4,7 @@
 #include <cstring>
 
 #include <stdexcept>
+#include <utility>
 
 namespace base {
 
@@ -194,6 +195,21 @@ namespace base {
             return true;
          }
 
+         /** erase cnt items starting from index, remaining items shifted only once */
+         bool erase_items(unsigned indx, unsigned cnt)
+         {
+            if (indx >= fSize) return false;
+            if (cnt > fSize - indx) cnt = fSize - indx;
+
+            for (unsigned n = indx + cnt; n < fSize; ++n)
+               item(n - cnt) = item(n);
+
+            fSize -= cnt;
+            fHead = fTail + fSize;
+            if (fHead >= fBorder) fHead -= fCapacity;
+            return true;
+         }
+
          /** create place for next entry */
          bool MakePlaceForNext()
          {
@@ -212,6 +228,18 @@ namespace base {
             }
          }
 
+         /** push value, moving content into the queue */
+         void push(T&& val)
+         {
+            if ((fSize<fCapacity) || Expand()) {
+               *fHead++ = std::move(val);
+               if (fHead==fBorder) fHead = fQueue;
+               fSize++;
+            } else {
+               throw std::runtime_error("No more space in fixed-size queue");
+            }
+         }
+
          /** push empty, return pointer on place */
          T* PushEmpty()
          {
@@ -340,6 +368,8 @@ namespace base {
    template<class T, bool canexpand = true>
    class RecordsQueue : public Queue<T, canexpand> {
       typedef Queue<T, canexpand> Parent;
+      protected:
+         unsigned fHighWater{0};   ///< maximal number of items in the queue
       public:
          /** default constructor */
          RecordsQueue() : Parent() {}
@@ -377,7 +407,7 @@ namespace base {
          /** pop item and return it */
          T pop_front()
          {
-            T res = front();
+            T res = std::move(front());
             pop();
             return res;
          }
@@ -416,6 +446,71 @@ namespace base {
             return res;
          }
 
+         /** Change capacity of the queue, items are moved into new storage
+           * Capacity cannot be smaller than number of items in the queue */
+         bool Resize(unsigned newcapacity)
+         {
+            unsigned sz = size();
+            if ((newcapacity == 0) || (newcapacity < sz)) return false;
+            if (newcapacity == capacity()) return true;
+
+            T *q = new T[newcapacity];
+            for (unsigned n = 0; n < sz; n++)
+               q[n] = std::move(item(n));
+
+            delete [] Parent::fQueue;
+
+            Parent::fQueue = q;
+            Parent::fCapacity = newcapacity;
+            Parent::fBorder = q + newcapacity;
+            Parent::fTail = q;
+            Parent::fHead = (sz == newcapacity) ? q : q + sz;
+            return true;
+         }
+
+         /** Push item, capacity doubled when queue is full but not more than limit
+           * Returns false if queue is full and cannot grow */
+         template<class V>
+         bool push_adaptive(V &&val, unsigned limit)
+         {
+            if (full()) {
+               unsigned newcapacity = capacity() < 8 ? 16 : capacity() * 2;
+               if (newcapacity > limit) newcapacity = limit;
+               if ((newcapacity <= capacity()) || !Resize(newcapacity)) return false;
+            }
+            Parent::push(std::forward<V>(val));
+            if (size() > fHighWater) fHighWater = size();
+            return true;
+         }
+
+         /** Halve capacity when queue mostly empty, but not below mincapacity */
+         void ShrinkUnused(unsigned mincapacity)
+         {
+            unsigned newcapacity = capacity() / 2;
+            if ((newcapacity >= mincapacity) && (size() < capacity() / 4))
+               Resize(newcapacity);
+         }
+
+         /** maximal number of items in the queue */
+         unsigned high_water() const { return fHighWater; }
+
+         /** erase several items */
+         bool erase_items(unsigned indx, unsigned cnt)
+         {
+            unsigned oldsize = size();
+
+            if (!Parent::erase_items(indx, cnt)) return false;
+
+            // reset all items behind the head which are not used now
+            T* _item = Parent::fHead;
+            for (unsigned n = size(); n < oldsize; ++n) {
+               _item->reset();
+               if (++_item == Parent::fBorder) _item = Parent::fQueue;
+            }
+
+            return true;
+         }
+
    };
 
 }
@@ -0,0 +1,173 @@
+#ifndef BASE_SHMPROCMGR_H
+#define BASE_SHMPROCMGR_H
+
+#include "base/ProcMgr.h"
+
+#include <atomic>
+#include <string>
+
+namespace base {
+
+   /** \brief Layout of shared memory segment with histograms
+    *
+    * \ingroup stream_core_classes
+    *
+    * Segment starts with header, followed by directory with maxhist entries and data area.
+    * Histogram data has same layout as internal histograms of \ref base::ProcMgr,
+    * offset in entry is counted from segment begin. Entries only appended - reader should
+    * read numhist with acquire semantic, all entries before are complete.
+    * Counter fillseq works as seqlock - it is odd while analysis fills histograms */
+
+   struct ShmHist {
+
+      enum { Layout = 2, NameLength = 128 };
+
+      /** segment header */
+      struct Header {
+         char magic[8];                       ///< "STRMHIST"
+         uint32_t layout;                     ///< layout version, see Layout
+         uint32_t maxhist;                    ///< capacity of directory
+         uint64_t size;                       ///< total size of the segment
+         uint64_t dataoffset;                 ///< offset of data area
+         std::atomic<uint32_t> numhist;       ///< number of histograms in directory
+         std::atomic<uint64_t> dataused;      ///< used bytes in data area
+         std::atomic<uint64_t> dirversion;    ///< incremented when histogram added
+         std::atomic<uint64_t> events;        ///< number of processed events
+         std::atomic<uint64_t> fillseq;       ///< incremented before and after histograms filling
+      };
+
+      /** directory entry */
+      struct Entry {
+         char name[NameLength];               ///< full histogram name
+         char title[NameLength];              ///< histogram title
+         char options[NameLength];            ///< axis titles and other options
+         uint32_t ndim;                       ///< 1 or 2
+         uint32_t storage;                    ///< bins storage, see \ref base::HistStorageKind
+         int32_t nbins1;                      ///< number of X bins
+         int32_t nbins2;                      ///< number of Y bins
+         double left1, right1;                ///< X range
+         double left2, right2;                ///< Y range
+         uint64_t offset;                     ///< offset of histogram data from segment begin
+         uint64_t size;                       ///< size of histogram data in bytes
+         std::atomic<uint64_t> version;       ///< incremented when content cleared or set
+      };
+
+      static_assert(std::atomic<uint64_t>::is_always_lock_free, "64-bit atomics required for shared memory");
+   };
+
+   /** \brief Processor manager with histograms in POSIX shared memory
+    *
+    * \ingroup stream_core_classes
+    *
+    * Internal histograms allocated in named shared memory segment, see \ref base::ShmHist.
+    * Filling is the same as for normal internal histograms, therefore analysis does not spend
+    * any time for export. Other process can attach segment with \ref base::ShmHistReader
+    * and read histograms at any time. When segment is full, histograms allocated in normal memory */
+
+   class ShmProcMgr : public ProcMgr {
+      protected:
+         std::string fShmName;             ///<! name of shared memory segment
+         char *fSegment{nullptr};          ///<! mapped segment
+         uint64_t fSegmentSize{0};         ///<! segment size
+         bool fUnlink{true};               ///<! remove segment in destructor
+         std::map<void *, unsigned> fEntries; ///<! histogram to directory entry
+         unsigned fFillDepth{0};           ///<! nesting level of histograms filling
+
+         ShmHist::Header *header() const { return (ShmHist::Header *) fSegment; }
+         ShmHist::Entry *entry(unsigned n) const { return (ShmHist::Entry *) (fSegment + sizeof(ShmHist::Header)) + n; }
+
+         double *AllocateHist(unsigned size, const char *name, const char *title, const char *options,
+                              int nbins1, double left1, double right1,
+                              int nbins2 = 0, double left2 = 0., double right2 = 0.) override;
+
+         void IncVersion(void *hist);
+
+         void BeginFill();
+         void EndFill();
+
+         /** Tiles allocated in normal memory and cannot be seen by reader, therefore tiling disabled */
+         bool CanTileHist() const override { return false; }
+
+         /** Histograms created by base implementation, compact storage can be used */
+         bool CanCompactHist() const override { return true; }
+
+      public:
+         ShmProcMgr(const char *shmname = "/stream_hist", uint64_t size = 0x10000000, unsigned maxhist = 100000, bool force = false);
+         virtual ~ShmProcMgr();
+
+         /** Returns true if shared memory segment is created */
+         bool IsShmOk() const { return fSegment != nullptr; }
+
+         /** Returns name of shared memory segment */
+         const std::string &GetShmName() const { return fShmName; }
+
+         /** Keep segment after manager is destroyed, one should remove it with shm_unlink() */
+         void SetKeepSegment(bool on = true) { fUnlink = !on; }
+
+         void SetH1Content(H1handle h1, int bin, double v = 0.) override;
+         void ClearH1(H1handle h1) override;
+         void CopyH1(H1handle tgt, H1handle src) override;
+         void SetH2Content(H2handle h2, int bin1, int bin2, double v = 0.) override;
+         void ClearH2(H2handle h2) override;
+
+         bool AnalyzeNewData(base::Event* &evt) override;
+
+         bool ProcessEvent(base::Event* evt) override;
+   };
+
+   /** \brief Reader of histograms from shared memory segment
+    *
+    * \ingroup stream_core_classes
+    *
+    * Attaches segment, created by \ref base::ShmProcMgr, in read-only mode.
+    * Bins are read without locking - every single bin value is consistent,
+    * but bins of the same histogram may belong to different events.
+    * Histograms filled only inside AnalyzeNewData() and ProcessEvent() of the manager,
+    * fill sequence is incremented around these calls. If fill sequence was even before reading
+    * and unchanged after reading, snapshot is exact, see \ref IsExactSnapshot */
+
+   class ShmHistReader {
+      protected:
+         const char *fSegment{nullptr};    ///< mapped segment
+         uint64_t fSegmentSize{0};         ///< segment size
+
+         const ShmHist::Header *header() const { return (const ShmHist::Header *) fSegment; }
+
+      public:
+         ShmHistReader() = default;
+         ~ShmHistReader();
+
+         ShmHistReader(const ShmHistReader &) = delete;
+         ShmHistReader &operator=(const ShmHistReader &) = delete;
+
+         bool Open(const char *shmname);
+         void Close();
+
+         /** Returns true if segment is attached */
+         bool IsOpen() const { return fSegment != nullptr; }
+
+         /** Number of histograms */
+         unsigned NumHist() const { return fSegment ? header()->numhist.load(std::memory_order_acquire) : 0; }
+
+         /** Version of directory, changed when histograms are added */
+         uint64_t GetDirVersion() const { return fSegment ? header()->dirversion.load(std::memory_order_acquire) : 0; }
+
+         /** Number of events processed by analysis */
+         uint64_t GetNumEvents() const { return fSegment ? header()->events.load(std::memory_order_acquire) : 0; }
+
+         /** Fill sequence, odd value means that histograms are filled now */
+         uint64_t GetFillSeq() const { return fSegment ? header()->fillseq.load(std::memory_order_acquire) : 0; }
+
+         bool IsExactSnapshot(uint64_t seq) const;
+
+         /** Directory entry, index should be less than NumHist() */
+         const ShmHist::Entry &GetEntry(unsigned n) const { return ((const ShmHist::Entry *) (fSegment + sizeof(ShmHist::Header)))[n]; }
+
+         int FindHist(const char *name) const;
+
+         bool ReadBins(unsigned n, std::vector<double> &bins) const;
+   };
+
+}
+
+#endif
@@ -51,6 +51,7 @@ namespace base {
          SyncMarksQueue  fSyncs;                  ///< list of sync markers
          unsigned        fSyncScanIndex;          ///< sync scan index, indicate number of syncs which can really be used for synchronization
          bool            fSyncFlag;               ///< boolean, used in sync adjustment procedure
+         unsigned long   fNumSyncLost{0};         ///< number of sync markers erased while no matching master sync found
 
          LocalMarkersQueue  fLocalMarks;          ///< queue with local markers
          double          fTriggerAcceptMaring;    ///< time margin (in local time) to accept new trigger
@@ -60,16 +61,29 @@ namespace base {
 
          unsigned fGlobalTrigScanIndex;           ///< index with first trigger which is not yet ready
          unsigned fGlobalTrigRightIndex;          ///< temporary value, used during second buffers scan
+         unsigned fGlobalTrigHint{0};             ///< index of first trigger right from last tested hit, used as search start
+         bool fGlobalMarksOrdered{true};          ///< true when left and right boundaries of all triggers are time-ordered
 
          bool fTimeSorting;                       ///< defines if time sorting should be used for the messages
 
          base::H1handle fTriggerTm;  ///<! histogram with time relative to the trigger
+         GlobalTimePs_t fTriggerTmLeft{0};  ///< left range of trigger time histogram
+         GlobalTimePs_t fTriggerTmRight{0}; ///< right range of trigger time histogram
          base::H1handle fMultipl;    ///<! histogram of event multiplicity
 
          base::C1handle fTriggerWindow;   ///<  window used for data selection
 
-         static unsigned fMarksQueueCapacity;   ///< maximum number of items in the marksers queue
-         static unsigned fBufsQueueCapacity;   ///< maximum number of items in the queue
+         unsigned fBufsQueueLimit;        ///< maximal capacity of buffers queue for this processor
+         unsigned fMarksQueueLimit;       ///< maximal capacity of markers queues for this processor
+         unsigned long fNumRejectedBufs{0}; ///< number of buffers rejected because queue reached its limit
+
+         bool fSkipEmptyScans{true};      ///< when true, second scan skipped for buffers without hits in trigger windows
+         unsigned long fNumSkippedScans{0}; ///< number of buffers where second scan was skipped
+
+         static unsigned fMarksQueueCapacity;   ///< initial number of items in the markers queue
+         static unsigned fBufsQueueCapacity;   ///< initial number of items in the queue
+         static unsigned fMarksQueueMaxCapacity; ///< default limit for markers queues
+         static unsigned fBufsQueueMaxCapacity;  ///< default limit for buffers queue
 
          /** Make constructor protected - no way to create base class instance */
          StreamProc(const char* name = "", unsigned brdid = DummyBrdId, bool basehist = true);
@@ -101,6 +115,9 @@ namespace base {
          /** Method should return time, which could be flushed from the processor */
          virtual GlobalTime_t ProvidePotentialFlushTime(GlobalTime_t last_marker);
 
+         /** Method returns earliest global time of data, which is scanned by the processor */
+         virtual bool ProvideFirstDataTime(GlobalTime_t &tm);
+
          /** Method must ensure that processor scanned such time and can really skip this data */
          bool VerifyFlushTime(const base::GlobalTime_t& flush_time);
 
@@ -112,6 +129,16 @@ namespace base {
           *  can_close_event - when true, hit time can be used to decide that event is ready */
          unsigned TestHitTime(const base::GlobalTime_t& hittime, bool normal_hit, bool can_close_event = true);
 
+         unsigned TestHitTimePs(GlobalTimePs_t hitps, bool normal_hit, bool can_close_event = true);
+
+         unsigned TestHitTimeLinear(GlobalTimePs_t hitps, bool normal_hit, bool can_close_event);
+
+         unsigned FindFirstTriggerRight(GlobalTimePs_t hitps);
+
+         bool CanSkipSecondScan(const base::Buffer& buf);
+
+         double GetTriggerWindowLimit(bool isleft);
+
          // TODO: this is another place for future improvement
          // one can preallocate number of subevents with place ready for some messages
          // than one can use these events instead of creating them on the fly
@@ -130,6 +157,9 @@ namespace base {
          /** Removes sync at specified position */
          bool eraseSyncAt(unsigned indx);
 
+         /** Removes cnt syncs starting at specified position */
+         bool eraseSyncsAt(unsigned indx, unsigned cnt);
+
          /** Remove specified number of syncs */
          bool eraseFirstSyncs(unsigned sync_num);
 
@@ -185,6 +215,10 @@ namespace base {
          /** Provide next port of data to the processor */
          virtual bool AddNextBuffer(const Buffer& buf);
 
+         /** Provide next port of data to the processor, buffer released by caller.
+           * Calls AddNextBuffer(const Buffer&), therefore subclasses override only that method */
+         bool AddNextBuffer(Buffer&& buf) { return AddNextBuffer(static_cast<const Buffer&>(buf)); }
+
          /** \brief Scanning all new buffers in the queue
           *  \returns true when any new data was scanned */
          virtual bool ScanNewBuffers();
@@ -202,6 +236,9 @@ namespace base {
          unsigned numSyncs() const { return fSyncs.size(); }
          /** Returns number of read sync markers */
          unsigned numReadySyncs() const { return fSyncScanIndex; }
+
+         /** Returns number of sync markers which were erased without matching master sync */
+         unsigned long GetNumSyncLost() const { return fNumSyncLost; }
          /** Returns sync marker */
          SyncMarker& getSync(unsigned n) { return fSyncs.item(n); }
          unsigned findSyncWithId(unsigned syncid) const;
@@ -244,10 +281,41 @@ namespace base {
           * which are mapped to the branch */
          virtual void ResetStore() {}
 
-         /** Set markers queue capacity */
-         static void SetMarksQueueCapacity(unsigned sz) { fMarksQueueCapacity = sz; }
-         /** Set buffers queue capacity */
-         static void SetBufsQueueCapacity(unsigned sz) { fBufsQueueCapacity = sz; }
+         /** Add hits of subevent, produced by this processor, to the timeslice.
+          * Source is index of processor in \ref base::ProcMgr.
+          * Can be called from worker threads for different timeslices, therefore should not modify processor */
+         virtual void FillTimeslice(base::Timeslice&, base::SubEvent*, unsigned /* source */) {}
+
+         /** Verify configuration for timeslice mode, called before store is created */
+         virtual void CheckTimesliceMode() {}
+
+         /** Set initial markers queue capacity, optionally default limit for new processors */
+         static void SetMarksQueueCapacity(unsigned sz, unsigned limit = 0) { fMarksQueueCapacity = sz; if (limit) fMarksQueueMaxCapacity = limit; }
+         /** Set initial buffers queue capacity, optionally default limit for new processors */
+         static void SetBufsQueueCapacity(unsigned sz, unsigned limit = 0) { fBufsQueueCapacity = sz; if (limit) fBufsQueueMaxCapacity = limit; }
+
+         /** Set limits for queues of this processor. Queues grow when full and shrink when mostly empty.
+           * Global markers queue always can hold all triggers of the manager queue */
+         void SetQueueLimits(unsigned bufs_limit, unsigned marks_limit) { fBufsQueueLimit = bufs_limit; fMarksQueueLimit = marks_limit; }
+
+         /** Returns true when buffers queue reached its limit and no more data can be accepted */
+         bool IsQueueAtLimit() const { return fQueue.size() >= fBufsQueueLimit; }
+
+         /** Returns maximal number of buffers in the queue */
+         unsigned GetBufsQueueHighWater() const { return fQueue.high_water(); }
+
+         unsigned GetMarksQueueHighWater() const;
+
+         /** Returns number of buffers rejected because queue reached its limit */
+         unsigned long GetNumRejectedBufs() const { return fNumRejectedBufs; }
+
+         void AdjustQueuesCapacity();
+
+         /** Enable/disable skipping of second scan for buffers which hits do not overlap with any trigger window */
+         void SetSkipEmptyScans(bool on = true) { fSkipEmptyScans = on; }
+
+         /** Returns number of buffers where second scan was skipped */
+         unsigned long GetNumSkippedScans() const { return fNumSkippedScans; }
 
    };
 
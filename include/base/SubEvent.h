@@ -2,8 +2,14 @@
 #define BASE_SUBEVENT_H
 
 #include <algorithm>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "base/EventArena.h"
+
 namespace base {
 
 
@@ -71,7 +77,7 @@ namespace base {
          }
 
          /** destructor */
-         ~MessageExt() {}
+         ~MessageExt() = default;
 
          /** this is used for timesorting the messages in the filled vectors */
          bool operator<(const MessageExt &rhs) const
@@ -85,13 +91,50 @@ namespace base {
    };
 
 
-   /** Subevent with vector of extended messages*/
+   /** Subevent with vector of extended messages
+    *
+    * Messages can be kept either in std::vector or, when AttachArena() is called,
+    * in memory of the event arena. Arena avoids heap allocations for every new event,
+    * but content remains valid only until event is reset.
+    * Use view() to access messages independent from storage kind */
 
    template<class MsgClass>
    class SubEventEx : public base::SubEvent {
       protected:
          std::vector<MsgClass> fExtMessages;   ///< vector of extended messages
 
+         base::EventArena *fArena{nullptr};    ///<! arena where messages are allocated
+         MsgClass *fArenaMsgs{nullptr};        ///<! messages in the arena
+         unsigned fArenaSize{0};               ///<! number of messages in the arena
+         unsigned fArenaCapacity{0};           ///<! capacity of messages block in the arena
+
+         /** allocate bigger block in the arena, previous block remains in the arena until reset
+           * If arena cannot provide memory, messages moved into vector and arena is detached */
+         bool GrowArena(unsigned newcapacity)
+         {
+            auto msgs = fArena->AllocateArray<MsgClass>(newcapacity);
+            if (!msgs) {
+               DetachArena();
+               fExtMessages.reserve(newcapacity);
+               return false;
+            }
+            if (fArenaSize > 0)
+               std::uninitialized_copy(fArenaMsgs, fArenaMsgs + fArenaSize, msgs);
+            fArenaMsgs = msgs;
+            fArenaCapacity = newcapacity;
+            return true;
+         }
+
+         /** move messages from arena into vector */
+         void DetachArena()
+         {
+            if (!fArena) return;
+            fExtMessages.assign(fArenaMsgs, fArenaMsgs + fArenaSize);
+            fArena = nullptr;
+            fArenaMsgs = nullptr;
+            fArenaSize = fArenaCapacity = 0;
+         }
+
       public:
 
          /** constructor */
@@ -100,34 +143,99 @@ namespace base {
          /** destructor */
          ~SubEventEx() {}
 
+         /** Use event arena for messages storage, capacity defines size of first allocated block
+          * Only possible while subevent is empty, otherwise vector will be used */
+         bool AttachArena(base::EventArena *arena, unsigned capacity)
+         {
+            // arena memory released without calling destructors
+            static_assert(std::is_trivially_destructible<MsgClass>::value, "only trivially destructible messages can be stored in event arena");
+
+            if (!arena || (Size() > 0)) {
+               SetCapacity(capacity);
+               return false;
+            }
+            fArena = arena;
+            fArenaMsgs = nullptr;
+            fArenaSize = fArenaCapacity = 0;
+            if ((capacity > 0) && !GrowArena(capacity))
+               return false;
+            return true;
+         }
+
+         /** Returns true if messages stored in the event arena */
+         bool IsArena() const { return fArena != nullptr; }
+
          /** Add new message to sub-event */
-         void AddMsg(const MsgClass &_msg) { fExtMessages.emplace_back(_msg); }
+         void AddMsg(const MsgClass &_msg) { EmplaceMsg(_msg); }
+
+         /** Construct new message in the sub-event */
+         template<class... Args>
+         void EmplaceMsg(Args&&... args)
+         {
+            if (fArena && (fArenaSize == fArenaCapacity))
+               GrowArena(fArenaCapacity < 8 ? 16 : fArenaCapacity * 2);
+
+            if (!fArena)
+               fExtMessages.emplace_back(std::forward<Args>(args)...);
+            else
+               new (fArenaMsgs + fArenaSize++) MsgClass(std::forward<Args>(args)...);
+         }
 
          /** Returns number of messages */
-         unsigned Size() const { return fExtMessages.size(); }
+         unsigned Size() const { return fArena ? fArenaSize : fExtMessages.size(); }
 
          /** Returns capacity of the message container */
-         unsigned Capacity() const { return fExtMessages.capacity(); }
+         unsigned Capacity() const { return fArena ? fArenaCapacity : fExtMessages.capacity(); }
 
          /** Change capacity of the container */
-         void SetCapacity(unsigned sz) { fExtMessages.reserve(sz); }
+         void SetCapacity(unsigned sz)
+         {
+            if (!fArena)
+               fExtMessages.reserve(sz);
+            else if (sz > fArenaCapacity)
+               GrowArena(sz);
+         }
 
          /** Returns message with specified index */
-         MsgClass &msg(unsigned indx) { return fExtMessages[indx]; }
+         MsgClass &msg(unsigned indx) { return fArena ? fArenaMsgs[indx] : fExtMessages[indx]; }
 
-         /** Returns pointer on vector with messages, used in the store */
-         std::vector<MsgClass>* vect_ptr() { return &fExtMessages; }
+         /** Returns view on all messages */
+         base::Span<MsgClass> view()
+         {
+            return fArena ? base::Span<MsgClass>(fArenaMsgs, fArenaSize) : base::Span<MsgClass>(fExtMessages.data(), fExtMessages.size());
+         }
+
+         /** Returns pointer on vector with messages, used in the store
+          * If messages were kept in the arena, they moved into vector */
+         std::vector<MsgClass>* vect_ptr() { DetachArena(); return &fExtMessages; }
+
+         /** Returns pointer on vector with messages, used in the store
+          * If messages are kept in the arena, they copied into provided vector,
+          * which capacity can be reused from event to event */
+         std::vector<MsgClass>* store_ptr(std::vector<MsgClass> &tgt)
+         {
+            if (!fArena) return &fExtMessages;
+            tgt.assign(fArenaMsgs, fArenaMsgs + fArenaSize);
+            return &tgt;
+         }
 
          /** Returns subevent multiplicity  */
          unsigned Multiplicity() const override { return Size(); }
 
-         /** Clear subevent - remove all messages */
-         void Clear() override { fExtMessages.clear(); }
+         /** Clear subevent - remove all messages, arena is detached */
+         void Clear() override
+         {
+            fExtMessages.clear();
+            fArena = nullptr;
+            fArenaMsgs = nullptr;
+            fArenaSize = fArenaCapacity = 0;
+         }
 
          /** Do time sorting of messages */
          void Sort() override
          {
-            std::sort(fExtMessages.begin(), fExtMessages.end());
+            auto v = view();
+            std::sort(v.begin(), v.end());
          }
 
    };
@@ -12,6 +12,7 @@ namespace base {
     *    local stamp - 64-bit unsigned integer (LocalStamp_t), can be analyzed only locally
     *    local time  - double in seconds (GlobalTime_t), adjust all local differences, should be without wrap
     *    global time - double in seconds (GlobalTime_t), universal time used for global actions like RoI declaration
+    *    global time in picoseconds - 64-bit integer (GlobalTimePs_t), used for trigger window compare
     *  In case when stream does not required time synchronization local time automatically used as global
     */
 
@@ -27,6 +28,27 @@ namespace base {
    typedef double GlobalTime_t;
 
 
+   /** type for global time in integer picoseconds
+     * Used for compare of hit times with trigger windows, range covers about 50 days.
+     * Values produced by rounding of GlobalTime_t, therefore precision is not better than double time */
+   typedef int64_t GlobalTimePs_t;
+
+   /** limit for picoseconds time, used to represent infinite intervals */
+   const GlobalTimePs_t GlobalTimePsLimit = ((GlobalTimePs_t) 1) << 62;
+
+   /** convert time in seconds into picoseconds, rounded to nearest and limited by GlobalTimePsLimit */
+   inline GlobalTimePs_t SecondsToPs(GlobalTime_t tm)
+   {
+      double ps = tm * 1e12;
+      if (ps >= (double) GlobalTimePsLimit) return GlobalTimePsLimit;
+      if (ps <= -(double) GlobalTimePsLimit) return -GlobalTimePsLimit;
+      return (GlobalTimePs_t) (ps < 0 ? ps - 0.5 : ps + 0.5);
+   }
+
+   /** convert time in picoseconds into seconds */
+   inline GlobalTime_t PsToSeconds(GlobalTimePs_t ps) { return ps * 1e-12; }
+
+
    /** LocalStampConverter class should perform
     *  conversion of time stamps to time in seconds.
     *  Main problem to solve - handle correctly time stamp wraps.
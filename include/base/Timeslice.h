@@ -0,0 +1,101 @@
+#ifndef BASE_TIMESLICE_H
+#define BASE_TIMESLICE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "base/SubEvent.h"
+#include "base/TimeStamp.h"
+
+namespace base {
+
+   /** \brief Timeslice - all hits of all streams in fixed time interval
+    *
+    * \ingroup stream_core_classes
+    *
+    * Produced by \ref base::ProcMgr when timeslice mode is configured.
+    * Hits are stored column-wise in contiguous arrays: global time, source (index of stream processor),
+    * channel and flags. Hits sorted by global time. Timeslice begins overlap time before its nominal start,
+    * hits from this range are also delivered with previous timeslice */
+
+   class Timeslice : public SubEvent {
+      protected:
+         GlobalTime_t fStart{0.};             ///< nominal start of timeslice
+         GlobalTime_t fLength{0.};            ///< timeslice length
+         GlobalTime_t fOverlap{0.};           ///< overlap with previous timeslice
+         std::vector<GlobalTime_t> fTime;     ///< hits global time
+         std::vector<uint16_t> fSource;       ///< index of stream processor
+         std::vector<uint16_t> fChannel;      ///< hits channel
+         std::vector<uint8_t> fFlags;         ///< hits flags, see EFlags
+         std::vector<unsigned> fOrder;        ///<! temporary, used for sorting
+
+      public:
+
+         /** hit flags */
+         enum EFlags { kFalling = 1 };
+
+         /** default constructor */
+         Timeslice() = default;
+
+         /** constructor */
+         Timeslice(GlobalTime_t start, GlobalTime_t length, GlobalTime_t overlap) :
+            fStart(start), fLength(length), fOverlap(overlap) {}
+
+         /** nominal start of timeslice */
+         GlobalTime_t GetStart() const { return fStart; }
+         /** timeslice length */
+         GlobalTime_t GetLength() const { return fLength; }
+         /** overlap with previous timeslice */
+         GlobalTime_t GetOverlap() const { return fOverlap; }
+         /** time of first possible hit, including overlap */
+         GlobalTime_t GetFirstTime() const { return fStart - fOverlap; }
+         /** end of timeslice, not included */
+         GlobalTime_t GetEndTime() const { return fStart + fLength; }
+
+         /** Add hit, hits outside timeslice range are ignored */
+         bool AddHit(GlobalTime_t tm, unsigned source, unsigned channel, unsigned flags = 0)
+         {
+            if ((tm < GetFirstTime()) || (tm >= GetEndTime())) return false;
+            fTime.emplace_back(tm);
+            fSource.emplace_back(source);
+            fChannel.emplace_back(channel);
+            fFlags.emplace_back(flags);
+            return true;
+         }
+
+         /** Number of hits */
+         unsigned Size() const { return fTime.size(); }
+
+         /** hit time */
+         GlobalTime_t time(unsigned indx) const { return fTime[indx]; }
+         /** hit source - index of stream processor, see \ref base::ProcMgr::GetProc */
+         unsigned source(unsigned indx) const { return fSource[indx]; }
+         /** hit channel */
+         unsigned channel(unsigned indx) const { return fChannel[indx]; }
+         /** hit flags */
+         unsigned flags(unsigned indx) const { return fFlags[indx]; }
+
+         /** column with hits time */
+         const GlobalTime_t *times() const { return fTime.data(); }
+         /** column with hits sources */
+         const uint16_t *sources() const { return fSource.data(); }
+         /** column with hits channels */
+         const uint16_t *channels() const { return fChannel.data(); }
+         /** column with hits flags */
+         const uint8_t *flags() const { return fFlags.data(); }
+
+         /** Multiplicity - number of hits */
+         unsigned Multiplicity() const override { return Size(); }
+
+         void Clear() override;
+
+         void Sort() override;
+
+         void CopyHits(const Timeslice &src, GlobalTime_t from);
+
+         void InsertFront(const Timeslice &src);
+   };
+
+}
+
+#endif
@@ -33,6 +33,12 @@ namespace base {
       kind_Stream       ///< normal analysis
    };
 
+   /** Storage kind of bins in internal histogram format */
+   enum HistStorageKind {
+      hist_Double = 0,  ///< default, header and bins as double values
+      hist_Float  = 1   ///< header with inverse bin width, bins as float values
+   };
+
    typedef void* H1handle;
    typedef void* H2handle;
    typedef void* C1handle;
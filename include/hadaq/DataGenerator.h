@@ -0,0 +1,180 @@
+#ifndef HADAQ_DATAGENERATOR_H
+#define HADAQ_DATAGENERATOR_H
+
+#include "base/Buffer.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace hadaq {
+
+   /** \brief Generator of synthetic TDC data
+     *
+     * \ingroup stream_hadaq_classes
+     *
+     * Produces HLD events with TRB3 TDC (v3) data or DOGMA events with TDC5 packets.
+     * HLD event contains one subevent per TRB with data of configured number of TDCs,
+     * DOGMA event contains TDC5 packets of all TDCs.
+     * Channel 0 always has hit at trigger time, other channels get Poisson-distributed number of hits
+     * with rising and falling edges. Every N-th event can be 0xD calibration trigger with
+     * single hit in all channels. Sequence is fully defined by configuration and random seed,
+     * therefore same data can be reproduced without real data files */
+
+   class DataGenerator {
+      public:
+
+         /** kinds of errors, which can be injected into data */
+         enum ErrorKind {
+            err_MissingHit = 0x1,   ///< hit with 0x3ff fine counter
+            err_Channel = 0x2,      ///< channel number outside of configured range
+            err_Fine = 0x4,         ///< fine counter outside of allowed range
+            err_Header = 0x8,       ///< error bits in TDC header, only for TDC v3
+            err_All = 0xf           ///< all kinds of errors
+         };
+
+      protected:
+
+         /** single hit */
+         struct HitRec {
+            uint64_t tm;        ///< coarse time
+            unsigned ch;        ///< channel
+            unsigned fine;      ///< fine counter
+            bool rising;        ///< rising edge
+         };
+
+         bool fDogma{false};              ///< produce DOGMA events with TDC5 data
+         unsigned fNumTrbs{1};            ///< number of TRBs (subevents) in event
+         unsigned fNumTdcs{4};            ///< number of TDCs in each TRB
+         unsigned fNumChannels{33};       ///< number of channels in each TDC, including channel 0
+         unsigned fTrbId{0x8000};         ///< id of first TRB
+         unsigned fTdcId{0x0100};         ///< id of first TDC, all TDCs get consequent ids
+         uint32_t fRunId{0};              ///< run id
+         double fMeanHits{1.};            ///< mean number of hits per channel
+         double fWindow{500.};            ///< time window before trigger where hits are distributed, ns
+         double fTot{30.};                ///< time over threshold of normal hits, 0 - no falling edges, ns
+         double fTrigPeriod{10000.};      ///< time between triggers, ns
+         unsigned fTrigType{0x1};         ///< trigger type of normal events
+         unsigned fCalibrPeriod{0};       ///< every N-th event is 0xD calibration trigger, 0 - off
+         unsigned fEpochWrap{0};          ///< event number when 28-bit epoch counter of TDC v3 overflows, 0 - off
+         bool fSwapped{true};             ///< produce HLD subevents in swapped (big-endian) format
+         double fErrorRate{0.};           ///< probability of error injection per event
+         unsigned fErrorMask{err_All};    ///< kinds of injected errors
+         uint64_t fSeed{1};               ///< random seed
+
+         uint64_t fRandom{1};             ///< random generator state
+         double fExpMean{0.};             ///< exp(-fMeanHits), used for Poisson distribution
+         double fCoarseUnit{5.};          ///< coarse counter unit, ns
+         unsigned fFineMin{0};            ///< minimal fine counter value
+         unsigned fFineMax{0};            ///< maximal fine counter value
+         uint64_t fTrigTime{0};           ///< current trigger time in coarse units
+         uint32_t fSeqNr{0};              ///< current event number
+         std::vector<HitRec> fHits;       ///< hits of current TDC
+         std::vector<uint32_t> fEvent;    ///< current event
+         std::vector<uint8_t> fPacket;    ///< payload of TDC5 packet
+         unsigned fEventSize{0};          ///< size of current event in bytes
+         bool fPending{false};            ///< current event was not yet delivered
+
+         unsigned long fNumEvents{0};     ///< number of generated events
+         unsigned long fNumHits{0};       ///< number of generated hits
+         unsigned long fNumErrors{0};     ///< number of injected errors
+
+         /** Random 32-bit value */
+         uint32_t Random()
+         {
+            fRandom ^= fRandom >> 12;
+            fRandom ^= fRandom << 25;
+            fRandom ^= fRandom >> 27;
+            return (fRandom * 2685821657736338717ULL) >> 32;
+         }
+
+         /** Random value in range [0..1) */
+         double RandomUniform() { return Random() / 4294967296.; }
+
+         unsigned RandomPoisson();
+
+         /** Random fine counter value */
+         unsigned RandomFine() { return fFineMin + Random() % (fFineMax - fFineMin + 1); }
+
+         /** Convert time in ns into coarse units */
+         uint64_t ToCoarse(double ns) const { return (uint64_t) (ns / fCoarseUnit + 0.5); }
+
+         void MakeHits(bool calibr);
+         unsigned InjectError();
+         void AddTdc3Data(unsigned tdcid, bool errheader);
+         void AddTdc5Packet(unsigned tdcid, unsigned trigtype);
+         void BuildHldEvent(unsigned trigtype, int errtdc);
+         void BuildDogmaEvent(unsigned trigtype, int errtdc);
+         void BuildEvent();
+
+      public:
+
+         DataGenerator();
+         virtual ~DataGenerator() {}
+
+         /** Produce DOGMA events with TDC5 packets instead of HLD events with TDC v3 data */
+         void SetDogma(bool on = true) { fDogma = on; Reset(); }
+         /** Returns true if DOGMA events are produced */
+         bool IsDogma() const { return fDogma; }
+
+         /** Configure number of TRBs, TDCs per TRB and channels per TDC (including channel 0) */
+         void SetLayout(unsigned numtrbs, unsigned numtdcs, unsigned numch)
+         {
+            fNumTrbs = numtrbs ? numtrbs : 1;
+            fNumTdcs = numtdcs ? numtdcs : 1;
+            fNumChannels = numch > 1 ? numch : 2;
+         }
+
+         /** Configure id of first TRB and first TDC, all others get consequent ids */
+         void SetIds(unsigned trbid, unsigned tdcid) { fTrbId = trbid; fTdcId = tdcid; }
+
+         /** Configure run id */
+         void SetRunId(uint32_t runid) { fRunId = runid; }
+
+         /** Configure mean number of hits per channel, hits window before trigger and time over threshold in ns */
+         void SetHits(double mean, double window = 500., double tot = 30.)
+         {
+            fMeanHits = mean > 0 ? mean : 0.;
+            fWindow = window > 1 ? window : 1.;
+            fTot = tot > 0 ? tot : 0.;
+         }
+
+         /** Configure time between triggers in ns, trigger type of normal events
+           * and period of 0xD calibration triggers, 0 - no calibration triggers */
+         void SetTrigger(double period, unsigned trigtype = 0x1, unsigned calibrperiod = 0)
+         {
+            fTrigPeriod = period > 0 ? period : 1.;
+            fTrigType = trigtype & 0xf;
+            fCalibrPeriod = calibrperiod;
+         }
+
+         /** Configure event number when 28-bit epoch counter of TDC v3 overflows, 0 - epoch starts from 0 */
+         void SetEpochWrap(unsigned evnt) { fEpochWrap = evnt; Reset(); }
+
+         /** Configure swapped (big-endian) format of HLD subevents, as produced by TRBs */
+         void SetSwapped(bool on = true) { fSwapped = on; }
+
+         /** Configure probability of error per event and kinds of injected errors */
+         void SetErrors(double rate, unsigned mask = err_All) { fErrorRate = rate; fErrorMask = mask; }
+
+         /** Configure random seed, restarts sequence */
+         void SetSeed(uint64_t seed) { fSeed = seed; Reset(); }
+
+         void Reset();
+
+         const void *NextEvent(unsigned &size);
+
+         unsigned FillBuffer(base::Buffer &buf, unsigned maxevents, unsigned bufsize = 0x100000);
+
+         bool WriteFile(const char *fname, unsigned numevents);
+
+         /** Returns number of generated events */
+         unsigned long GetNumEvents() const { return fNumEvents; }
+         /** Returns number of generated hits, including channel 0 */
+         unsigned long GetNumHits() const { return fNumHits; }
+         /** Returns number of injected errors */
+         unsigned long GetNumErrors() const { return fNumErrors; }
+   };
+
+}
+
+#endif
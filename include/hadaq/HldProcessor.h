@@ -95,6 +95,10 @@ namespace hadaq {
 
          TrbProcMap fMap;            ///< map of trb processors
 
+         std::vector<uint16_t> fTrbDispatch;            ///<! index in fTrbDispatchProcs for 16-bit subevent ids
+         std::vector<TrbProcessor *> fTrbDispatchProcs; ///<! TRB processors from dispatch table, first entry is nullptr
+         bool fTrbDispatchDirty{true};                  ///<! when true, dispatch table must be rebuild
+
          unsigned  fEventTypeSelect; ///< selection for event type (lower 4 bits in event id)
          bool      fFilterStatusEvents; ///< filter out status events
 
@@ -105,6 +109,8 @@ namespace hadaq {
          bool fUseThreads{false};     ///< enables multi-threading for TRB3 processing
          bool fThreadsCreated{false}; ///< flag set when threads already  created
          unsigned fThrdEventsProcessed{0}; ///< events processed
+         unsigned long fNumIncompleteEvents{0}; ///< events where TRBs could not deliver data to sub-processors
+         unsigned long fNumEvents{0};  ///< events scanned, without events skipped by type selection
 
          std::string fCalibrName;      ///< name of calibration for (auto)created components
          long fCalibrPeriod;           ///< how often calibration should be performed
@@ -187,6 +193,15 @@ namespace hadaq {
          TrbProcessor* GetTRB(unsigned indx) const;
          TrbProcessor* FindTRB(unsigned trbid) const;
 
+         void BuildTrbDispatch();
+
+         /** Fast TRB lookup via dispatch table, falls back to map for ids above 0xffff */
+         TrbProcessor *LookupTRB(unsigned trbid)
+         {
+            if (fTrbDispatchDirty) BuildTrbDispatch();
+            return trbid < 0x10000 ? fTrbDispatchProcs[fTrbDispatch[trbid]] : FindTRB(trbid);
+         }
+
          void ConfigureCalibration(const std::string& fileprefix, long period, unsigned trig = 0xFFFF);
 
          /** Set event type, only used in the analysis */
@@ -196,6 +211,14 @@ namespace hadaq {
          void SetFilterStatusEvents(bool on = true) { fFilterStatusEvents = on; }
          bool GetFilterStatusEvents() const { return fFilterStatusEvents; }
 
+         unsigned long GetNumRejectedSubBufs() const;
+
+         /** Returns number of events with data rejected by sub-processors because their queues reached limit */
+         unsigned long GetNumIncompleteEvents() const { return fNumIncompleteEvents; }
+
+         /** Returns number of scanned events, events skipped by type selection are not counted */
+         unsigned long GetNumEvents() const { return fNumEvents; }
+
          void SetTriggerWindow(double left, double right) override;
 
          void SetStoreKind(unsigned kind = 1) override;
@@ -49,6 +49,7 @@ protected:
 
    std::vector<hadaq::MdcMessage> fDummyFloat;  ///<! vector with messages
    std::vector<hadaq::MdcMessage> *pStoreFloat{nullptr}; ///<! pointer on store vector
+   hadaq::MdcSubEvent *pEvent{nullptr}; ///<! subevent filled in triggered analysis
 
    void CreateBranch(TTree *) override;
    void Store(base::Event* ev) override;
@@ -0,0 +1,79 @@
+#ifndef HADAQ_TDCDECODER_H
+#define HADAQ_TDCDECODER_H
+
+#include <cstdint>
+#include <vector>
+
+namespace hadaq {
+
+/** \brief Batch decoder of TDC messages
+  *
+  * \ingroup stream_hadaq_classes
+  *
+  * Decodes complete buffer of TDC messages at once into structure-of-arrays:
+  * unswapped words, message kind, hit channel, edge, coarse and fine counters.
+  * For every message index of last epoch message (at or before the message) is resolved,
+  * therefore hits processing does not need to track epoch state.
+  * Depending on CPU capabilities AVX2, SSE4.1 or scalar code is used,
+  * all variants produce identical results */
+
+   class TdcDecoder {
+      protected:
+         std::vector<uint32_t> fWords;      ///<! unswapped message words
+         std::vector<uint8_t>  fKind;       ///<! message kind - upper 3 bits of the word
+         std::vector<uint8_t>  fChannel;    ///<! hit channel
+         std::vector<uint8_t>  fEdge;       ///<! hit edge, 1 - rising
+         std::vector<uint16_t> fCoarse;     ///<! hit coarse counter
+         std::vector<uint16_t> fFine;       ///<! hit fine counter
+         std::vector<int32_t>  fEpochIndx;  ///<! index of last epoch message, -1 if not exists
+         unsigned              fSize{0};    ///<! number of decoded messages
+
+         void Reserve(unsigned len);
+
+      public:
+
+         /** message kind, returned by kind() method */
+         enum EKind {
+            kTrailer = 0, kHeader = 1, kDebug = 2, kEpoch = 3,
+            kHit = 4, kHit1 = 5, kHit2 = 6, kCalibr = 7
+         };
+
+         unsigned Decode(const uint32_t *src, unsigned len, bool swapped);
+
+         /** number of decoded messages */
+         unsigned size() const { return fSize; }
+
+         /** unswapped message word */
+         uint32_t word(unsigned indx) const { return fWords[indx]; }
+
+         /** message kind, see EKind */
+         unsigned kind(unsigned indx) const { return fKind[indx]; }
+
+         /** true if any kind of hit message */
+         bool isHit(unsigned indx) const { return (fKind[indx] >= kHit) && (fKind[indx] <= kHit2); }
+
+         /** hit channel */
+         unsigned channel(unsigned indx) const { return fChannel[indx]; }
+
+         /** true for rising edge */
+         bool isRising(unsigned indx) const { return fEdge[indx] != 0; }
+
+         /** hit coarse counter */
+         unsigned coarse(unsigned indx) const { return fCoarse[indx]; }
+
+         /** hit fine counter */
+         unsigned fine(unsigned indx) const { return fFine[indx]; }
+
+         /** index of epoch message valid for this message, -1 if no epoch before */
+         int epochIndex(unsigned indx) const { return fEpochIndx[indx]; }
+
+         /** epoch value of the epoch message */
+         uint32_t epochValue(int epindx) const { return fWords[epindx] & 0xFFFFFFF; }
+
+         static int GetSimdLevel();
+         static void SetSimdLevel(int lvl);
+   };
+
+}
+
+#endif
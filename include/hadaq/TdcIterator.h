@@ -77,7 +77,7 @@ namespace hadaq {
             if (!fBuf) return false;
 
             if (fSwapped)
-               fMsg.assign((((uint8_t *) fBuf)[0] << 24) | (((uint8_t *) fBuf)[1] << 16) | (((uint8_t *) fBuf)[2] << 8) | (((uint8_t *) fBuf)[3]));
+               fMsg.assign(HADAQ_SWAP4(*fBuf));
             else
                fMsg.assign(*fBuf);
 
@@ -95,7 +95,7 @@ namespace hadaq {
             if (!fBuf) return false;
 
             if (fSwapped)
-               fMsg.assign((((uint8_t *) fBuf)[0] << 24) | (((uint8_t *) fBuf)[1] << 16) | (((uint8_t *) fBuf)[2] << 8) | (((uint8_t *) fBuf)[3]));
+               fMsg.assign(HADAQ_SWAP4(*fBuf));
             else
                fMsg.assign(*fBuf);
 
@@ -113,7 +113,7 @@ namespace hadaq {
             if (!fBuf)
                return false;
             if (fSwapped)
-               msg.assign((((uint8_t *) fBuf)[0] << 24) | (((uint8_t *) fBuf)[1] << 16) | (((uint8_t *) fBuf)[2] << 8) | (((uint8_t *) fBuf)[3]));
+               msg.assign(HADAQ_SWAP4(*fBuf));
             else
                msg.assign(*fBuf);
             return true;
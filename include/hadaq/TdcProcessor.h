@@ -5,6 +5,7 @@
 
 #include "hadaq/TdcMessage.h"
 #include "hadaq/TdcIterator.h"
+#include "hadaq/TdcDecoder.h"
 #include "hadaq/TdcSubEvent.h"
 
 #include <vector>
@@ -224,6 +225,7 @@ namespace hadaq {
 
          TdcIterator fIter1;         ///<! iterator for the first scan
          TdcIterator fIter2;         ///<! iterator for the second scan
+         TdcDecoder  fDecoder;       ///<! batch decoder of messages, used in both scans
 
          base::H1handle fChannels{nullptr};   ///<! histogram with messages per channel
          base::H1handle fHits{nullptr};       ///<! histogram with hits per channel
@@ -276,6 +278,19 @@ namespace hadaq {
          float                    fCalibrTempCoef;    ///<! coefficient to scale calibration curve (real value -1)
          bool                     fCalibrUseTemp;     ///<! when true, use temperature adjustment for calibration
          unsigned                 fCalibrTriggerMask; ///<! mask with enabled for trigger events ids, default all
+         std::vector<float>       fCalibrTable;       ///<! compiled calibration [ch][edge][fine] with ToT shift and temperature correction, s
+         bool                     fCalibrTableDirty{true}; ///<! when true, compiled calibration table must be rebuild
+         float                    fCalibrTableTemp{-1.};   ///<! temperature used when building compiled calibration table, -1 without compensation
+
+         /** entry of integer correction table, used in fast transform */
+         struct TransformEntry {
+            uint16_t fine{0};   ///< new fine counter
+            int16_t coarse{0};  ///< correction of coarse counter, >0 subtract, <0 add
+         };
+
+         std::vector<TransformEntry> fTransformTable; ///<! integer corrections [ch][edge][fine+1], last entry for zero correction
+         unsigned                 fTransformTableMode{0};     ///<! mode of transform table: 0 - none, 1 - in place, 2 - to target
+         bool                     fTransformTableDirty{true}; ///<! when true, transform table must be rebuild
 
          bool                     fToTdflt;        ///<! indicate if default setting used, which can be adjusted after seeing first event
          double                   fToTvalue;       ///<! ToT of 0xd trigger
@@ -283,6 +298,10 @@ namespace hadaq {
          double                   fToThmin;        ///<! histogram min
          double                   fToThmax;        ///<! histogram max
          double                   fTotUpperLimit;  ///<! upper limit for ToT range check
+
+         bool                     fDelayedCalibr{false};      ///<! calibration checks and logging delayed, used by parallel transform
+         bool                     fPendingToTLog{false};      ///<! ToT configuration should be logged
+         bool                     fPendingCalibrCheck{false}; ///<! calibration progress should be checked
          int                      fTotStatLimit;   ///<! how much statistic required for ToT calibration
          double                   fTotRMSLimit;    ///<! maximal RMS valus for complete calibration
 
@@ -306,6 +325,7 @@ namespace hadaq {
 
          std::vector<hadaq::TdcMessageExt>  fDummyVect; ///<! dummy empty vector
          std::vector<hadaq::TdcMessageExt> *pStoreVect{nullptr}; ///<! pointer on store vector
+         hadaq::TdcSubEvent               *pEventVect{nullptr}; ///<! pointer on current event
 
          std::vector<hadaq::MessageFloat> fDummyFloat;  ///<! vector with compact messages
          std::vector<hadaq::MessageFloat> *pStoreFloat = nullptr; ///<! pointer on store vector
@@ -313,6 +333,20 @@ namespace hadaq {
 
          std::vector<hadaq::MessageDouble> fDummyDouble;  ///<! vector with compact messages
          std::vector<hadaq::MessageDouble> *pStoreDouble = nullptr; ///<! pointer on store vector
+         hadaq::TdcSubEventDouble          *pEventDouble = nullptr; ///<! pointer on current event
+
+         std::vector<hadaq::MessageInt>   fDummyInt;    ///<! vector with integer messages
+         std::vector<hadaq::MessageInt>   *pStoreInt = nullptr; ///<! pointer on store vector
+         hadaq::TdcSubEventInt            *pEventInt = nullptr; ///<! pointer on current event
+         std::vector<double>              fStoreRef;    ///<! reference time of integer messages, one entry per event
+         std::vector<double>              *pStoreRef = &fStoreRef; ///<! pointer on reference time vector
+
+         bool fStoreBranch{false};  ///<! true when TTree branch created for the store vector
+
+         int fColumnGroup{-1};      ///<! group in columnar store
+         int fColumnCh{-1};         ///<! column with channel and edge or with raw message for store kind 1
+         int fColumnStamp{-1};      ///<! column with time stamp
+         int fColumnRef{-1};        ///<! column with reference time for store kind 4
 
          /** EdgeMask defines how TDC calibration for falling edge is performed
           * 0,1 - use only rising edge, falling edge is ignore
@@ -348,6 +382,7 @@ namespace hadaq {
          TdcMessage fLastTdcTrailer;      ///<! copy of last TDC trailer
 
          long      fRateCnt;             ///<! counter used for rate calculation
+         unsigned long fNumHits{0};      ///<! number of hits processed by first scan or transformation
          double    fLastRateTm = -1.;    ///<! last ch0 time when rate was calculated
          double    fRef0Time = 0.;       ///<! absolute ref time, set once when first channel0 time will be seen
 
@@ -381,6 +416,8 @@ namespace hadaq {
          static bool gStoreCalibrTables;   ///<! when enabled, store calibration tables for v4 TDC
          static bool gPreventFineCalibration;  ///<! when enabled, not produce calibration but just fill extra histograms
          static int gTimeRefKind;          ///<! which time used as reference for time stamps
+         static bool gFastTransform;       ///<! when enabled, fast transform kernel is used when possible
+         static bool gScanKernels;         ///<! when enabled, specialised scan kernels without histograms filling are used
 
          void AppendTrbSync(uint32_t syncid) override;
 
@@ -390,7 +427,23 @@ namespace hadaq {
 
          int GetBinsPerNS(double range = 1.) const;
 
+         /** Add hit to the event with integer time stamps, relative to trigger marker time.
+           * Stamps of hits inside trigger window always fit into int32 */
+         void AddIntMessage(unsigned indx, unsigned chid, bool isrising, double globaltm)
+         {
+            auto subev = (hadaq::TdcSubEventInt *) fGlobalMarks.item(indx).subev;
+            if (!subev) {
+               subev = new hadaq::TdcSubEventInt;
+               subev->SetTriggerTime(fGlobalMarks.item(indx).globaltm);
+               fGlobalMarks.item(indx).subev = subev;
+            }
+            subev->AddMsg(hadaq::MessageInt(chid, isrising, hadaq::MessageInt::ToStamp(globaltm - subev->GetTriggerTime())));
+         }
+
          bool DoBufferScan(const base::Buffer &buf, bool isfirst);
+         template<bool FIRST, unsigned STORE, bool HISTS, bool TIMEOPT>
+         bool DoBufferScanT(const base::Buffer &buf);
+         bool HasScanHistos() const;
          bool DoBuffer4Scan(const base::Buffer &buf, bool isfirst);
          bool DoBuffer5Scan(const base::Buffer &buf, bool isfirst);
 
@@ -424,6 +477,32 @@ namespace hadaq {
 
          float ExtractCalibr(const std::vector<float> &func, unsigned bin);
 
+         void BuildCalibrTable();
+
+         void BuildTransformTable(unsigned mode);
+
+         unsigned TransformTdcDataFast(hadaqs::RawSubevent* sub, uint32_t *rawdata, unsigned indx, unsigned datalen, hadaqs::RawSubevent* tgt, unsigned tgtindx);
+
+         /** Returns true if temperature compensation is applied to calibration */
+         inline bool IsTempCompensation() const
+         {
+            return fCalibrUseTemp && (fCalibrTemp > 0) && (fCurrentTemp > 0);
+         }
+
+         /** Rebuild compiled calibration table if calibration was changed
+           * or temperature was changed while compensation is active */
+         inline void CheckCalibrTable()
+         {
+            if (fCalibrTableDirty || (fCalibrTableTemp != (IsTempCompensation() ? fCurrentTemp : -1.f)))
+               BuildCalibrTable();
+         }
+
+         /** Returns complete correction from compiled calibration table, including ToT shift and temperature compensation */
+         inline float GetTableCalibr(unsigned ch, bool isrising, unsigned fine) const
+         {
+            return fCalibrTable[(ch*2 + (isrising ? 0 : 1))*fNumFineBins + fine];
+         }
+
          /** extract calibration value */
          inline float ExtractCalibrDirect(const std::vector<float> &func, unsigned bin)
          {
@@ -451,6 +530,10 @@ namespace hadaq {
 
          void CreateBranch(TTree*) override;
 
+         void CreateColumns(base::ColumnStoreWriter*) override;
+
+         void StoreColumns();
+
          void AddError(unsigned code, const char *args, ...);
 
       public:
@@ -512,6 +595,10 @@ namespace hadaq {
 
          static void SetTimeRefKind(int kind = -1);
 
+         static void SetScanKernels(bool on = true);
+
+         static void SetFastTransform(bool on = true);
+
          /** Set number of TDC messages, which should be skipped from subevent before analyzing it */
          void SetSkipTdcMessages(unsigned cnt = 0) { fSkipTdcMessages = cnt; }
 
@@ -573,6 +660,9 @@ namespace hadaq {
             return res;
          }
 
+         /** Get number of hits processed by first scan or transformation */
+         unsigned long GetNumHits() const { return fNumHits; }
+
          /** Get number of indexed histograms */
          int GetNumHist() const { return 9; }
 
@@ -662,6 +752,7 @@ namespace hadaq {
          {
             fCalibrTriggerMask = trigmask & 0x3FFF;
             fCalibrUseTemp = (trigmask & 0x80000000) != 0;
+            fCalibrTableDirty = fTransformTableDirty = true;
          }
 
          /** Set temperature coefficient, which is applied to calibration curves
@@ -669,18 +760,21 @@ namespace hadaq {
          void SetCalibrTempCoef(float coef)
          {
             fCalibrTempCoef = coef;
+            fCalibrTableDirty = fTransformTableDirty = true;
          }
 
          /** Set shift for the channel time stamp, which is added with temperature change */
          void SetChannelTempShift(unsigned ch, float shift_per_grad)
          {
             if (ch < fCh.size()) fCh[ch].time_shift_per_grad = shift_per_grad;
+            fCalibrTableDirty = fTransformTableDirty = true;
          }
 
          /** Set channel TOT shift in nano-seconds, typical value is around 30 ns */
          void SetChannelTotShift(unsigned ch, float tot_shift)
          {
             if (ch < fCh.size()) fCh[ch].tot_shift = tot_shift;
+            fCalibrTableDirty = fTransformTableDirty = true;
          }
 
          /** Returns channel TOT shift in nano-seconds */
@@ -760,6 +854,12 @@ namespace hadaq {
 
          void ConfigureToTByHwType(unsigned hwtype);
 
+         /** When enabled, calibration checks and logging during transform are delayed until
+          * \ref ProcessDelayedCalibr is called. Used when TDCs transformed in parallel threads */
+         void SetDelayedCalibr(bool on = true) { fDelayedCalibr = on; }
+
+         void ProcessDelayedCalibr();
+
          /** When enabled, last hit time in the channel used for reference time calculations
           * By default, first hit time is used
           * Special case is reference to channel 0 - here all hits will be used */
@@ -791,6 +891,8 @@ namespace hadaq {
           * if returned false, buffer has error and must be discarded */
          bool FirstBufferScan(const base::Buffer& buf) override
          {
+            base::ProfilerGuard grd(fProfiler, "scan", 0);
+            SelectSampledEvent();
             switch(fVersion) {
                case 4: return DoBuffer4Scan(buf, true);
                case 5: return DoBuffer5Scan(buf, true);
@@ -817,7 +919,7 @@ namespace hadaq {
          float GetCalibrTemp() const { return fCalibrTemp; }
 
          /** Set temperature used for calibration */
-         void SetCalibrTemp(float v) { fCalibrTemp = v; }
+         void SetCalibrTemp(float v) { fCalibrTemp = v; fCalibrTableDirty = fTransformTableDirty = true; }
 
          void StoreCalibration(const std::string& fname, unsigned fileid = 0);
 
@@ -830,6 +932,12 @@ namespace hadaq {
 
          void ResetStore() override;
 
+         void FillTimeslice(base::Timeslice& ts, base::SubEvent* sub, unsigned source) override;
+
+         void CheckTimesliceMode() override;
+
+         void CheckCalibrProgress();
+
          unsigned TransformTdcData(hadaqs::RawSubevent* sub, uint32_t *rawdata, unsigned indx, unsigned datalen, hadaqs::RawSubevent* tgt = nullptr, unsigned tgtindx = 0);
 
          void EmulateTransform(int dummycnt);
@@ -103,6 +103,69 @@ namespace hadaq {
    /** subevent with \ref hadaq::MessageDouble */
    typedef base::SubEventEx<hadaq::MessageDouble> TdcSubEventDouble;
 
+   /** \brief Output integer message
+     *
+     * \ingroup stream_hadaq_classes
+     *
+     * Stores channel, edge and time stamp in ps relative to reference time of the subevent.
+     * Reference time is channel 0 (trigger) time in triggered analysis and
+     * trigger marker time in stream analysis, kept once in \ref hadaq::TdcSubEventInt
+     * Configured when calling base::ProcMgr::instance()->SetStoreKind(4); */
+
+   struct MessageInt {
+      uint32_t ch;    ///< channel and edge
+      int32_t stamp;  ///< time stamp minus reference time, ps
+
+      /**  stamp in ps */
+      int32_t getStamp() const { return stamp; }
+      /**  channel */
+      uint8_t getCh() const { return ch & 0x7F; }
+      /**  edge 0 - rising, 1 - falling */
+      uint8_t getEdge() const { return (ch >> 7) & 1; }
+      /**  is rising */
+      bool isRising() const { return getEdge() == 0; }
+      /**  is falling */
+      bool isFalling() const { return getEdge() == 1; }
+
+      /** constructor */
+      MessageInt() : ch(0), stamp(0) {}
+      /** constructor */
+      MessageInt(const MessageInt& src) : ch(src.ch), stamp(src.stamp) {}
+      /** constructor */
+      MessageInt(unsigned _ch, bool _rising, int32_t _stamp) :
+         ch(_ch | (_rising ? 0x00 : 0x80)),
+         stamp(_stamp)
+      {
+      }
+
+      /** compare operator - used for time sorting */
+      bool operator<(const MessageInt &rhs) const
+         { return (stamp < rhs.stamp); }
+
+      /** Convert time difference in seconds into ps stamp, rounded and limited to int32 range */
+      static int32_t ToStamp(double tm)
+      {
+         tm *= 1e12;
+         if (tm >= 2147483647.) return 2147483647;
+         if (tm <= -2147483648.) return -2147483647 - 1;
+         return (int32_t) (tm < 0 ? tm - 0.5 : tm + 0.5);
+      }
+   };
+
+   /** subevent with \ref hadaq::MessageInt, reference time in seconds */
+   class TdcSubEventInt : public base::SubEventEx<hadaq::MessageInt> {
+      double fTriggerTime = 0.;
+
+   public:
+      TdcSubEventInt(unsigned capacity = 0) : base::SubEventEx<hadaq::MessageInt>(capacity) {}
+
+      void SetTriggerTime(double tm) { fTriggerTime = tm; }
+      double GetTriggerTime() const { return fTriggerTime; }
+
+      /** full time of the message in seconds */
+      double GetTime(const hadaq::MessageInt &msg) const { return fTriggerTime + msg.getStamp()*1e-12; }
+   };
+
 }
 
 #endif
@@ -2,7 +2,6 @@
 #define HADAQ_TRBPROCESSOR_H
 
 #include "base/StreamProc.h"
-//#include "base/Profiler.h"
 #include "hadaq/definess.h"
 #include "hadaq/TdcProcessor.h"
 #include "hadaq/SubProcessor.h"
@@ -15,6 +14,8 @@ namespace hadaq {
 
    class ThreadData;
 
+   class TransformWorkers;
+
    /** message used for ROOT tree storage, similar to TdcMessage and AdcMessage */
    struct TrbMessage {
       bool fTrigSyncIdFound;              ///<  is sync id found
@@ -63,6 +64,7 @@ namespace hadaq {
          unsigned fLastTriggerId{0};    ///< last seen trigger id
          unsigned fLostTriggerCnt{0};   ///< lost trigger counts
          unsigned fTakenTriggerCnt{0};  ///< registered trigger counts
+         unsigned long fNumRejectedSubBufs{0}; ///< number of sub-buffers rejected by sub-processors with full queue
 
          base::H1handle fEvSize{nullptr};     ///< HADAQ event size
          unsigned fSubevHLen{0};        ///< maximal length of subevent in bytes
@@ -96,11 +98,26 @@ namespace hadaq {
          TrbMessage  fMsg;            ///< used for TTree store
          TrbMessage* pMsg{nullptr};    ///< used for TTree store
 
-//         base::Profiler  fProfiler;   ///< profiler
-
-         unsigned fMinTdc;         ///< minimal id of TDC
-         unsigned fMaxTdc;         ///< maximal id of TDC
-         std::vector<hadaq::TdcProcessor*> fTdcsVect; ///< array of TDCs
+         /** kind of sub-sub-event handler in dispatch table */
+         enum EDispatchKind {
+            kDispUnknown = 0,  ///< no handler
+            kDispHub = 1,      ///< HUB header
+            kDispCTS = 2,      ///< CTS header
+            kDispTdc = 3,      ///< TDC data
+            kDispDummy = 4,    ///< dummy 0x5555 header
+            kDispSub = 5       ///< any other sub-processor
+         };
+
+         /** processors assigned to sub-sub-event id */
+         struct DispatchProcs {
+            SubProcessor *sub{nullptr};       ///< sub-processor with such id
+            TdcProcessor *tdc{nullptr};       ///< TDC processor with such id
+            SubProcessor *attached{nullptr};  ///< processor attached to sub-processor, registered with id | 0xff0000
+         };
+
+         std::vector<uint16_t> fDispatch;          ///<! dispatch table for 16-bit ids, kind in upper 3 bits and index in fDispatchProcs in lower 13 bits
+         std::vector<DispatchProcs> fDispatchProcs; ///<! processors referenced from dispatch table, first entry is empty
+         bool fDispatchDirty{true};                ///<! when true, dispatch table must be rebuild
 
          hadaqs::RawSubevent   fLastSubevHdr; ///<! copy of last subevent header (without data)
          unsigned fCurrentRunId;           ///<! current runid
@@ -110,6 +127,10 @@ namespace hadaq {
 
          ThreadData *fThreadData{nullptr}; ///<! thread data, assigned from HldProcessor
 
+         TransformWorkers *fTransformWorkers{nullptr}; ///<! workers for parallel transform of TDC data
+         unsigned fTransformThreads{0};    ///<! number of extra threads used for transform
+         unsigned fTransformMinWords{0};   ///<! minimal subevent size in words for parallel transform
+
          static unsigned gNumChannels;     ///< default number of channels
          static unsigned gEdgesMask;       ///< default edges mask
          static bool gIgnoreSync;          ///< ignore sync in analysis, very rare used for sync with other data sources
@@ -132,6 +153,17 @@ namespace hadaq {
          /** Way to register sub-processor, like for TDC */
          void AddSub(SubProcessor* tdc, unsigned id);
 
+         void BuildDispatchTable();
+
+         /** Returns dispatch entry for sub-sub-event id, ids above 16 bit are not dispatched */
+         inline uint16_t GetDispatch(unsigned id) const { return id < 0x10000 ? fDispatch[id] : 0; }
+
+         /** Returns dispatch kind from entry */
+         static unsigned DispatchKind(uint16_t entry) { return entry >> 13; }
+
+         /** Returns processors from dispatch entry */
+         const DispatchProcs &GetDispatchProcs(uint16_t entry) const { return fDispatchProcs[entry & 0x1fff]; }
+
          /** Scan FPGA-TDC data, distribute over sub-processors */
          virtual void ScanSubEvent(hadaqs::RawSubevent* sub, unsigned trb3runid, unsigned trb3seqid);
 
@@ -140,15 +172,17 @@ namespace hadaq {
          void AfterEventScan();
          void AfterEventFill();
 
-         void BuildFastTDCVector();
-
          void CreateBranch(TTree* t) override;
 
          void EventError(const char *msg);
          void EventLog(const char *msg);
 
+         bool PassSubBuffer(SubProcessor *subproc, base::Buffer &&buf);
+
          void SetCrossProcessAll();
 
+         unsigned TransformSubEventParallel(hadaqs::RawSubevent *sub, hadaqs::RawSubevent *tgt, unsigned tgtlen, std::vector<unsigned> *newids);
+
          bool DogmaBufferScan(const base::Buffer &buf);
 
       public:
@@ -163,15 +197,16 @@ namespace hadaq {
          void SetAutoCreate(bool on = true) { fAutoCreate = on; }
 
          /** Set id of CTS sub-sub event */
-         void SetHadaqCTSId(unsigned id) { fHadaqCTSId = id; }
+         void SetHadaqCTSId(unsigned id) { fHadaqCTSId = id; fDispatchDirty = true; }
 
          /** Add HUB id */
-         void AddHadaqHUBId(unsigned id) { fHadaqHUBId.emplace_back(id); }
+         void AddHadaqHUBId(unsigned id) { fHadaqHUBId.emplace_back(id); fDispatchDirty = true; }
 
          /** Set up to 4 different HUB ids */
          void SetHadaqHUBId(unsigned id1, unsigned id2=0, unsigned id3=0, unsigned id4=0)
          {
             fHadaqHUBId.clear();
+            fDispatchDirty = true;
             AddHadaqHUBId(id1);
             if (id2!=0) AddHadaqHUBId(id2);
             if (id3!=0) AddHadaqHUBId(id3);
@@ -278,7 +313,7 @@ namespace hadaq {
             return nullptr;
          }
 
-         void AddBufferToTDC(
+         bool AddBufferToTDC(
                hadaqs::RawSubevent* sub,
                hadaq::SubProcessor* tdcproc,
                unsigned ix,
@@ -286,6 +321,10 @@ namespace hadaq {
 
          TdcProcessor* FindTDC(unsigned tdcid) const;
 
+         /** Returns number of sub-buffers, rejected by sub-processors because their queue reached limit.
+           * Data of such buffers are missing in produced events */
+         unsigned long GetNumRejectedSubBufs() const { return fNumRejectedSubBufs; }
+
          static void SetDefaults(unsigned numch=65, unsigned edges=0x1, bool ignore_sync = true);
 
          static unsigned GetDefaultNumCh();
@@ -340,6 +379,8 @@ namespace hadaq {
 
          unsigned EmulateTransform(hadaqs::RawSubevent *sub, int dummycnt, bool only_hist = false);
 
+         void SetTransformThreads(unsigned nthreads = 0, unsigned minwords = 2000);
+
          void CreatePerTDCHistos();
 
          /** Are there per-TDC histograms */
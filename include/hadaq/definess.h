@@ -2,6 +2,7 @@
 #define HADAQ_DEFINESS_H
 
 #include <cstdint>
+#include <cstring>
 
 //Description of the Event Structure
 //
@@ -116,6 +117,10 @@ namespace hadaqs {
 
 // #define HADAQ_SWAP4(value)  __builtin_bswap32(value)
 
+   /** Copy len 32-bit words from src to tgt with bytes swapping, tgt may be same as src.
+    * Uses SIMD shuffle when supported by CPU */
+   void SwapCopy4(uint32_t *tgt, const uint32_t *src, unsigned len);
+
    /**
     * HADES transport unit header
     * used as base for event and subevent
@@ -183,6 +188,8 @@ namespace hadaqs {
 
          /** set decoding */
          void SetDecoding(uint32_t decod) { SetValue(&tuDecoding, decod); }
+         /** init decoding, defines byte order of all other header fields */
+         void InitDecoding(uint32_t decod, bool swapped = false) { tuDecoding = swapped ? HADAQ_SWAP4(decod) : decod; }
    };
 
    // ======================================================================
@@ -498,6 +505,14 @@ namespace hadaqs {
          void CopyDataTo(void* buf, unsigned indx, unsigned datalen)
          {
             if (!buf) return;
+            if (Alignment() == 4) {
+               // complete block copied at once, swapping done for all words together
+               if (IsSwapped())
+                  SwapCopy4((uint32_t *) buf, GetDataPtr(indx), datalen);
+               else
+                  memcpy(buf, GetDataPtr(indx), datalen*4);
+               return;
+            }
             while (datalen-- > 0) {
                *((uint32_t*) buf) = Data(indx++);
                buf = ((uint32_t*) buf) + 1;
@@ -3,13 +3,57 @@
 
 #include "base/ProcMgr.h"
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+class TClass;
+class TBufferFile;
+
 /** Processors manager for using in ROOT environment */
 
 class TRootProcMgr : public base::ProcMgr {
+   protected:
+
+      /** object branch, used in asynchronous store */
+      struct StoreBranch {
+         TClass *fClass{nullptr};      ///< class of stored object
+         void **fObj{nullptr};         ///< pointer on object pointer, provided by processor
+         void *fWriterObj{nullptr};    ///< object filled by writer thread
+         void *fEmptyObj{nullptr};     ///< stored when processor does not provide object
+      };
+
+      unsigned fAsyncQueue{0};                  ///<! capacity of events queue, 0 - synchronous store
+      std::vector<StoreBranch *> fBranches;     ///<! object branches of asynchronous store
+      std::vector<TBufferFile *> fFreeSlots;    ///<! buffers which can be filled with next event
+      std::deque<TBufferFile *> fReadySlots;    ///<! serialized events, waiting for writer thread
+      std::mutex fQueueMutex;                   ///<! protects queue and writer state
+      std::condition_variable fQueueCond;       ///<! signals changes in queue
+      std::mutex fStreamMutex;                  ///<! serializes objects streaming into and out of queue buffers
+      std::thread fWriter;                      ///<! writer thread
+      bool fWriterRunning{false};               ///<! true when writer thread started
+      bool fWriterStop{false};                  ///<! request writer thread to stop
+      bool fWriterBusy{false};                  ///<! writer thread processes event
+      unsigned long fNumQueueFull{0};           ///<! number of events, which waited for free buffer
+
+      void WriterLoop();
+      void StartWriter();
+      void StopWriter();
+      void WaitWriterIdle();
+
+      /** Histograms created by base implementation, compact storage can be used */
+      bool CanCompactHist() const override { return true; }
+
    public:
       TRootProcMgr();
       virtual ~TRootProcMgr();
 
+      void SetAsyncStore(unsigned queuesize = 100);
+
+      /** Returns true if asynchronous store configured */
+      bool IsAsyncStore() const { return fAsyncQueue > 0; }
+
       bool CreateStore(const char* storename) override;
       bool CloseStore() override;
 
@@ -22,4 +66,3 @@ class TRootProcMgr : public base::ProcMgr {
 };
 
 #endif
-